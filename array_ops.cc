@@ -0,0 +1,155 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "array_ops.h"
+
+#include <algorithm>
+
+namespace Calc::array_ops {
+
+namespace {
+
+/// The number of independent accumulators, (enough for two 256 bit
+/// registers of 32 bit lanes).
+constexpr std::size_t lanes = 16u;
+
+} // namespace
+
+int
+sum(const int *a, std::size_t n)
+{
+    unsigned acc[lanes] = { };
+    auto i = 0u;
+    for (; i + lanes <= n; i += lanes) {
+        for (auto j = 0u; j < lanes; ++j) {
+            acc[j] += static_cast<unsigned>(a[i + j]);
+        }
+    }
+    unsigned total = 0u;
+    for (; i < n; ++i) {
+        total += static_cast<unsigned>(a[i]);
+    }
+    for (auto j = 0u; j < lanes; ++j) {
+        total += acc[j];
+    }
+    return static_cast<int>(total);
+}
+
+int
+min(const int *a, std::size_t n)
+{
+    int acc[lanes];
+    std::fill(acc, acc + lanes, a[0]);
+    auto i = 0u;
+    for (; i + lanes <= n; i += lanes) {
+        for (auto j = 0u; j < lanes; ++j) {
+            acc[j] = a[i + j] < acc[j] ? a[i + j] : acc[j];
+        }
+    }
+    for (; i < n; ++i) {
+        acc[0] = a[i] < acc[0] ? a[i] : acc[0];
+    }
+    return *std::min_element(acc, acc + lanes);
+}
+
+int
+max(const int *a, std::size_t n)
+{
+    int acc[lanes];
+    std::fill(acc, acc + lanes, a[0]);
+    auto i = 0u;
+    for (; i + lanes <= n; i += lanes) {
+        for (auto j = 0u; j < lanes; ++j) {
+            acc[j] = a[i + j] > acc[j] ? a[i + j] : acc[j];
+        }
+    }
+    for (; i < n; ++i) {
+        acc[0] = a[i] > acc[0] ? a[i] : acc[0];
+    }
+    return *std::max_element(acc, acc + lanes);
+}
+
+int
+dot(const int *a, const int *b, std::size_t n)
+{
+    unsigned acc[lanes] = { };
+    auto i = 0u;
+    for (; i + lanes <= n; i += lanes) {
+        for (auto j = 0u; j < lanes; ++j) {
+            acc[j] += static_cast<unsigned>(a[i + j]) *
+                      static_cast<unsigned>(b[i + j]);
+        }
+    }
+    unsigned total = 0u;
+    for (; i < n; ++i) {
+        total += static_cast<unsigned>(a[i]) * static_cast<unsigned>(b[i]);
+    }
+    for (auto j = 0u; j < lanes; ++j) {
+        total += acc[j];
+    }
+    return static_cast<int>(total);
+}
+
+void
+fill(int *a, std::size_t n, int value)
+{
+    std::fill(a, a + n, value);
+}
+
+int
+prefix_sum(int *a, std::size_t n)
+{
+    // Each block is scanned on its own, (steps which don't depend on
+    // each other), and then the total of the blocks before it is added.
+    constexpr std::size_t block = 8u;
+    unsigned carry = 0u;
+    auto i = 0u;
+    for (; i + block <= n; i += block) {
+        unsigned v[block];
+        for (auto j = 0u; j < block; ++j) {
+            v[j] = static_cast<unsigned>(a[i + j]);
+        }
+        for (auto step = 1u; step < block; step *= 2u) {
+            unsigned shifted[block];
+            for (auto j = 0u; j < block; ++j) {
+                shifted[j] = j >= step ? v[j - step] : 0u;
+            }
+            for (auto j = 0u; j < block; ++j) {
+                v[j] += shifted[j];
+            }
+        }
+        for (auto j = 0u; j < block; ++j) {
+            a[i + j] = static_cast<int>(v[j] + carry);
+        }
+        carry += v[block - 1u];
+    }
+    for (; i < n; ++i) {
+        carry += static_cast<unsigned>(a[i]);
+        a[i] = static_cast<int>(carry);
+    }
+    return a[n - 1u];
+}
+
+} // namespace Calc::array_ops
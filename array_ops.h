@@ -0,0 +1,51 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef ARRAY_OPS_H_INCLUDED
+#define ARRAY_OPS_H_INCLUDED
+
+#include <cstddef>
+
+namespace Calc::array_ops {
+
+/// The kernels of the builtin functions on arrays, (see
+/// Node::array_builtin).  Each works on contiguous elements, with loops the
+/// compiler can vectorize, (several independent accumulators, and no
+/// branches).  Sums wrap around rather than overflow, as the sums of
+/// parallel loops do.  Every array has at least one element.
+
+int sum(const int *a, std::size_t n);
+int min(const int *a, std::size_t n);
+int max(const int *a, std::size_t n);
+int dot(const int *a, const int *b, std::size_t n);
+void fill(int *a, std::size_t n, int value);
+
+/// Replace each element with the sum of those up to and including it.
+/// @return The last element.
+int prefix_sum(int *a, std::size_t n);
+
+} // namespace Calc::array_ops
+
+#endif // ARRAY_OPS_H_INCLUDED
@@ -0,0 +1,99 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "atomic_marker.h"
+#include "liveness.h"
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+bool
+refers_to(const node &n, const node &var)
+{
+    auto ref = n.get_kind<variable_ref>();
+    return ref && ref->symbol_ == &var;
+}
+
+bool
+reads(const node &expr, const node &var)
+{
+    var_set vars;
+    collect_reads(expr, vars);
+    return vars.count(&var) != 0u;
+}
+
+} // namespace
+
+atomic_form
+atomic_marker::classify(const node &var, const node &expr)
+{
+    if (!reads(expr, var)) {
+        return atomic_form::store;
+    }
+    if (expr.get_kind<addition>() || expr.get_kind<subtraction>()) {
+        auto &lhs = *expr.children[0];
+        auto &rhs = *expr.children[1];
+        if (refers_to(lhs, var) && !reads(rhs, var)) {
+            return expr.get_kind<addition>() ? atomic_form::add
+                                             : atomic_form::subtract;
+        }
+        if (expr.get_kind<addition>() && refers_to(rhs, var) &&
+            !reads(lhs, var)) {
+            return atomic_form::add;
+        }
+    }
+    return effects_.pure(expr) ? atomic_form::update : atomic_form::store;
+}
+
+void
+atomic_marker::mark(node &n)
+{
+    ++visited_;
+    if (auto a = n.get_kind<assignment_statement>(); a) {
+        auto var = n.children[0]->get_kind<variable_ref>()->symbol_;
+        if (var->get_kind<variable>()->cell_) {
+            a->atomic_ = classify(*var, *n.children[1]);
+            ++marked_;
+        } else {
+            a->atomic_ = atomic_form::none;
+        }
+    }
+    for (auto &child : n.children) {
+        mark(*child);
+    }
+}
+
+std::size_t
+atomic_marker::run(node &root)
+{
+    auto marked = marked_;
+    mark(root);
+    return marked_ - marked;
+}
+
+} // namespace Calc
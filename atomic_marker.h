@@ -0,0 +1,71 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef ATOMIC_MARKER_H_INCLUDED
+#define ATOMIC_MARKER_H_INCLUDED
+
+#include "node.h"
+#include "effects.h"
+
+namespace Calc {
+
+/// Choose how each assignment to a shared variable is made, (see
+/// atomic_form).  An update is retried until no other script has changed
+/// the variable in the meantime, so its expression must be pure; one which
+/// isn't is evaluated once and stored, (and an update made by another
+/// script meanwhile is lost).  Run after the transforms, since they may
+/// change the shape of the assigned expression.
+class atomic_marker
+{
+public:
+    atomic_marker() = default;
+    atomic_marker(const atomic_marker &) = delete;
+    atomic_marker(atomic_marker &&) = default;
+    ~atomic_marker() = default;
+
+    atomic_marker& operator=(const atomic_marker &) = delete;
+    atomic_marker& operator=(atomic_marker &&) = default;
+
+    /// Mark the assignments in an analyzed tree.
+    /// @return The number of assignments to shared variables.
+    std::size_t run(Node::node &root);
+
+    /// The number of nodes looked at so far.
+    std::size_t visited() const             { return visited_; }
+
+private:
+    void mark(Node::node &n);
+
+    /// Classify an assignment to the shared variable var.
+    Node::atomic_form classify(const Node::node &var, const Node::node &expr);
+
+    effect_analysis effects_;
+    std::size_t     visited_{0u};
+    std::size_t     marked_{0u};
+};
+
+} // namespace Calc
+
+#endif // ATOMIC_MARKER_H_INCLUDED
@@ -0,0 +1,858 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "batch.h"
+#include "column_file.h"
+#include "csv.h"
+#include "dataflow.h"
+#include "shard.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+[[noreturn]] void
+malformed(const std::string &source, std::size_t line,
+          const std::string &message)
+{
+    throw std::runtime_error(source + ": " + std::to_string(line) + ": " +
+                             message);
+}
+
+} // namespace
+
+batch::batch(node &root, std::size_t frame_size) :
+    root_(root), frame_size_(frame_size),
+    vector_(vector_evaluator::supports(root))
+{
+}
+
+void
+batch::aggregate(std::string_view spec)
+{
+    auto bad = [spec](const std::string &why)
+        {
+            return std::runtime_error("Aggregate '" + std::string(spec) +
+                                      "': " + why);
+        };
+    std::vector<std::string_view> parts;
+    for (auto rest = spec; ; ) {
+        auto colon = rest.find(':');
+        parts.push_back(csv::trim(rest.substr(0, colon)));
+        if (colon == std::string_view::npos) {
+            break;
+        }
+        rest.remove_prefix(colon + 1);
+    }
+    using kind = aggregate_spec::kind;
+    aggregate_spec a;
+    a.spec_ = spec;
+    auto what = parts[0];
+    if (what == "count") {
+        if (parts.size() != 1u) {
+            throw bad("expected 'count'.");
+        }
+        aggregates_.push_back(std::move(a));
+        return;
+    }
+    if (what == "sum" || what == "min" || what == "max") {
+        if (parts.size() != 2u || parts[1].empty()) {
+            throw bad("expected '" + std::string(what) + ":variable'.");
+        }
+        a.kind_ = what == "sum" ? kind::sum :
+                  what == "min" ? kind::min : kind::max;
+    } else if (what == "histogram") {
+        int buckets = 0;
+        if (parts.size() != 5u || parts[1].empty() ||
+            !csv::to_int(parts[2], a.low_) ||
+            !csv::to_int(parts[3], a.high_) ||
+            !csv::to_int(parts[4], buckets)) {
+            throw bad("expected 'histogram:variable:low:high:ranges'.");
+        }
+        if (a.high_ <= a.low_ || buckets < 1 || buckets > 1 << 16) {
+            throw bad("low must be less than high, with from 1 to 65536 "
+                      "ranges.");
+        }
+        a.kind_ = kind::histogram;
+        a.buckets_ = static_cast<std::size_t>(buckets);
+    } else {
+        throw bad("expected count, sum, min, max or histogram.");
+    }
+    a.name_ = parts[1];
+    aggregates_.push_back(std::move(a));
+}
+
+void
+batch::partial::add(const aggregate_spec &spec, int value)
+{
+    if (count_++ == 0u) {
+        min_ = max_ = value;
+    } else {
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+    }
+    sum_ += value;
+    if (spec.kind_ != aggregate_spec::kind::histogram) {
+        return;
+    }
+    if (buckets_.empty()) {
+        buckets_.resize(spec.buckets_ + 2u);
+    }
+    std::size_t bucket;
+    if (value < spec.low_) {
+        bucket = 0u;
+    } else if (value >= spec.high_) {
+        bucket = spec.buckets_ + 1u;
+    } else {
+        // Range k holds the values v for which (v - low) * n / (high - low)
+        // is k.
+        std::int64_t width = std::int64_t(spec.high_) - spec.low_;
+        bucket = 1u + static_cast<std::size_t>(
+            (std::int64_t(value) - spec.low_) *
+            static_cast<std::int64_t>(spec.buckets_) / width);
+    }
+    ++buckets_[bucket];
+}
+
+void
+batch::partial::merge(const partial &other)
+{
+    if (other.count_ == 0u) {
+        return;
+    }
+    if (count_ == 0u) {
+        *this = other;
+        return;
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+    if (buckets_.size() < other.buckets_.size()) {
+        buckets_.resize(other.buckets_.size());
+    }
+    for (auto i = 0u; i < other.buckets_.size(); ++i) {
+        buckets_[i] += other.buckets_[i];
+    }
+}
+
+template <typename Value>
+void
+batch::accumulate(worker &w, Value value)
+{
+    for (auto i = 0u; i < aggregates_.size(); ++i) {
+        auto &spec = aggregates_[i];
+        w.partials_[i].add(spec, spec.var_ ? value(spec.var_) : 0);
+    }
+}
+
+void
+batch::merge()
+{
+    totals_.resize(aggregates_.size());
+    for (auto &w : workers_) {
+        w->partials_.resize(aggregates_.size());
+        for (auto i = 0u; i < aggregates_.size(); ++i) {
+            totals_[i].merge(w->partials_[i]);
+            w->partials_[i] = partial{};
+        }
+    }
+}
+
+void
+batch::write_aggregates(std::ostream &os) const
+{
+    using kind = aggregate_spec::kind;
+    os << "aggregate,value\n";
+    for (auto i = 0u; i < aggregates_.size(); ++i) {
+        auto &spec = aggregates_[i];
+        auto t = i < totals_.size() ? totals_[i] : partial{};
+        switch (spec.kind_) {
+        case kind::count:
+            os << spec.spec_ << ',' << t.count_ << '\n';
+            break;
+        case kind::sum:
+            os << spec.spec_ << ',' << t.sum_ << '\n';
+            break;
+        case kind::min:
+        case kind::max:
+            os << spec.spec_ << ',';
+            if (t.count_) {
+                os << (spec.kind_ == kind::min ? t.min_ : t.max_);
+            }
+            os << '\n';
+            break;
+        case kind::histogram: {
+            t.buckets_.resize(spec.buckets_ + 2u);
+            auto prefix = "histogram:" + spec.name_ + ":";
+            std::int64_t width = std::int64_t(spec.high_) - spec.low_;
+            auto n = static_cast<std::int64_t>(spec.buckets_);
+            auto start = [&](std::int64_t k)
+                {
+                    return spec.low_ + (k * width + n - 1) / n;
+                };
+            os << prefix << '<' << spec.low_ << ',' << t.buckets_[0] << '\n';
+            for (std::int64_t k = 0; k < n; ++k) {
+                os << prefix << start(k) << ".." << start(k + 1) - 1 << ','
+                   << t.buckets_[k + 1] << '\n';
+            }
+            os << prefix << ">=" << spec.high_ << ','
+               << t.buckets_[spec.buckets_ + 1u] << '\n';
+            break;
+        }
+        }
+    }
+}
+
+void
+batch::range(std::string_view spec)
+{
+    auto high = spec.rfind(':');
+    auto low = high == std::string_view::npos || high == 0u ?
+               std::string_view::npos : spec.rfind(':', high - 1u);
+    interval values;
+    int first = 0, last = 0;
+    if (low == std::string_view::npos || low == 0u ||
+        !csv::to_int(csv::trim(spec.substr(low + 1u, high - low - 1u)),
+                     first) ||
+        !csv::to_int(csv::trim(spec.substr(high + 1u)), last) ||
+        first > last) {
+        throw std::runtime_error("Range '" + std::string(spec) + "': "
+                                 "expected 'column:low:high', with low no "
+                                 "more than high.");
+    }
+    values.low_ = first;
+    values.high_ = last;
+    declared_.emplace_back(std::string(csv::trim(spec.substr(0u, low))),
+                           values);
+}
+
+node*
+batch::find(std::string_view name) const
+{
+    auto r = root_.get_kind<root>();
+    if (!r || !r->scope_) {
+        return nullptr;
+    }
+    for (auto &child : r->scope_->children) {
+        auto var = child->get_kind<variable>();
+        if (var && var->name_ == name) {
+            return child.get();
+        }
+    }
+    return nullptr;
+}
+
+void
+batch::bind(const std::vector<std::string_view> &names,
+            const std::string &source)
+{
+    for (auto name : names) {
+        auto var = find(name);
+        if (var && var->get_kind<variable>()->cell_) {
+            malformed(source, 1u, "Column '" + std::string(name) +
+                                  "' names a shared variable.");
+        }
+        if (var && var->get_kind<variable>()->length_) {
+            malformed(source, 1u, "Column '" + std::string(name) +
+                                  "' names an array.");
+        }
+        inputs_.push_back(var);
+        limits_.push_back(interval::full());
+        for (auto &[column, values] : declared_) {
+            if (column == name) {
+                limits_.back() = values;
+            }
+        }
+    }
+    for (auto &declared : declared_) {
+        if (std::find(names.begin(), names.end(), declared.first) ==
+            names.end()) {
+            throw std::runtime_error("No column '" + declared.first +
+                                     "' to declare the range of.");
+        }
+    }
+    hoist();
+
+    for (auto &a : aggregates_) {
+        if (a.kind_ == aggregate_spec::kind::count) {
+            continue;
+        }
+        a.var_ = find(a.name_);
+        if (!a.var_) {
+            throw std::runtime_error("No top-level variable '" + a.name_ +
+                                     "' to aggregate.");
+        }
+        if (a.var_->get_kind<variable>()->length_) {
+            throw std::runtime_error("'" + a.name_ + "' is an array, and "
+                                     "cannot be aggregated.");
+        }
+    }
+
+    if (!result_names_.empty()) {
+        for (auto &name : result_names_) {
+            auto var = find(name);
+            if (!var) {
+                throw std::runtime_error("No top-level variable '" + name +
+                                         "' to write.");
+            }
+            if (var->get_kind<variable>()->length_) {
+                throw std::runtime_error("'" + name + "' is an array, and "
+                                         "cannot be written.");
+            }
+            results_.push_back(var);
+        }
+        return;
+    }
+    if (auto r = root_.get_kind<root>(); r && r->scope_) {
+        for (auto &child : r->scope_->children) {
+            auto var = child->get_kind<variable>();
+            if (var && !var->length_ &&
+                std::find(inputs_.begin(), inputs_.end(),
+                          child.get()) == inputs_.end()) {
+                result_names_.push_back(var->name_);
+                results_.push_back(child.get());
+            }
+        }
+    }
+}
+
+void
+batch::hoist()
+{
+    statements_.clear();
+    std::vector<std::size_t> slots;
+    for (auto var : inputs_) {
+        if (var) {
+            slots.push_back(var->get_kind<variable>()->slot_);
+        }
+    }
+    auto invariant = invariant_statements(root_, slots);
+    std::vector<node *> prologue;
+    for (auto i = 0u; i < root_.children.size(); ++i) {
+        auto stmt = root_.children[i].get();
+        (invariant[i] ? prologue : statements_).push_back(stmt);
+    }
+
+    std::ostream discard(nullptr);
+    evaluator eval(frame_size_, discard);
+    try {
+        for (auto stmt : prologue) {
+            eval.accept(*stmt);
+        }
+    } catch (...) {
+        // Left for each record to fail on, as it would have.
+        statements_.clear();
+        for (auto &child : root_.children) {
+            statements_.push_back(child.get());
+        }
+        initial_.assign(frame_size_, 0);
+        hoisted_ = 0u;
+        return;
+    }
+    initial_ = eval.slots();
+    hoisted_ = prologue.size();
+}
+
+std::vector<interval>
+batch::observed(std::size_t first, std::size_t last) const
+{
+    if (first == last) {
+        return limits_;
+    }
+    std::vector<interval> columns(inputs_.size());
+    for (auto i = 0u; i < inputs_.size(); ++i) {
+        if (!inputs_[i]) {
+            continue;
+        }
+        auto values = in_columns_[i];
+        auto [low, high] = std::minmax_element(values + first,
+                                               values + last);
+        columns[i] = {*low, *high};
+        auto &limit = limits_[i];
+        if (*low < limit.low_ || *high > limit.high_) {
+            auto value = *low < limit.low_ ? *low : *high;
+            throw std::runtime_error("Column '" +
+                inputs_[i]->get_kind<variable>()->name_ + "' holds " +
+                std::to_string(value) + ", outside its range, (" +
+                std::to_string(limit.low_) + " to " +
+                std::to_string(limit.high_) + ").");
+        }
+    }
+    return columns;
+}
+
+void
+batch::narrow(const std::vector<interval> &columns)
+{
+    // Each record starts with the values the hoisted statements left,
+    // and those of its columns.
+    value_range ranges(frame_size_);
+    for (auto slot = 0u; slot < initial_.size(); ++slot) {
+        ranges.seed(slot, {initial_[slot], initial_[slot]});
+    }
+    for (auto i = 0u; i < inputs_.size(); ++i) {
+        if (auto var = inputs_[i]; var) {
+            ranges.seed(var->get_kind<variable>()->slot_, columns[i]);
+        }
+    }
+    ranges.run(statements_);
+    narrowed_ = ranges.mark(statements_, vector_ && narrow_);
+}
+
+void
+batch::record(worker &w, std::string_view line, const std::string &source,
+              std::size_t number, std::ostream &out)
+{
+    auto &fields = w.fields_;
+    csv::split(line, fields);
+    if (fields.size() != inputs_.size()) {
+        malformed(source, number, "Expected " +
+                  std::to_string(inputs_.size()) + " fields, found " +
+                  std::to_string(fields.size()) + ".");
+    }
+    if (vector_ && w.pending_ == 0u) {
+        w.vector_eval_.reset(initial_);
+    } else if (!vector_) {
+        w.eval_.reset(initial_);
+    }
+    for (auto i = 0u; i < fields.size(); ++i) {
+        auto var = inputs_[i];
+        if (!var) {
+            continue;
+        }
+        int value = 0;
+        if (!csv::to_int(fields[i], value)) {
+            malformed(source, number, "'" + std::string(fields[i]) +
+                      "' is not an integer.");
+        }
+        if (value < limits_[i].low_ || value > limits_[i].high_) {
+            malformed(source, number, "'" + std::string(fields[i]) +
+                      "' is outside the range of its column, (" +
+                      std::to_string(limits_[i].low_) + " to " +
+                      std::to_string(limits_[i].high_) + ").");
+        }
+        auto slot = var->get_kind<variable>()->slot_;
+        if (vector_) {
+            w.vector_eval_.column(slot)[w.pending_] = value;
+        } else {
+            w.eval_.slot(slot) = value;
+        }
+    }
+    if (vector_) {
+        if (++w.pending_ == vector_evaluator::width) {
+            flush(w, out);
+        }
+        return;
+    }
+    for (auto stmt : statements_) {
+        w.eval_.accept(*stmt);
+    }
+    accumulate(w, [&w](node *var) { return w.eval_.load(var); });
+    if (!rows_) {
+        return;
+    }
+
+    auto separator = "";
+    for (auto var : results_) {
+        out << separator << w.eval_.load(var);
+        separator = ",";
+    }
+    out << '\n';
+}
+
+void
+batch::flush(worker &w, std::ostream &out)
+{
+    if (w.pending_ == 0u) {
+        return;
+    }
+    auto &v = w.vector_eval_;
+    v.run(statements_, w.pending_);
+    for (auto lane = 0u; lane < w.pending_; ++lane) {
+        accumulate(w, [&v, lane](node *var)
+            {
+                return v.column(var->get_kind<variable>()->slot_)[lane];
+            });
+    }
+    for (auto lane = 0u; rows_ && lane < w.pending_; ++lane) {
+        auto separator = "";
+        for (auto var : results_) {
+            out << separator
+                << w.vector_eval_.column(var->get_kind<variable>()->slot_)[lane];
+            separator = ",";
+        }
+        out << '\n';
+    }
+    w.pending_ = 0u;
+}
+
+void
+batch::evaluate(worker &w, chunk &c, const std::string &source)
+{
+    std::ostringstream out;
+    try {
+        for (auto i = 0u; i < c.lines_.size(); ++i) {
+            record(w, c.lines_[i], source, c.numbers_[i], out);
+            ++c.records_;
+        }
+    } catch (...) {
+        // The records before the malformed one are still written.
+        c.error_ = std::current_exception();
+    }
+    try {
+        flush(w, out);
+    } catch (...) {
+        if (!c.error_) {
+            c.error_ = std::current_exception();
+        }
+    }
+    w.pending_ = 0u;
+    c.output_ = out.str();
+    c.done_.set_value();
+}
+
+std::size_t
+batch::run(std::istream &in, const std::string &source, std::ostream &out)
+{
+    auto start = clock::now();
+    auto records = records_;
+    std::string line;
+    if (!std::getline(in, line)) {
+        malformed(source, 1u, "No header line.");
+    }
+    std::vector<std::string_view> names;
+    csv::split(line, names);
+    bind(names, source);
+    narrow(limits_);
+    if (rows_) {
+        auto separator = "";
+        for (auto &name : result_names_) {
+            out << separator << name;
+            separator = ",";
+        }
+        out << '\n';
+    }
+
+    // Each chunk is evaluated by a task of its own, with the worker state
+    // its place in the input picks.  A chunk is submitted only when the
+    // one which used that state last has been written, so no state is ever
+    // used by two tasks at once, and the memory held by chunks waiting to
+    // be written is bounded.
+    auto threads = pool_ ? pool_->size() : 1u;
+    auto limit = pool_ ? threads * 4u : 1u;
+    while (workers_.size() < limit) {
+        workers_.push_back(std::make_unique<worker>(frame_size_));
+    }
+    for (auto &w : workers_) {
+        w->partials_.resize(aggregates_.size());
+    }
+    std::deque<std::unique_ptr<chunk>> chunks;
+    std::size_t submitted = 0u;
+    std::exception_ptr error;
+
+    // Write the oldest chunk, once it is done.
+    auto write = [&]
+        {
+            auto &c = *chunks.front();
+            c.finished_.wait();
+            out << c.output_;
+            records_ += c.records_;
+            if (c.error_ && !error) {
+                error = c.error_;
+            }
+            chunks.pop_front();
+        };
+    auto submit = [&](std::unique_ptr<chunk> c)
+        {
+            if (chunks.size() == limit) {
+                write();
+            }
+            auto &w = *workers_[submitted++ % limit];
+            auto &next = *c;
+            chunks.push_back(std::move(c));
+            if (pool_) {
+                pool_->submit([this, &w, &next, &source]
+                    {
+                        evaluate(w, next, source);
+                    });
+            } else {
+                evaluate(w, next, source);
+            }
+        };
+
+    auto number = 1u;
+    auto c = std::make_unique<chunk>();
+    while (!error && std::getline(in, line)) {
+        ++number;
+        if (csv::trim(line).empty()) {
+            continue;
+        }
+        c->lines_.push_back(std::move(line));
+        c->numbers_.push_back(number);
+        if (c->lines_.size() == chunk_size_) {
+            submit(std::move(c));
+            c = std::make_unique<chunk>();
+        }
+    }
+    if (!error && !c->lines_.empty()) {
+        submit(std::move(c));
+    }
+    // After a malformed record, the chunks after it are still waited for,
+    // (they use the worker state), but nothing more is written.
+    while (!chunks.empty()) {
+        if (error) {
+            chunks.front()->finished_.wait();
+            chunks.pop_front();
+        } else {
+            write();
+        }
+    }
+    out.flush();
+    merge();
+    elapsed_ += clock::now() - start;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return records_ - records;
+}
+
+void
+batch::evaluate(worker &w, std::size_t first, std::size_t last)
+{
+    if (vector_) {
+        // Each block of rows is copied straight from the input mapping,
+        // and its results straight into the output mapping.
+        auto &v = w.vector_eval_;
+        for (auto row = first; row < last; row += vector_evaluator::width) {
+            auto count = std::min(vector_evaluator::width, last - row);
+            v.reset(initial_);
+            for (auto i = 0u; i < inputs_.size(); ++i) {
+                if (auto var = inputs_[i]; var) {
+                    auto slot = var->get_kind<variable>()->slot_;
+                    std::copy_n(in_columns_[i] + row, count,
+                                v.column(slot).begin());
+                }
+            }
+            v.run(statements_, count);
+            for (auto lane = 0u; lane < count; ++lane) {
+                accumulate(w, [&v, lane](node *var)
+                    {
+                        return v.column(var->get_kind<variable>()->slot_)[lane];
+                    });
+            }
+            for (auto i = 0u; i < out_columns_.size(); ++i) {
+                auto slot = results_[i]->get_kind<variable>()->slot_;
+                std::copy_n(v.column(slot).begin(), count,
+                            out_columns_[i] + (row - out_first_));
+            }
+        }
+        return;
+    }
+    for (auto row = first; row < last; ++row) {
+        w.eval_.reset(initial_);
+        for (auto i = 0u; i < inputs_.size(); ++i) {
+            if (auto var = inputs_[i]; var) {
+                w.eval_.slot(var->get_kind<variable>()->slot_) =
+                    in_columns_[i][row];
+            }
+        }
+        for (auto stmt : statements_) {
+            w.eval_.accept(*stmt);
+        }
+        accumulate(w, [&w](node *var) { return w.eval_.load(var); });
+        for (auto i = 0u; i < out_columns_.size(); ++i) {
+            out_columns_[i][row - out_first_] = w.eval_.load(results_[i]);
+        }
+    }
+}
+
+std::exception_ptr
+batch::dispatch(std::size_t first, std::size_t last)
+{
+    // Every row has its own place in the output, so the chunks may be
+    // evaluated in any order: each thread takes the next one until there
+    // are none left.
+    auto chunks = (last - first + chunk_size_ - 1u) / chunk_size_;
+    auto tasks = pool_ ? std::min(pool_->size(), chunks) : 1u;
+    while (workers_.size() < tasks) {
+        workers_.push_back(std::make_unique<worker>(frame_size_));
+    }
+    for (auto &w : workers_) {
+        w->partials_.resize(aggregates_.size());
+    }
+    std::atomic<std::size_t> next{0u};
+    std::mutex mutex;
+    std::condition_variable finished;
+    auto running = tasks;
+    std::vector<std::exception_ptr> errors(tasks);
+    auto work = [&](std::size_t task)
+        {
+            try {
+                for (auto c = next++; c < chunks; c = next++) {
+                    auto from = first + c * chunk_size_;
+                    evaluate(*workers_[task], from,
+                             std::min(last, from + chunk_size_));
+                }
+            } catch (...) {
+                errors[task] = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0u) {
+                finished.notify_all();
+            }
+        };
+    if (pool_) {
+        for (auto t = 0u; t < tasks; ++t) {
+            pool_->submit([&work, t] { work(t); });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&running] { return running == 0u; });
+    } else {
+        work(0u);
+    }
+    merge();
+    for (auto &error : errors) {
+        if (error) {
+            return error;
+        }
+    }
+    return nullptr;
+}
+
+void
+batch::bind(const column_reader &in)
+{
+    std::vector<std::string_view> names(in.names().begin(),
+                                        in.names().end());
+    bind(names, in.path());
+    in_columns_.clear();
+    for (auto i = 0u; i < names.size(); ++i) {
+        in_columns_.push_back(in.column(i));
+    }
+}
+
+std::size_t
+batch::run(const column_reader &in, const std::string &output)
+{
+    auto start = clock::now();
+    bind(in);
+    std::unique_ptr<column_writer> out;
+    if (!output.empty()) {
+        out = std::make_unique<column_writer>(output, result_names_,
+                                              in.rows());
+    }
+    out_columns_.clear();
+    for (auto i = 0u; out && i < results_.size(); ++i) {
+        out_columns_.push_back(out->column(i));
+    }
+    out_first_ = 0u;
+
+    auto rows = in.rows();
+    narrow(observed(0u, rows));
+    auto error = dispatch(0u, rows);
+    elapsed_ += clock::now() - start;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    records_ += rows;
+    return rows;
+}
+
+std::size_t
+batch::run(const column_reader &in, std::size_t first, std::size_t last,
+           std::ostream &out)
+{
+    auto start = clock::now();
+    if (first > last || last > in.rows()) {
+        throw std::runtime_error(in.path() + ": No rows " +
+                                 std::to_string(first) + " to " +
+                                 std::to_string(last) + ", (it has " +
+                                 std::to_string(in.rows()) + ").");
+    }
+    bind(in);
+    auto rows = last - first;
+    std::vector<std::vector<int>> values(results_.size(),
+                                         std::vector<int>(rows));
+    out_columns_.clear();
+    for (auto &column : values) {
+        out_columns_.push_back(column.data());
+    }
+    out_first_ = first;
+
+    narrow(observed(first, last));
+    auto error = dispatch(first, last);
+    elapsed_ += clock::now() - start;
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    std::vector<const int *> columns(values.size());
+    for (auto i = 0u; i < values.size(); ++i) {
+        columns[i] = values[i].data();
+    }
+    write_shard(out, result_names_, first, rows, columns);
+    records_ += rows;
+    return rows;
+}
+
+void
+batch::report(std::ostream &os) const
+{
+    using us = std::chrono::microseconds;
+    auto micros = std::chrono::duration_cast<us>(elapsed_).count();
+    os << "Batch: " << records_ << " records in " << micros << " us";
+    if (micros) {
+        os << ", (" << records_ * 1000000u / micros << " records per second";
+        if (vector_) {
+            os << ", " << vector_evaluator::width << " at a time";
+        }
+        if (pool_) {
+            os << ", on " << pool_->size() << " threads";
+        }
+        os << ")";
+    }
+    if (hoisted_) {
+        os << ", " << hoisted_ << " of " << root_.children.size()
+           << " statements evaluated once";
+    }
+    if (narrowed_.first) {
+        os << ", " << narrowed_.first << " of " << narrowed_.second
+           << " operations in 8 or 16 bit lanes";
+    }
+    os << '\n';
+}
+
+} // namespace Calc
@@ -0,0 +1,290 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+#include "node.h"
+#include "evaluator.h"
+#include "vector_evaluator.h"
+#include "value_range.h"
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Calc {
+
+class thread_pool;
+class column_reader;
+
+/// Evaluate a compiled script once for each record of a CSV file.
+/// The first line of the file names the columns.  A column which names a
+/// top-level variable of the script sets it before each record is
+/// evaluated; other columns are ignored.  Every other variable starts at 0
+/// for each record, (as when the script is run on its own), and what the
+/// script prints is thrown away.  After each record, the result variables
+/// are written as a line of CSV, (after a line naming them).
+/// Where the script allows it, records are evaluated a block at a time by
+/// a vector_evaluator.  With a thread pool, the records are read in chunks
+/// which are evaluated at the same time, and written in the order they
+/// were read.  The top-level statements which don't depend on the columns,
+/// (see invariant_statements), are evaluated just once, and each record
+/// starts from the values they left.  Aggregates of the variables over
+/// every record, (sums, minimums and so on), are kept by each thread, and
+/// merged at the end, so the results of each record need not be written.
+/// The operations whose values are known to fit in 8 or 16 bits, given
+/// those of the columns, (declared, or those in a column file), are
+/// vectorized in narrower lanes, (see value_range).
+class batch
+{
+public:
+    /// @param root An analyzed tree, with its slots allocated.
+    /// @param frame_size The number of slots, (see frame_allocator).
+    batch(Node::node &root, std::size_t frame_size);
+    batch(const batch &) = delete;
+    batch(batch &&) = delete;
+    ~batch() = default;
+
+    batch& operator=(const batch &) = delete;
+    batch& operator=(batch &&) = delete;
+
+    /// Write these variables after each record.  By default, every
+    /// top-level variable which isn't set from a column is written, in the
+    /// order they were declared.
+    void results(std::vector<std::string> names)
+    {
+        result_names_ = std::move(names);
+    }
+
+    /// Compute an aggregate of a top-level variable over every record:
+    /// "count", "sum:x", "min:x", "max:x", or "histogram:x:low:high:n",
+    /// (the number of values in each of n equal ranges from low up to high,
+    /// and of those below and above).
+    /// Throws std::runtime_error if the aggregate is malformed.
+    void aggregate(std::string_view spec);
+
+    /// Write the results of each record?  (The aggregates are computed
+    /// either way.)
+    void rows(bool write)                   { rows_ = write; }
+
+    /// Write the aggregates as CSV, (a line for each, or each range of a
+    /// histogram, naming it, and its value).  A minimum or maximum of no
+    /// records is empty.
+    void write_aggregates(std::ostream &os) const;
+
+    /// Evaluate one record at a time, even if the script could be
+    /// vectorized, (to compare the two).
+    void scalar()                           { vector_ = false; }
+
+    /// Declare the values a column holds, "name:low:high", (inclusive).  A
+    /// record with any other is an error.
+    /// Throws std::runtime_error if the range is malformed.
+    void range(std::string_view spec);
+
+    /// Vectorize every operation in 32 bit lanes, even where narrower
+    /// lanes would do, (to compare the two).
+    void wide()                             { narrow_ = false; }
+
+    /// Evaluate chunks of records on these threads, (nullptr for none).
+    void pool(thread_pool *p)               { pool_ = p; }
+
+    /// The number of records in each chunk.
+    void chunk_size(std::size_t records)
+    {
+        chunk_size_ = records ? records : 1u;
+    }
+
+    /// Evaluate the script for each record.
+    /// @param source The name of the input, for error messages.
+    /// @return The number of records.
+    /// Throws std::runtime_error if the input is malformed.
+    std::size_t run(std::istream &in, const std::string &source,
+                    std::ostream &out);
+
+    /// Evaluate the script for each row of a column file, and write the
+    /// results as another, (see column_file.h).  The columns are bound as
+    /// those of a CSV file are.
+    /// @return The number of rows.
+    /// Throws std::runtime_error if either file is unusable.
+    std::size_t run(const column_reader &in, const std::string &output);
+
+    /// Evaluate rows [first, last) of a column file, and write their
+    /// results to a stream as a shard, (see shard.h), for a coordinator to
+    /// merge with those of the other rows.
+    /// @return The number of rows.
+    /// Throws std::runtime_error if the file is unusable, or the rows
+    /// aren't in it.
+    std::size_t run(const column_reader &in, std::size_t first,
+                    std::size_t last, std::ostream &out);
+
+    /// Print the number of records, and how fast they were evaluated.
+    void report(std::ostream &os) const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    /// An aggregate of a variable over every record, (see aggregate()).
+    struct aggregate_spec
+    {
+        enum class kind { count, sum, min, max, histogram };
+
+        std::string  spec_;
+        kind         kind_ = kind::count;
+        std::string  name_;                 ///< Of the variable.
+        Node::node   *var_ = nullptr;       ///< Once bound.
+        int          low_ = 0;
+        int          high_ = 0;
+        std::size_t  buckets_ = 0u;
+    };
+
+    /// The value of an aggregate over some of the records.
+    struct partial
+    {
+        std::uint64_t              count_{0u};
+        std::int64_t               sum_{0};
+        int                        min_{0};
+        int                        max_{0};
+        std::vector<std::uint64_t> buckets_;    ///< Below, each, above.
+
+        void add(const aggregate_spec &spec, int value);
+        void merge(const partial &other);
+    };
+
+    /// What a thread evaluates records with.  Only one chunk at a time
+    /// uses each, (see run).
+    struct worker
+    {
+        explicit worker(std::size_t frame_size) :
+            eval_(frame_size, discard_), vector_eval_(frame_size) { }
+
+        std::ostream                  discard_{nullptr};
+        evaluator                     eval_;
+        vector_evaluator              vector_eval_;
+        std::vector<std::string_view> fields_;
+        std::size_t                   pending_{0u};  ///< Records in the block.
+        std::vector<partial>          partials_;     ///< Of each aggregate.
+    };
+
+    /// Records read together, and what they wrote.
+    struct chunk
+    {
+        std::vector<std::string> lines_;
+        std::vector<std::size_t> numbers_;   ///< The line number of each.
+        std::string              output_;
+        std::size_t              records_{0u};  ///< Evaluated without error.
+        std::exception_ptr       error_;
+
+        /// Set, (last), by whoever evaluated it, and waited for by the
+        /// writer.
+        std::promise<void>       done_;
+        std::future<void>        finished_{done_.get_future()};
+    };
+
+    /// The top-level variable of this name, or nullptr.
+    Node::node* find(std::string_view name) const;
+
+    /// Bind the columns named by the header, and choose the results.
+    void bind(const std::vector<std::string_view> &names,
+              const std::string &source);
+
+    /// Bind the columns of a column file.
+    void bind(const column_reader &in);
+
+    /// The values the bound columns hold in rows [first, last) of a column
+    /// file, (or may hold, if there are none).
+    /// Throws std::runtime_error if one is outside its declared range.
+    std::vector<interval> observed(std::size_t first, std::size_t last) const;
+
+    /// Mark the operations which may be vectorized in narrower lanes,
+    /// given the values each column may hold, (see value_range).
+    void narrow(const std::vector<interval> &columns);
+
+    /// Evaluate the statements which don't depend on the columns bound, and
+    /// keep the values they leave as the start of every record.
+    void hoist();
+
+    /// Add a record's values to a worker's partial aggregates.
+    /// @param value Gives the value of a variable, (or nullptr).
+    template <typename Value>
+    void accumulate(worker &w, Value value);
+
+    /// Merge the workers' partial aggregates into the totals.
+    void merge();
+
+    /// Evaluate one record, (or add it to the block, if vectorized).
+    void record(worker &w, std::string_view line, const std::string &source,
+                std::size_t number, std::ostream &out);
+
+    /// Evaluate the records of the block, and write their results.
+    void flush(worker &w, std::ostream &out);
+
+    /// Evaluate the records of a chunk.
+    void evaluate(worker &w, chunk &c, const std::string &source);
+
+    /// Evaluate rows [first, last) of a column file.  The results are
+    /// written only if there is an output file.
+    void evaluate(worker &w, std::size_t first, std::size_t last);
+
+    /// Evaluate rows [first, last) of a column file in chunks, on the
+    /// threads of the pool, if any.
+    /// @return The first error, if any.
+    std::exception_ptr dispatch(std::size_t first, std::size_t last);
+
+    Node::node                &root_;
+    std::size_t               frame_size_;
+    bool                      vector_;
+    thread_pool               *pool_ = nullptr;
+    std::size_t               chunk_size_{4096u};
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::vector<Node::node *> inputs_;   ///< For each column, or nullptr.
+    std::vector<std::pair<std::string, interval>> declared_;
+    std::vector<interval>     limits_;   ///< Declared, for each column.
+    bool                      narrow_{true};
+    std::pair<std::size_t, std::size_t> narrowed_{0u, 0u};  ///< Of all.
+    std::vector<std::string>  result_names_;
+    std::vector<Node::node *> results_;
+    std::vector<Node::node *> statements_;   ///< Evaluated for each record.
+    std::size_t               hoisted_{0u};
+    std::vector<int>          initial_;      ///< The values of each slot.
+    bool                      rows_{true};
+    std::vector<aggregate_spec> aggregates_;
+    std::vector<partial>      totals_;       ///< Of each aggregate.
+    std::vector<const int *>  in_columns_;   ///< For each column, (see run).
+    std::vector<int *>        out_columns_;  ///< For each result.
+    std::size_t               out_first_{0u};  ///< The row they start at.
+    std::size_t               records_{0u};
+    clock::duration           elapsed_{};
+};
+
+} // namespace Calc
+
+#endif // BATCH_H_INCLUDED
@@ -0,0 +1,89 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "bounds_check.h"
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+bool
+bounds_check::in_bounds(const node &index, const node &array) const
+{
+    auto length = array.get_kind<variable>()->length_;
+    if (auto num = index.get_kind<number>(); num) {
+        return num->value_ >= 0 && num->value_ < length;
+    }
+    if (auto ref = index.get_kind<variable_ref>(); ref) {
+        if (auto found = ranges_.find(ref->symbol_); found != ranges_.end()) {
+            auto [first, last] = found->second;
+            // (A loop which never runs never uses its variable.)
+            return last < first || (first >= 0 && last < length);
+        }
+    }
+    return false;
+}
+
+void
+bounds_check::mark(node &n)
+{
+    ++visited_;
+    const node *var = nullptr;
+    if (n.get_kind<parallel_loop>() && n.children[1]->get_kind<number>() &&
+        n.children[2]->get_kind<number>()) {
+        // The variable may not be assigned in the body, (see
+        // check_parallel_loops).
+        var = n.children[0]->get_kind<variable_ref>()->symbol_;
+        ranges_[var] = {n.children[1]->get_kind<number>()->value_,
+                        n.children[2]->get_kind<number>()->value_};
+    }
+    for (auto &child : n.children) {
+        mark(*child);
+    }
+    if (var) {
+        ranges_.erase(var);
+    }
+
+    element_base *e = n.get_kind<element>();
+    if (!e) {
+        e = n.get_kind<element_assignment>();
+    }
+    if (e && e->checked_ &&
+        in_bounds(*n.children[1],
+                  *n.children[0]->get_kind<variable_ref>()->symbol_)) {
+        e->checked_ = false;
+        ++cleared_;
+    }
+}
+
+std::size_t
+bounds_check::run(node &root)
+{
+    auto cleared = cleared_;
+    mark(root);
+    return cleared_ - cleared;
+}
+
+} // namespace Calc
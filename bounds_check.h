@@ -0,0 +1,75 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef BOUNDS_CHECK_H_INCLUDED
+#define BOUNDS_CHECK_H_INCLUDED
+
+#include "node.h"
+
+#include <map>
+#include <utility>
+
+namespace Calc {
+
+/// Clear the checks of the array elements whose index is known to be in
+/// bounds: a constant, or the variable of an enclosing parallel loop whose
+/// constant bounds are, (as in "loop parallel for i := 0 to 999 ... a[i]"
+/// with "var a[1000];").
+class bounds_check
+{
+public:
+    bounds_check() = default;
+    bounds_check(const bounds_check &) = delete;
+    bounds_check(bounds_check &&) = default;
+    ~bounds_check() = default;
+
+    bounds_check& operator=(const bounds_check &) = delete;
+    bounds_check& operator=(bounds_check &&) = default;
+
+    /// Look at the elements of an analyzed tree.
+    /// @return The number of checks cleared.
+    std::size_t run(Node::node &root);
+
+    /// The number of nodes looked at so far.
+    std::size_t visited() const             { return visited_; }
+
+private:
+    void mark(Node::node &n);
+
+    /// Is the index, (a child of an element), known to be in bounds of
+    /// the array?
+    bool in_bounds(const Node::node &index, const Node::node &array) const;
+
+    /// The values taken by the variables of the enclosing parallel loops
+    /// with constant bounds.
+    std::map<const Node::node *, std::pair<int, int>> ranges_;
+
+    std::size_t visited_{0u};
+    std::size_t cleared_{0u};
+};
+
+} // namespace Calc
+
+#endif // BOUNDS_CHECK_H_INCLUDED
@@ -0,0 +1,191 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "chunked_parse.h"
+#include "grammar.h"
+#include "selector.h"
+#include "thread_pool.h"
+
+#include <tao/pegtl.hpp>
+#include <tao/pegtl/contrib/parse_tree.hpp>
+
+#include <cctype>
+#include <cstring>
+#include <future>
+
+namespace Calc {
+
+namespace {
+
+/// Scripts smaller than this are parsed in one go.
+constexpr std::size_t min_chunk = 1u << 20;
+
+bool
+identifier_char(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+/// Does the text at p start with the given keyword?
+bool
+at_keyword(const char *p, const char *end, const char *kw)
+{
+    auto len = std::strlen(kw);
+    return static_cast<std::size_t>(end - p) >= len &&
+           std::memcmp(p, kw, len) == 0 &&
+           (p + len == end || !identifier_char(p[len]));
+}
+
+/// Skip white space and comments.
+const char*
+skip_space(const char *p, const char *end)
+{
+    while (p < end) {
+        if (std::isspace(static_cast<unsigned char>(*p))) {
+            ++p;
+        } else if (*p == '/' && p + 1 < end && p[1] == '/') {
+            while (p < end && *p != '\n') {
+                ++p;
+            }
+        } else {
+            break;
+        }
+    }
+    return p;
+}
+
+Node::Ptr
+parse_piece(const char *begin, const char *end, const std::string &source,
+            const split_point &at)
+{
+    using namespace tao::pegtl;
+    memory_input in(begin, end, source, at.byte_, at.line_, at.column_);
+    return parse_tree::parse<grammar::grammar, Node::node,
+                             grammar::selector>(in);
+}
+
+} // namespace
+
+std::vector<split_point>
+find_split_points(const char *begin, const char *end, std::size_t target)
+{
+    std::vector<split_point> points;
+    int depth = 0;
+    std::size_t line = 1u;
+    auto line_start = begin;
+    auto next = begin + target;
+    for (auto p = begin; p < end; ++p) {
+        switch (*p) {
+        case '\n':
+            ++line;
+            line_start = p + 1;
+            continue;
+        case '/':
+            if (p + 1 < end && p[1] == '/') {
+                // Leave p on the end of the line, so it is counted.
+                while (p + 1 < end && p[1] != '\n') {
+                    ++p;
+                }
+            }
+            continue;
+        case '(':
+        case '{':
+            ++depth;
+            continue;
+        case ')':
+            --depth;
+            continue;
+        case '}':
+            --depth;
+            break;
+        case ';':
+            break;
+        default:
+            continue;
+        }
+        if (depth != 0 || p + 1 < next) {
+            continue;
+        }
+        auto q = skip_space(p + 1, end);
+        if (q == end) {
+            break;
+        }
+        if (at_keyword(q, end, "else") || at_keyword(q, end, "while") ||
+            at_keyword(q, end, "until")) {
+            continue;
+        }
+        auto start = p + 1;
+        points.push_back({static_cast<std::size_t>(start - begin), line,
+                          static_cast<std::size_t>(start - line_start) + 1u});
+        next = start + target;
+    }
+    return points;
+}
+
+Node::Ptr
+parse_chunked(const char *begin, const char *end, const std::string &source,
+              std::size_t threads)
+{
+    std::size_t size = end - begin;
+    if (threads < 2u || size < 2u * min_chunk) {
+        return parse_piece(begin, end, source, split_point{});
+    }
+
+    // A few pieces per thread, so they finish at about the same time.
+    auto target = std::max(min_chunk, size / (threads * 4u));
+    auto points = find_split_points(begin, end, target);
+    points.insert(points.begin(), split_point{});
+
+    thread_pool pool(threads);
+    std::vector<std::future<Node::Ptr>> pieces;
+    for (auto i = 0u; i < points.size(); ++i) {
+        auto piece_end = i + 1 < points.size() ? begin + points[i + 1].byte_
+                                               : end;
+        auto at = points[i];
+        pieces.push_back(pool.async([=, &source]
+            {
+                return parse_piece(begin + at.byte_, piece_end, source, at);
+            }));
+    }
+
+    // Wait for them all, in order, so the first error is the one reported.
+    Node::Ptr root;
+    for (auto &piece : pieces) {
+        auto tree = piece.get();
+        if (!tree) {
+            return nullptr;
+        }
+        if (!root) {
+            root = std::move(tree);
+            continue;
+        }
+        for (auto &child : tree->children) {
+            root->children.emplace_back(std::move(child));
+        }
+    }
+    return root;
+}
+
+} // namespace Calc
@@ -0,0 +1,64 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef CHUNKED_PARSE_H_INCLUDED
+#define CHUNKED_PARSE_H_INCLUDED
+
+#include "node.h"
+
+#include <string>
+#include <vector>
+
+namespace Calc {
+
+/// A place where a script may be split between top-level statements.
+struct split_point
+{
+    std::size_t byte_ = 0u;
+    std::size_t line_ = 1u;
+    std::size_t column_ = 1u;
+};
+
+/// Find places where a script may be split, so that each piece holds whole
+/// top-level statements.  A split may follow a ';' or '}' outside of any
+/// braces or parentheses, (and comments), unless the statement continues
+/// with "else", (an if-statement), or "while" or "until", (a bottom test
+/// loop).  Splits are at least target bytes apart.
+std::vector<split_point> find_split_points(const char *begin,
+                                           const char *end,
+                                           std::size_t target);
+
+/// Parse a script.  Large scripts are split into pieces, (see
+/// find_split_points()), which are parsed at the same time on the given
+/// number of threads, and the statements of each are then joined under a
+/// single root, in order.  Source positions are as if the script had been
+/// parsed in one go.  The nodes refer to the text, which must outlive them.
+/// @return The root of the parse tree, or nullptr if the parse fails.
+Node::Ptr parse_chunked(const char *begin, const char *end,
+                        const std::string &source, std::size_t threads);
+
+} // namespace Calc
+
+#endif // CHUNKED_PARSE_H_INCLUDED
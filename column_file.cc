@@ -0,0 +1,268 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "column_file.h"
+#include "csv.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Calc {
+
+static_assert(sizeof(int) == 4, "Columns hold 4 byte integers");
+
+namespace {
+
+[[noreturn]] void
+failed(const std::string &path, const std::string &what)
+{
+    throw std::runtime_error(path + ": " + what);
+}
+
+/// The offset of the first column, after the header and the names.
+std::size_t
+data_offset(const std::vector<std::string> &names)
+{
+    auto size = sizeof(column_header);
+    for (auto &name : names) {
+        size += sizeof(std::uint32_t) + name.size();
+    }
+    auto align = column_header::align;
+    return (size + align - 1u) / align * align;
+}
+
+/// Closes a file descriptor when done with it.
+struct descriptor
+{
+    explicit descriptor(int fd) : fd_(fd) { }
+    descriptor(const descriptor &) = delete;
+    descriptor(descriptor &&) = delete;
+    ~descriptor()                           { if (fd_ >= 0) ::close(fd_); }
+
+    descriptor& operator=(const descriptor &) = delete;
+    descriptor& operator=(descriptor &&) = delete;
+
+    int fd_;
+};
+
+} // namespace
+
+constexpr char column_header::magic[8];
+
+bool
+column_reader::detect(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(column_header::magic)];
+    return in.read(magic, sizeof(magic)) &&
+           std::memcmp(magic, column_header::magic, sizeof(magic)) == 0;
+}
+
+column_reader::column_reader(const std::string &path) :
+    path_(path)
+{
+    descriptor file(::open(path.c_str(), O_RDONLY));
+    if (file.fd_ < 0) {
+        failed(path, "Cannot open.");
+    }
+    struct stat st;
+    if (::fstat(file.fd_, &st) != 0) {
+        failed(path, "Cannot stat.");
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    if (size_ < sizeof(column_header)) {
+        failed(path, "Not a column file.");
+    }
+    map_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file.fd_, 0);
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        failed(path, "Cannot map.");
+    }
+
+    auto base = static_cast<const char *>(map_);
+    column_header h;
+    std::memcpy(&h, base, sizeof(h));
+    if (std::memcmp(h.magic_, column_header::magic, sizeof(h.magic_)) != 0) {
+        failed(path, "Not a column file.");
+    }
+    if (h.version_ != column_header::current) {
+        failed(path, "Unknown version, (or the other byte order).");
+    }
+    // Everything else is checked against these, so they come first.
+    if (h.data_ < sizeof(h) || h.data_ > size_ ||
+        h.data_ % column_header::align || h.rows_ > size_) {
+        failed(path, "Truncated.");
+    }
+    rows_ = h.rows_;
+
+    std::size_t at = sizeof(h);
+    for (auto i = 0u; i < h.columns_; ++i) {
+        std::uint32_t length;
+        if (at + sizeof(length) > h.data_) {
+            failed(path, "Malformed column names.");
+        }
+        std::memcpy(&length, base + at, sizeof(length));
+        at += sizeof(length);
+        if (at + length > h.data_) {
+            failed(path, "Malformed column names.");
+        }
+        names_.emplace_back(base + at, length);
+        at += length;
+    }
+    // (Divided, since the product of two large sizes may overflow.)
+    if (h.columns_ && h.stride() > (size_ - h.data_) / h.columns_) {
+        failed(path, "Truncated.");
+    }
+    for (auto i = 0u; i < h.columns_; ++i) {
+        columns_.push_back(reinterpret_cast<const int *>(
+            base + h.data_ + i * h.stride()));
+    }
+}
+
+column_reader::~column_reader()
+{
+    if (map_) {
+        ::munmap(map_, size_);
+    }
+}
+
+column_writer::column_writer(const std::string &path,
+                             const std::vector<std::string> &names,
+                             std::size_t rows)
+{
+    column_header h;
+    std::memcpy(h.magic_, column_header::magic, sizeof(h.magic_));
+    h.version_ = column_header::current;
+    h.columns_ = static_cast<std::uint32_t>(names.size());
+    h.rows_ = rows;
+    h.data_ = data_offset(names);
+    size_ = h.data_ + names.size() * h.stride();
+
+    descriptor file(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666));
+    if (file.fd_ < 0) {
+        failed(path, "Cannot create.");
+    }
+    if (::ftruncate(file.fd_, static_cast<off_t>(size_)) != 0) {
+        failed(path, "Cannot set the size.");
+    }
+    map_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  file.fd_, 0);
+    if (map_ == MAP_FAILED) {
+        map_ = nullptr;
+        failed(path, "Cannot map.");
+    }
+
+    auto base = static_cast<char *>(map_);
+    std::memcpy(base, &h, sizeof(h));
+    std::size_t at = sizeof(h);
+    for (auto &name : names) {
+        auto length = static_cast<std::uint32_t>(name.size());
+        std::memcpy(base + at, &length, sizeof(length));
+        at += sizeof(length);
+        std::memcpy(base + at, name.data(), name.size());
+        at += name.size();
+    }
+    for (auto i = 0u; i < names.size(); ++i) {
+        columns_.push_back(reinterpret_cast<int *>(
+            base + h.data_ + i * h.stride()));
+    }
+}
+
+column_writer::~column_writer()
+{
+    if (map_) {
+        ::munmap(map_, size_);
+    }
+}
+
+void
+csv_to_columns(std::istream &in, const std::string &source,
+               const std::string &path)
+{
+    std::string line;
+    if (!std::getline(in, line)) {
+        failed(source, "No header line.");
+    }
+    std::vector<std::string_view> fields;
+    csv::split(line, fields);
+    std::vector<std::string> names(fields.begin(), fields.end());
+    std::vector<std::vector<int>> values(names.size());
+
+    auto number = 1u;
+    while (std::getline(in, line)) {
+        ++number;
+        if (csv::trim(line).empty()) {
+            continue;
+        }
+        csv::split(line, fields);
+        if (fields.size() != names.size()) {
+            failed(source, std::to_string(number) + ": Expected " +
+                   std::to_string(names.size()) + " fields, found " +
+                   std::to_string(fields.size()) + ".");
+        }
+        for (auto i = 0u; i < fields.size(); ++i) {
+            int value = 0;
+            if (!csv::to_int(fields[i], value)) {
+                failed(source, std::to_string(number) + ": '" +
+                       std::string(fields[i]) + "' is not an integer.");
+            }
+            values[i].push_back(value);
+        }
+    }
+
+    auto rows = values.empty() ? 0u : values[0].size();
+    column_writer out(path, names, rows);
+    for (auto i = 0u; i < values.size(); ++i) {
+        std::memcpy(out.column(i), values[i].data(), rows * sizeof(int));
+    }
+}
+
+void
+columns_to_csv(const column_reader &in, std::ostream &out)
+{
+    auto &names = in.names();
+    auto separator = "";
+    for (auto &name : names) {
+        out << separator << name;
+        separator = ",";
+    }
+    out << '\n';
+    for (auto row = 0u; row < in.rows(); ++row) {
+        separator = "";
+        for (auto i = 0u; i < names.size(); ++i) {
+            out << separator << in.column(i)[row];
+            separator = ",";
+        }
+        out << '\n';
+    }
+}
+
+} // namespace Calc
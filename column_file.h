@@ -0,0 +1,136 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef COLUMN_FILE_H_INCLUDED
+#define COLUMN_FILE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Calc {
+
+/// The layout of a column file, (the binary alternative to CSV for batch
+/// input and output):
+///
+///     header          (below)
+///     names           for each column, its length, (4 bytes), and its
+///                     characters, (not terminated)
+///     padding         up to data_, (a multiple of 64)
+///     columns         for each column, rows_ 4 byte integers, padded to a
+///                     multiple of 64 bytes
+///
+/// Numbers are in the byte order of the machine which wrote the file,
+/// (version_ shows whether that is the reader's).
+struct column_header
+{
+    static constexpr char          magic[8] = {'c', 'a', 'l', 'c',
+                                               'c', 'o', 'l', 's'};
+    static constexpr std::uint32_t current = 1u;
+    static constexpr std::size_t   align = 64u;
+
+    char          magic_[8];
+    std::uint32_t version_;
+    std::uint32_t columns_;
+    std::uint64_t rows_;
+    std::uint64_t data_;    ///< The offset of the first column.
+
+    /// The bytes between the starts of two columns.
+    std::size_t stride() const
+    {
+        return (rows_ * sizeof(int) + align - 1u) / align * align;
+    }
+};
+
+/// A column file, mapped into memory for reading.
+/// Throws std::runtime_error if it can't be read, or is malformed.
+class column_reader
+{
+public:
+    explicit column_reader(const std::string &path);
+    column_reader(const column_reader &) = delete;
+    column_reader(column_reader &&) = delete;
+    ~column_reader();
+
+    column_reader& operator=(const column_reader &) = delete;
+    column_reader& operator=(column_reader &&) = delete;
+
+    /// Does the file start as a column file does?
+    static bool detect(const std::string &path);
+
+    const std::string& path() const                 { return path_; }
+    std::size_t rows() const                        { return rows_; }
+    const std::vector<std::string>& names() const   { return names_; }
+
+    /// The values of a column, (rows() of them).
+    const int* column(std::size_t index) const      { return columns_[index]; }
+
+private:
+    std::string              path_;
+    void                     *map_ = nullptr;
+    std::size_t              size_ = 0u;
+    std::size_t              rows_ = 0u;
+    std::vector<std::string> names_;
+    std::vector<const int *> columns_;
+};
+
+/// A column file, created at its full size and mapped into memory, so that
+/// the values can be written in place.
+/// Throws std::runtime_error if it can't be created.
+class column_writer
+{
+public:
+    column_writer(const std::string &path,
+                  const std::vector<std::string> &names, std::size_t rows);
+    column_writer(const column_writer &) = delete;
+    column_writer(column_writer &&) = delete;
+    ~column_writer();
+
+    column_writer& operator=(const column_writer &) = delete;
+    column_writer& operator=(column_writer &&) = delete;
+
+    /// Where the values of a column go.
+    int* column(std::size_t index)                  { return columns_[index]; }
+
+private:
+    void               *map_ = nullptr;
+    std::size_t        size_ = 0u;
+    std::vector<int *> columns_;
+};
+
+/// Convert CSV, (as read by batch), to a column file.
+/// @param source The name of the input, for error messages.
+void csv_to_columns(std::istream &in, const std::string &source,
+                    const std::string &path);
+
+/// Write a column file as CSV.
+void columns_to_csv(const column_reader &in, std::ostream &out);
+
+} // namespace Calc
+
+#endif // COLUMN_FILE_H_INCLUDED
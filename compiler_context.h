@@ -0,0 +1,83 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef COMPILER_CONTEXT_H_INCLUDED
+#define COMPILER_CONTEXT_H_INCLUDED
+
+#include <cstddef>
+#include <iostream>
+#include <limits>
+
+namespace Calc {
+class symbol_scope;
+
+/// The state of a single compilation.  Nothing about a compilation is
+/// global, so several files may be compiled at once, on different threads,
+/// each with a context of its own.
+class compiler_context
+{
+public:
+    /// @param diagnostics Where errors and warnings are written.
+    explicit compiler_context(std::ostream &diagnostics = std::cerr) :
+        diagnostics_(&diagnostics) { }
+
+    compiler_context(const compiler_context &) = delete;
+    compiler_context(compiler_context &&) = default;
+    ~compiler_context() = default;
+
+    compiler_context& operator=(const compiler_context &) = delete;
+    compiler_context& operator=(compiler_context &&) = default;
+
+    /// The innermost symbol scope, or nullptr outside of semantic analysis.
+    symbol_scope* current() const           { return current_; }
+    void current(symbol_scope *s)           { current_ = s; }
+
+    /// Where errors and warnings are written.
+    std::ostream& diagnostics() const       { return *diagnostics_; }
+    void diagnostics(std::ostream &os)      { diagnostics_ = &os; }
+
+    /// Number the next symbol added, (symbols are numbered in the order
+    /// they are added).
+    std::size_t next_sequence()             { return ++sequence_; }
+
+    /// The number of the last symbol added.
+    std::size_t sequence() const            { return sequence_; }
+
+    /// The last symbol in the scopes of another context which lookups may
+    /// find, (see semantic_analysis, which analyzes function bodies in
+    /// contexts of their own).
+    std::size_t visible() const             { return visible_; }
+    void visible(std::size_t v)             { visible_ = v; }
+
+private:
+    symbol_scope *current_ = nullptr;
+    std::ostream *diagnostics_;
+    std::size_t  sequence_ = 0u;
+    std::size_t  visible_ = std::numeric_limits<std::size_t>::max();
+};
+
+} // namespace Calc
+
+#endif // COMPILER_CONTEXT_H_INCLUDED
@@ -0,0 +1,237 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "constant_folder.h"
+
+#include <climits>
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+const number*
+constant(const Ptr &n)
+{
+    return n->get_kind<number>();
+}
+
+} // namespace
+
+void
+constant_folder::fold(node &n, long long value)
+{
+    if (value < INT_MIN || value > INT_MAX) {
+        return;
+    }
+    n.children.clear();
+    n.set_kind(number{static_cast<int>(value)});
+    n.set_type<number>();
+    ++folded_;
+}
+
+template <typename F>
+void
+constant_folder::fold_binary(node &n, F f)
+{
+    auto lhs = constant(n.children[0]);
+    auto rhs = constant(n.children[1]);
+    if (lhs && rhs) {
+        fold(n, f(static_cast<long long>(lhs->value_),
+                  static_cast<long long>(rhs->value_)));
+    }
+}
+
+void
+constant_folder::post_visit(node &n, unary_plus &)
+{
+    if (auto operand = constant(n.children[0]); operand) {
+        fold(n, operand->value_);
+    }
+}
+
+void
+constant_folder::post_visit(node &n, unary_minus &)
+{
+    if (auto operand = constant(n.children[0]); operand) {
+        fold(n, -static_cast<long long>(operand->value_));
+    }
+}
+
+void
+constant_folder::post_visit(node &n, logical_not &)
+{
+    if (auto operand = constant(n.children[0]); operand) {
+        fold(n, !operand->value_);
+    }
+}
+
+void
+constant_folder::post_visit(node &n, addition &)
+{
+    fold_binary(n, [](auto l, auto r) { return l + r; });
+}
+
+void
+constant_folder::post_visit(node &n, subtraction &)
+{
+    fold_binary(n, [](auto l, auto r) { return l - r; });
+}
+
+void
+constant_folder::post_visit(node &n, multiplication &)
+{
+    fold_binary(n, [](auto l, auto r) { return l * r; });
+}
+
+void
+constant_folder::post_visit(node &n, division &)
+{
+    // Division by zero must still fail at run time.
+    if (auto rhs = constant(n.children[1]); rhs && rhs->value_ != 0) {
+        fold_binary(n, [](auto l, auto r) { return l / r; });
+    }
+}
+
+void
+constant_folder::post_visit(node &n, modulus &)
+{
+    if (auto rhs = constant(n.children[1]); rhs && rhs->value_ != 0) {
+        fold_binary(n, [](auto l, auto r) { return l % r; });
+    }
+}
+
+void
+constant_folder::post_visit(node &n, equal_to &)
+{
+    fold_binary(n, [](auto l, auto r) { return l == r; });
+}
+
+void
+constant_folder::post_visit(node &n, not_equal &)
+{
+    fold_binary(n, [](auto l, auto r) { return l != r; });
+}
+
+void
+constant_folder::post_visit(node &n, less_than &)
+{
+    fold_binary(n, [](auto l, auto r) { return l < r; });
+}
+
+void
+constant_folder::post_visit(node &n, less_or_equal &)
+{
+    fold_binary(n, [](auto l, auto r) { return l <= r; });
+}
+
+void
+constant_folder::post_visit(node &n, greater_than &)
+{
+    fold_binary(n, [](auto l, auto r) { return l > r; });
+}
+
+void
+constant_folder::post_visit(node &n, greater_or_equal &)
+{
+    fold_binary(n, [](auto l, auto r) { return l >= r; });
+}
+
+void
+constant_folder::post_visit(node &n, logical_and &)
+{
+    fold_binary(n, [](auto l, auto r) { return l != 0 && r != 0; });
+}
+
+void
+constant_folder::post_visit(node &n, logical_or &)
+{
+    fold_binary(n, [](auto l, auto r) { return l != 0 || r != 0; });
+}
+
+void
+constant_folder::post_visit(node &n, logical_and_then &)
+{
+    // A false left side means the right side is never evaluated.
+    if (auto lhs = constant(n.children[0]); lhs && lhs->value_ == 0) {
+        fold(n, 0);
+        return;
+    }
+    fold_binary(n, [](auto l, auto r) { return l != 0 && r != 0; });
+}
+
+void
+constant_folder::post_visit(node &n, logical_or_else &)
+{
+    if (auto lhs = constant(n.children[0]); lhs && lhs->value_ != 0) {
+        fold(n, 1);
+        return;
+    }
+    fold_binary(n, [](auto l, auto r) { return l != 0 || r != 0; });
+}
+
+void
+constant_folder::post_visit(node &n, function_call &fc)
+{
+    if (!fc.symbol_ || n.children.size() != 1) {
+        return;
+    }
+    auto func = fc.symbol_->get_kind<function>();
+    if (!func) {
+        return;
+    }
+    auto operand = constant(n.children[0]);
+    if (auto intrinsic = func->get_intrinsic(); intrinsic && operand) {
+        fold(n, intrinsic(operand->value_));
+    }
+}
+
+void
+constant_folder::post_visit(node &n, if_statement &)
+{
+    auto cond = constant(n.children[0]);
+    if (!cond) {
+        return;
+    }
+    std::size_t chosen = cond->value_ != 0 ? 1 : 2;
+    if (chosen >= n.children.size()) {
+        // False, and no else clause, nothing left to do.
+        n.children.clear();
+        n.set_kind(compound_statement{});
+        n.set_type<compound_statement>();
+        ++folded_;
+        return;
+    }
+    if (n.children[chosen]->get_kind<function>()) {
+        // Function calls refer to the definition by address, leave it be.
+        return;
+    }
+    auto branch = std::move(n.children[chosen]);
+    n = std::move(*branch);
+    ++folded_;
+}
+
+} // namespace Calc
@@ -0,0 +1,88 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef CONSTANT_FOLDER_H_INCLUDED
+#define CONSTANT_FOLDER_H_INCLUDED
+
+#include "node.h"
+#include "visitor.h"
+
+namespace Calc {
+
+/// Fold operations whose operands are all constant into number nodes, and
+/// if-statements whose condition is constant into the chosen branch.
+/// Operations which would fail or overflow at run time are left alone so
+/// that evaluating the folded tree behaves exactly as the original.
+/// Use with a POST_VISIT traversal, so that operands are folded before
+/// the operations which use them.
+class constant_folder : public node_visitor
+{
+public:
+    constant_folder() = default;
+    constant_folder(const constant_folder &) = delete;
+    constant_folder(constant_folder &&) = default;
+    ~constant_folder() = default;
+
+    constant_folder& operator=(const constant_folder &) = delete;
+    constant_folder& operator=(constant_folder &&) = default;
+
+    void post_visit(Node::node &, Node::unary_plus &) override;
+    void post_visit(Node::node &, Node::unary_minus &) override;
+    void post_visit(Node::node &, Node::logical_not &) override;
+    void post_visit(Node::node &, Node::addition &) override;
+    void post_visit(Node::node &, Node::subtraction &) override;
+    void post_visit(Node::node &, Node::multiplication &) override;
+    void post_visit(Node::node &, Node::division &) override;
+    void post_visit(Node::node &, Node::modulus &) override;
+    void post_visit(Node::node &, Node::equal_to &) override;
+    void post_visit(Node::node &, Node::not_equal &) override;
+    void post_visit(Node::node &, Node::less_than &) override;
+    void post_visit(Node::node &, Node::less_or_equal &) override;
+    void post_visit(Node::node &, Node::greater_than &) override;
+    void post_visit(Node::node &, Node::greater_or_equal &) override;
+    void post_visit(Node::node &, Node::logical_and &) override;
+    void post_visit(Node::node &, Node::logical_or &) override;
+    void post_visit(Node::node &, Node::logical_and_then &) override;
+    void post_visit(Node::node &, Node::logical_or_else &) override;
+    void post_visit(Node::node &, Node::function_call &) override;
+    void post_visit(Node::node &, Node::if_statement &) override;
+
+    /// The number of nodes folded so far.
+    auto folded() const                     { return folded_; }
+
+private:
+    /// Replace n by a number node holding value, if it fits in an int.
+    void fold(Node::node &n, long long value);
+
+    /// Fold a binary operation whose operands are both constant.
+    template <typename F>
+    void fold_binary(Node::node &n, F f);
+
+    std::size_t folded_{0u};
+};
+
+} // namespace Calc
+
+#endif // CONSTANT_FOLDER_H_INCLUDED
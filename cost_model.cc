@@ -0,0 +1,521 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "cost_model.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace Calc {
+
+using namespace Node;
+
+namespace {
+
+using values = std::map<const node *, int>;
+
+constexpr auto max_cost = std::numeric_limits<std::uint64_t>::max();
+
+bool
+user_function(const node *n)
+{
+    auto func = n ? n->get_kind<function>() : nullptr;
+    return func && !func->is_intrinsic();
+}
+
+/// Collect the variables which evaluating n may write, including through
+/// the functions it calls.
+void
+collect_writes(const node &n, std::set<const node *> &writes,
+               std::set<const node *> &seen)
+{
+    if (n.get_kind<function>()) {
+        return;
+    }
+    if (n.get_kind<assignment_statement>() ||
+        n.get_kind<element_assignment>()) {
+        writes.insert(n.children[0]->get_kind<variable_ref>()->symbol_);
+    } else if (auto inc = n.get_kind<increment>(); inc) {
+        writes.insert(inc->symbol_);
+    } else if (auto b = n.get_kind<array_builtin>();
+               b && (b->op_ == array_op::fill ||
+                     b->op_ == array_op::prefix_sum)) {
+        writes.insert(n.children[0]->get_kind<variable_ref>()->symbol_);
+    } else if (auto fc = n.get_kind<function_call>();
+               fc && user_function(fc->symbol_) &&
+               seen.insert(fc->symbol_).second) {
+        collect_writes(*fc->symbol_->children[0], writes, seen);
+    }
+    for (auto &child : n.children) {
+        collect_writes(*child, writes, seen);
+    }
+}
+
+bool
+writes(const node &n, const node *var)
+{
+    std::set<const node *> written;
+    std::set<const node *> seen;
+    collect_writes(n, written, seen);
+    return written.count(var) != 0;
+}
+
+/// If n steps var by a constant, return the step.
+std::optional<int>
+step(const node &n, const node *var)
+{
+    if (auto inc = n.get_kind<increment>(); inc && inc->symbol_ == var) {
+        return inc->value_;
+    }
+    if (!n.get_kind<assignment_statement>() ||
+        n.children[0]->get_kind<variable_ref>()->symbol_ != var) {
+        return std::nullopt;
+    }
+    auto &rhs = *n.children[1];
+    bool add = rhs.get_kind<addition>() != nullptr;
+    if (!add && !rhs.get_kind<subtraction>()) {
+        return std::nullopt;
+    }
+    auto is_var = [var](const node &x)
+        {
+            auto ref = x.get_kind<variable_ref>();
+            return ref && ref->symbol_ == var;
+        };
+    auto &lhs_op = *rhs.children[0];
+    auto &rhs_op = *rhs.children[1];
+    if (is_var(lhs_op) && rhs_op.get_kind<number>()) {
+        auto c = rhs_op.get_kind<number>()->value_;
+        if (!add && c == std::numeric_limits<int>::min()) {
+            return std::nullopt;
+        }
+        return add ? c : -c;
+    }
+    if (add && is_var(rhs_op) && lhs_op.get_kind<number>()) {
+        return lhs_op.get_kind<number>()->value_;
+    }
+    return std::nullopt;
+}
+
+/// A loop condition of the form: var relation constant.
+struct condition
+{
+    const node *var_ = nullptr;
+    relation   op_ = relation::equal_to;
+    int        value_ = 0;
+};
+
+relation
+negate(relation op)
+{
+    switch (op) {
+    case relation::equal_to:         return relation::not_equal;
+    case relation::not_equal:        return relation::equal_to;
+    case relation::less_than:        return relation::greater_or_equal;
+    case relation::less_or_equal:    return relation::greater_than;
+    case relation::greater_than:     return relation::less_or_equal;
+    case relation::greater_or_equal: return relation::less_than;
+    }
+    return op;
+}
+
+std::optional<relation>
+relation_of(const node &n)
+{
+    if (n.get_kind<equal_to>())         return relation::equal_to;
+    if (n.get_kind<not_equal>())        return relation::not_equal;
+    if (n.get_kind<less_than>())        return relation::less_than;
+    if (n.get_kind<less_or_equal>())    return relation::less_or_equal;
+    if (n.get_kind<greater_than>())     return relation::greater_than;
+    if (n.get_kind<greater_or_equal>()) return relation::greater_or_equal;
+    return std::nullopt;
+}
+
+std::optional<condition>
+loop_condition(const node &n)
+{
+    if (n.get_kind<logical_not>()) {
+        // An "until" loop.
+        auto c = loop_condition(*n.children[0]);
+        if (c) {
+            c->op_ = negate(c->op_);
+        }
+        return c;
+    }
+    if (auto cmp = n.get_kind<compare>(); cmp) {
+        if (cmp->rhs_) {
+            return std::nullopt;
+        }
+        return condition{cmp->lhs_, cmp->op_, cmp->value_};
+    }
+    auto op = relation_of(n);
+    if (!op) {
+        return std::nullopt;
+    }
+    auto &lhs = *n.children[0];
+    auto &rhs = *n.children[1];
+    if (lhs.get_kind<variable_ref>() && rhs.get_kind<number>()) {
+        return condition{lhs.get_kind<variable_ref>()->symbol_, *op,
+                         rhs.get_kind<number>()->value_};
+    }
+    if (rhs.get_kind<variable_ref>() && lhs.get_kind<number>()) {
+        return condition{rhs.get_kind<variable_ref>()->symbol_,
+                         compare_base::mirror(*op),
+                         lhs.get_kind<number>()->value_};
+    }
+    return std::nullopt;
+}
+
+/// The number of consecutive values, start, start + s, ..., for which the
+/// condition holds.
+std::optional<std::uint64_t>
+count(long long start, long long s, relation op, long long limit)
+{
+    auto up = [](long long distance, long long by) -> std::uint64_t
+        {
+            return distance <= 0 ? 0u : (distance + by - 1) / by;
+        };
+    switch (op) {
+    case relation::less_or_equal:
+        return count(start, s, relation::less_than, limit + 1);
+    case relation::greater_or_equal:
+        return count(start, s, relation::greater_than, limit - 1);
+    case relation::less_than:
+        if (start >= limit) {
+            return 0u;
+        }
+        if (s <= 0) {
+            return std::nullopt;
+        }
+        return up(limit - start, s);
+    case relation::greater_than:
+        if (start <= limit) {
+            return 0u;
+        }
+        if (s >= 0) {
+            return std::nullopt;
+        }
+        return up(start - limit, -s);
+    case relation::equal_to:
+        if (start != limit) {
+            return 0u;
+        }
+        return s == 0 ? std::nullopt : std::optional<std::uint64_t>(1u);
+    case relation::not_equal: {
+        auto distance = limit - start;
+        if (distance == 0) {
+            return 0u;
+        }
+        if (s == 0 || distance % s != 0 || distance / s < 0) {
+            return std::nullopt;
+        }
+        return distance / s;
+    }
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+cost_model::estimate&
+cost_model::estimate::operator+=(const estimate &rhs)
+{
+    cost_ = cost_ > max_cost - rhs.cost_ ? max_cost : cost_ + rhs.cost_;
+    unbounded_ |= rhs.unbounded_;
+    recursive_ |= rhs.recursive_;
+    return *this;
+}
+
+cost_model::estimate&
+cost_model::estimate::operator*=(std::uint64_t times)
+{
+    if (times != 0u && cost_ > max_cost / times) {
+        cost_ = max_cost;
+    } else {
+        cost_ *= times;
+    }
+    return *this;
+}
+
+std::optional<std::uint64_t>
+cost_model::trip_count(const node &loop, const values &init)
+{
+    bool bottom = loop.get_kind<loop_bottom_test_statement>() != nullptr;
+    auto &body = *loop.children[bottom ? 0 : 1];
+    auto &cond = *loop.children[bottom ? 1 : 0];
+
+    auto c = loop_condition(cond);
+    if (!c) {
+        return std::nullopt;
+    }
+    auto found = init.find(c->var_);
+    if (found == init.end()) {
+        return std::nullopt;
+    }
+
+    // The body must step the variable exactly once, unconditionally.
+    std::optional<int> s;
+    for (auto &stmt : body.children) {
+        if (!writes(*stmt, c->var_)) {
+            continue;
+        }
+        if (s) {
+            return std::nullopt;
+        }
+        s = step(*stmt, c->var_);
+        if (!s) {
+            return std::nullopt;
+        }
+    }
+    if (!s) {
+        s = 0;
+    }
+
+    long long start = found->second;
+    if (bottom) {
+        // The body runs once before the condition is tested.
+        auto rest = count(start + *s, *s, c->op_, c->value_);
+        if (!rest) {
+            return std::nullopt;
+        }
+        return *rest + 1u;
+    }
+    return count(start, *s, c->op_, c->value_);
+}
+
+cost_model::estimate
+cost_model::loop_cost(const node &loop, const values &init)
+{
+    bool bottom = loop.get_kind<loop_bottom_test_statement>() != nullptr;
+    auto body = cost(*loop.children[bottom ? 0 : 1]);
+    auto cond = cost(*loop.children[bottom ? 1 : 0]);
+
+    estimate result{1u};
+    auto trips = trip_count(loop, init);
+    if (!trips) {
+        // Count one iteration, and say so.
+        result.unbounded_ = true;
+        trips = 1u;
+    }
+    body *= *trips;
+    result += body;
+    cond *= bottom ? *trips : *trips + 1u;
+    result += cond;
+    return result;
+}
+
+cost_model::estimate
+cost_model::parallel_cost(const node &loop, const values &init)
+{
+    auto bound = [&init](const node &n) -> std::optional<long long>
+        {
+            if (auto num = n.get_kind<number>(); num) {
+                return num->value_;
+            }
+            if (auto ref = n.get_kind<variable_ref>(); ref) {
+                if (auto found = init.find(ref->symbol_); found != init.end()) {
+                    return found->second;
+                }
+            }
+            return std::nullopt;
+        };
+
+    // Only the bounds and the body are evaluated.
+    estimate result{1u};
+    auto &first = *loop.children[1];
+    auto &last = *loop.children[2];
+    result += cost(first);
+    result += cost(last);
+    auto body = cost(*loop.children.back());
+    auto from = bound(first);
+    auto to = bound(last);
+    if (from && to) {
+        body *= *to < *from ? 0u : *to - *from + 1;
+    } else {
+        body.unbounded_ = true;
+    }
+    result += body;
+    return result;
+}
+
+cost_model::estimate
+cost_model::block_cost(const node &n, std::vector<estimate> *each)
+{
+    // Track variables holding constants from one statement to the next,
+    // so loops can find their starting values.
+    values known;
+    estimate result{1u};
+    for (auto &child : n.children) {
+        auto &stmt = *child;
+        auto e = stmt.get_kind<loop_top_test_statement>() ||
+                 stmt.get_kind<loop_bottom_test_statement>()
+                     ? loop_cost(stmt, known)
+                     : stmt.get_kind<parallel_loop>()
+                         ? parallel_cost(stmt, known) : cost(stmt);
+        result += e;
+        if (each) {
+            each->push_back(e);
+        }
+
+        const node *target = nullptr;
+        if (stmt.get_kind<assignment_statement>()) {
+            target = stmt.children[0]->get_kind<variable_ref>()->symbol_;
+            if (auto num = stmt.children[1]->get_kind<number>(); num) {
+                known[target] = num->value_;
+                continue;
+            }
+        }
+        std::set<const node *> written;
+        std::set<const node *> seen;
+        collect_writes(stmt, written, seen);
+        for (auto var : written) {
+            known.erase(var);
+        }
+    }
+    return result;
+}
+
+std::vector<cost_model::estimate>
+cost_model::statements(const node &block)
+{
+    std::vector<estimate> each;
+    block_cost(block, &each);
+    return each;
+}
+
+cost_model::estimate
+cost_model::function_cost(const node &func)
+{
+    if (auto found = functions_.find(&func); found != functions_.end()) {
+        return found->second;
+    }
+    if (!active_.insert(&func).second) {
+        estimate e;
+        e.recursive_ = true;
+        return e;
+    }
+    auto e = cost(*func.children[0]);
+    active_.erase(&func);
+    functions_[&func] = e;
+    return e;
+}
+
+cost_model::estimate
+cost_model::cost(const node &n)
+{
+    if (n.get_kind<function>() || n.get_kind<declaration>()) {
+        return estimate{1u};
+    }
+    if (n.get_kind<root>() || n.get_kind<compound_statement>()) {
+        return block_cost(n);
+    }
+    if (n.get_kind<loop_top_test_statement>() ||
+        n.get_kind<loop_bottom_test_statement>()) {
+        return loop_cost(n, values{});
+    }
+    if (n.get_kind<parallel_loop>()) {
+        return parallel_cost(n, values{});
+    }
+    if (n.get_kind<if_statement>()) {
+        estimate result{1u};
+        result += cost(*n.children[0]);
+        auto then_part = cost(*n.children[1]);
+        auto else_part = n.children.size() > 2 ? cost(*n.children[2])
+                                               : estimate{};
+        auto &larger = then_part.cost_ < else_part.cost_ ? else_part
+                                                         : then_part;
+        larger.unbounded_ |= then_part.unbounded_ || else_part.unbounded_;
+        larger.recursive_ |= then_part.recursive_ || else_part.recursive_;
+        result += larger;
+        return result;
+    }
+    if (n.get_kind<assignment_statement>()) {
+        estimate result{1u};
+        result += cost(*n.children[1]);
+        return result;
+    }
+
+    estimate result{1u};
+    for (auto &child : n.children) {
+        result += cost(*child);
+    }
+    if (auto fc = n.get_kind<function_call>();
+        fc && user_function(fc->symbol_)) {
+        result += function_cost(*fc->symbol_);
+    }
+    return result;
+}
+
+namespace {
+
+void
+collect_functions(const node &n, std::vector<const node *> &funcs)
+{
+    if (user_function(&n)) {
+        funcs.push_back(&n);
+    }
+    for (auto &child : n.children) {
+        collect_functions(*child, funcs);
+    }
+}
+
+} // namespace
+
+void
+cost_model::report(std::ostream &os, const node &root)
+{
+    std::vector<const node *> funcs;
+    collect_functions(root, funcs);
+    for (auto func : funcs) {
+        os << "Cost of function " << func->get_kind<function>()->name_
+           << ": " << function_cost(*func) << '\n';
+    }
+    std::vector<estimate> each;
+    auto total = block_cost(root, &each);
+    for (auto i = 0u; i < each.size(); ++i) {
+        os << "Cost of statement " << i + 1 << ", line "
+           << root.children[i]->begin().line << ": " << each[i] << '\n';
+    }
+    os << "Total cost: " << total << '\n';
+}
+
+std::ostream&
+operator<<(std::ostream &os, const cost_model::estimate &e)
+{
+    os << e.cost_;
+    if (e.bounded()) {
+        return os;
+    }
+    os << " or more, (";
+    if (e.unbounded_) {
+        os << "unbounded loop";
+    }
+    if (e.recursive_) {
+        os << (e.unbounded_ ? ", " : "") << "recursion";
+    }
+    return os << ')';
+}
+
+} // namespace Calc
@@ -0,0 +1,118 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef COST_MODEL_H_INCLUDED
+#define COST_MODEL_H_INCLUDED
+
+#include "node.h"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <set>
+#include <vector>
+
+namespace Calc {
+
+/// Estimate, without running it, how much work evaluating a tree will be.
+/// The unit is one node dispatched by the evaluator, (see
+/// node_visitor::dispatches()), so estimates can be checked against a run.
+/// Loops are multiplied by their trip count where it can be derived: the
+/// condition compares a variable with a constant, the variable is set to a
+/// constant just before the loop, and the body steps it by a constant
+/// exactly once.  Otherwise the loop is flagged as unbounded and counted
+/// once.  A parallel loop is multiplied by its trip count if its bounds are
+/// constants.  Recursive calls are flagged, and counted once.  Since exit and
+/// return statements aren't taken into account, bounded estimates are an
+/// upper limit.
+class cost_model
+{
+public:
+    /// The estimated cost of evaluating something.
+    struct estimate
+    {
+        std::uint64_t cost_ = 0u;
+        bool          unbounded_ = false;   ///< Has a loop with no bound.
+        bool          recursive_ = false;   ///< May recurse.
+
+        /// Is cost_ an upper limit, (rather than a lower one)?
+        bool bounded() const                { return !unbounded_ && !recursive_; }
+
+        estimate& operator+=(const estimate &rhs);
+        estimate& operator*=(std::uint64_t times);
+    };
+
+    cost_model() = default;
+    cost_model(const cost_model &) = delete;
+    cost_model(cost_model &&) = default;
+    ~cost_model() = default;
+
+    cost_model& operator=(const cost_model &) = delete;
+    cost_model& operator=(cost_model &&) = default;
+
+    /// Estimate the cost of evaluating n.
+    estimate cost(const Node::node &n);
+
+    /// Estimate the cost of a call to a user defined function, (not
+    /// including the arguments).
+    estimate function_cost(const Node::node &func);
+
+    /// The number of times a loop will iterate, if it can be derived.
+    /// @param init The value of the loop variable on entry, if known.
+    std::optional<std::uint64_t> trip_count(const Node::node &loop,
+        const std::map<const Node::node *, int> &init);
+
+    /// Estimate the cost of each statement in a block, (or the root).
+    std::vector<estimate> statements(const Node::node &block);
+
+    /// Print the estimate for each function, and each top-level statement.
+    void report(std::ostream &os, const Node::node &root);
+
+private:
+    /// The cost of a compound statement, (or the root), whose loops may
+    /// use the constants assigned by earlier statements.
+    /// @param each If not null, filled in with the cost of each statement.
+    estimate block_cost(const Node::node &n,
+                        std::vector<estimate> *each = nullptr);
+
+    /// The cost of a loop, given the known variable values on entry.
+    estimate loop_cost(const Node::node &loop,
+                       const std::map<const Node::node *, int> &init);
+
+    /// The cost of a parallel loop, (all of its iterations, whatever
+    /// threads they run on), given the known variable values on entry.
+    estimate parallel_cost(const Node::node &loop,
+                           const std::map<const Node::node *, int> &init);
+
+    std::map<const Node::node *, estimate> functions_;
+    std::set<const Node::node *>           active_;
+};
+
+std::ostream& operator<<(std::ostream &os, const cost_model::estimate &e);
+
+} // namespace Calc
+
+#endif // COST_MODEL_H_INCLUDED
@@ -0,0 +1,47 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef CSV_H_INCLUDED
+#define CSV_H_INCLUDED
+
+#include <string_view>
+#include <vector>
+
+namespace Calc::csv {
+
+/// Remove the blanks around a field, (and the '\r' of a CRLF line).
+std::string_view trim(std::string_view s);
+
+/// Split a line of CSV into its fields, (quoting isn't supported, since
+/// the fields are names and integers).
+void split(std::string_view line, std::vector<std::string_view> &fields);
+
+/// Convert a field to an integer, (with an optional sign).
+/// @return false if it isn't one.
+bool to_int(std::string_view field, int &value);
+
+} // namespace Calc::csv
+
+#endif // CSV_H_INCLUDED
@@ -0,0 +1,782 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "dataflow.h"
+#include "cost_model.h"
+#include "evaluator.h"
+#include "error.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <utility>
+
+#include <CompuBrite/CheckPoint.h>
+
+namespace Calc {
+namespace cbi = CompuBrite;
+
+using namespace Calc::Node;
+
+namespace {
+
+const node*
+user_callee(const node &n)
+{
+    auto fc = n.get_kind<function_call>();
+    if (!fc || !fc->symbol_) {
+        return nullptr;
+    }
+    auto func = fc->symbol_->get_kind<function>();
+    if (!func || func->is_intrinsic() || fc->symbol_->children.size() != 1 ||
+        !func->scope_) {
+        return nullptr;
+    }
+    return fc->symbol_;
+}
+
+/// Does n change some of the elements of its first child, (an array)?
+bool
+writes_array(const node &n)
+{
+    if (n.get_kind<element_assignment>()) {
+        return true;
+    }
+    auto b = n.get_kind<array_builtin>();
+    return b && (b->op_ == array_op::fill || b->op_ == array_op::prefix_sum);
+}
+
+std::vector<std::size_t>
+slots(const var_set &vars)
+{
+    std::vector<std::size_t> result;
+    for (auto var : vars) {
+        auto v = var->get_kind<variable>();
+        for (auto i = 0; v && v->slot_ >= 0 && i < std::max(1, v->length_);
+             ++i) {
+            result.push_back(v->slot_ + i);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+/// May evaluating n run a parallel loop, (in n, or in a function it calls)?
+bool
+runs_parallel_loop(const node &n, std::set<const node *> &seen)
+{
+    if (n.get_kind<parallel_loop>()) {
+        return true;
+    }
+    if (auto callee = user_callee(n); callee && seen.insert(callee).second &&
+        runs_parallel_loop(*callee, seen)) {
+        return true;
+    }
+    for (auto &child : n.children) {
+        if (runs_parallel_loop(*child, seen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+void
+access_analysis::expression(const node &n, const var_set &written,
+                            var_set &exposed)
+{
+    auto read = [&](const node *var)
+        {
+            if (written.find(var) == written.end()) {
+                exposed.insert(var);
+            }
+        };
+    if (auto ref = n.get_kind<variable_ref>(); ref) {
+        read(ref->symbol_);
+        return;
+    }
+    if (auto inc = n.get_kind<increment>(); inc) {
+        read(inc->symbol_);
+        return;
+    }
+    if (auto cmp = n.get_compare(); cmp) {
+        read(cmp->lhs_);
+        if (cmp->rhs_) {
+            read(cmp->rhs_);
+        }
+        return;
+    }
+    if (n.get_kind<function>() || n.get_kind<declaration>()) {
+        return;
+    }
+    for (auto &child : n.children) {
+        expression(*child, written, exposed);
+    }
+    if (auto callee = user_callee(n); callee) {
+        for (auto var : function_reads(*callee)) {
+            read(var);
+        }
+    }
+}
+
+void
+access_analysis::walk(const node &n, var_set &written, var_set &exposed)
+{
+    if (n.get_kind<compound_statement>()) {
+        for (auto &child : n.children) {
+            walk(*child, written, exposed);
+        }
+        return;
+    }
+    if (n.get_kind<assignment_statement>()) {
+        expression(*n.children[1], written, exposed);
+        written.insert(n.children[0]->get_kind<variable_ref>()->symbol_);
+        return;
+    }
+    if (auto inc = n.get_kind<increment>(); inc) {
+        expression(n, written, exposed);
+        written.insert(inc->symbol_);
+        return;
+    }
+    if (n.get_kind<if_statement>()) {
+        expression(*n.children[0], written, exposed);
+        auto then_written = written;
+        walk(*n.children[1], then_written, exposed);
+        if (n.children.size() == 3) {
+            auto else_written = written;
+            walk(*n.children[2], else_written, exposed);
+            var_set both;
+            std::set_intersection(then_written.begin(), then_written.end(),
+                                  else_written.begin(), else_written.end(),
+                                  std::inserter(both, both.begin()));
+            written = std::move(both);
+        }
+        return;
+    }
+    if (n.get_kind<loop_top_test_statement>()) {
+        expression(*n.children[0], written, exposed);
+        auto body_written = written;
+        walk(*n.children[1], body_written, exposed);
+        return;
+    }
+    if (n.get_kind<loop_bottom_test_statement>()) {
+        auto body_written = written;
+        walk(*n.children[0], body_written, exposed);
+        expression(*n.children[1], body_written, exposed);
+        return;
+    }
+    if (auto loop = n.get_kind<parallel_loop>(); loop) {
+        // The bounds, then the reductions, which combine with the values
+        // on entry.
+        auto last = 3 + loop->reductions_.size();
+        for (auto i = 1u; i < last; ++i) {
+            expression(*n.children[i], written, exposed);
+        }
+        auto body_written = written;
+        body_written.insert(n.children[0]->get_kind<variable_ref>()->symbol_);
+        walk(*n.children.back(), body_written, exposed);
+        for (auto i = 3u; i < last; ++i) {
+            written.insert(n.children[i]->get_kind<variable_ref>()->symbol_);
+        }
+        return;
+    }
+    expression(n, written, exposed);
+}
+
+var_set
+access_analysis::function_reads(const node &func)
+{
+    if (auto found = functions_.find(&func); found != functions_.end()) {
+        return found->second;
+    }
+    for (auto &param : func.get_kind<function>()->scope_->children) {
+        parameters_.insert(param.get());
+    }
+    if (!active_.insert(&func).second) {
+        // A recursive call: anything the function reads may come from an
+        // earlier call.
+        var_set reads;
+        collect_reads(*func.children[0], reads);
+        return reads;
+    }
+    var_set written, exposed;
+    walk(*func.children[0], written, exposed);
+    active_.erase(&func);
+    return functions_[&func] = exposed;
+}
+
+void
+access_analysis::collect_writes(const node &n, var_set &writes,
+                                var_set &funcs)
+{
+    if (n.get_kind<function>()) {
+        return;
+    }
+    if (n.get_kind<assignment_statement>() || n.get_kind<parallel_loop>()) {
+        // (The variable of a parallel loop is assigned by the loop.)
+        writes.insert(n.children[0]->get_kind<variable_ref>()->symbol_);
+    } else if (auto inc = n.get_kind<increment>(); inc) {
+        writes.insert(inc->symbol_);
+    } else if (writes_array(n)) {
+        writes.insert(n.children[0]->get_kind<variable_ref>()->symbol_);
+    } else if (auto callee = user_callee(n);
+               callee && funcs.insert(callee).second) {
+        collect_writes(*callee->children[0], writes, funcs);
+    }
+    for (auto &child : n.children) {
+        collect_writes(*child, writes, funcs);
+    }
+}
+
+var_set
+access_analysis::exposed(const node &n, var_set written)
+{
+    var_set result;
+    walk(n, written, result);
+    // Every parameter read is of a call in progress.
+    for (auto param : parameters_) {
+        result.erase(param);
+    }
+    return result;
+}
+
+var_set
+access_analysis::writes(const node &n)
+{
+    var_set result, funcs;
+    collect_writes(n, result, funcs);
+    return result;
+}
+
+void
+statement_graph::run(const node &root)
+{
+    statements_.clear();
+    access_analysis access;
+    auto count = root.children.size();
+    std::vector<std::vector<std::size_t>> exposed(count), written(count);
+    std::vector<bool> shared, shares(count);
+    for (auto i = 0u; i < count; ++i) {
+        exposed[i] = slots(access.exposed(*root.children[i]));
+        auto writes = access.writes(*root.children[i]);
+        shares[i] = std::any_of(writes.begin(), writes.end(),
+            [](const node *var)
+            {
+                auto v = var->get_kind<variable>();
+                return v && v->cell_;
+            });
+        written[i] = slots(writes);
+        for (auto s : exposed[i]) {
+            if (s >= shared.size()) {
+                shared.resize(s + 1);
+            }
+            shared[s] = true;
+        }
+    }
+
+    constexpr auto none = std::numeric_limits<std::size_t>::max();
+    std::vector<std::size_t> last_writer(shared.size(), none);
+    std::vector<std::vector<std::size_t>> readers(shared.size());
+    statements_.resize(count);
+    for (auto i = 0u; i < count; ++i) {
+        auto &stmt = statements_[i];
+        stmt.shares_ = shares[i];
+        std::vector<std::size_t> preds;
+        stmt.reads_ = std::move(exposed[i]);
+        for (auto s : stmt.reads_) {
+            if (last_writer[s] != none) {
+                preds.push_back(last_writer[s]);
+            }
+            readers[s].push_back(i);
+        }
+        for (auto s : written[i]) {
+            if (s >= shared.size() || !shared[s]) {
+                continue;
+            }
+            stmt.writes_.push_back(s);
+            if (last_writer[s] != none) {
+                preds.push_back(last_writer[s]);
+            }
+            for (auto r : readers[s]) {
+                if (r != i) {
+                    preds.push_back(r);
+                }
+            }
+            readers[s].clear();
+            last_writer[s] = i;
+        }
+        std::sort(preds.begin(), preds.end());
+        preds.erase(std::unique(preds.begin(), preds.end()), preds.end());
+        for (auto p : preds) {
+            statements_[p].successors_.push_back(i);
+        }
+        stmt.predecessors_ = preds.size();
+    }
+}
+
+std::size_t
+statement_graph::depth() const
+{
+    // Every dependence is on an earlier statement.
+    std::vector<std::size_t> chain(statements_.size(), 1u);
+    std::size_t longest = 0u;
+    for (auto i = 0u; i < statements_.size(); ++i) {
+        for (auto s : statements_[i].successors_) {
+            chain[s] = std::max(chain[s], chain[i] + 1);
+        }
+        longest = std::max(longest, chain[i]);
+    }
+    return longest;
+}
+
+void
+statement_graph::report(std::ostream &os) const
+{
+    std::size_t edges = 0u;
+    for (auto &stmt : statements_) {
+        edges += stmt.successors_.size();
+    }
+    os << "Statements: " << statements_.size() << ", dependences: " << edges
+       << ", longest chain: " << depth() << std::endl;
+}
+
+void
+parallel_evaluator::run(node &root)
+{
+    // Below this many dispatches, starting the threads costs more than it
+    // saves.
+    constexpr std::uint64_t grain = 1u << 16;
+
+    cbi::CheckPoint cp("parallel");
+    graph_.run(root);
+    auto &stmts = graph_.statements();
+    auto count = stmts.size();
+    auto pool = eval_.pool();
+    if (!pool || pool->size() < 2u || count < 2u || graph_.depth() == count) {
+        eval_.accept(root);
+        return;
+    }
+    cost_model model;
+    cost_model::estimate total;
+    for (auto &e : model.statements(root)) {
+        total += e;
+    }
+    if (total.bounded() && total.cost_ < grain) {
+        cp.print(CBI_HERE, "Too small to run in parallel: ", total);
+        eval_.accept(root);
+        return;
+    }
+
+    // Some statements are evaluated here, in turn, once every statement
+    // before them is done:
+    // - A parallel loop waits for its chunks, which would tie up a worker,
+    //   (or every worker, and wait forever).
+    // - An assignment to a shared variable is seen by other scripts, so it
+    //   mustn't be made if a statement before it fails, (as it wouldn't be
+    //   in order).
+    struct task
+    {
+        std::atomic<std::size_t> waiting{0u};
+        std::ostringstream       out;
+        std::promise<void>       done;
+        bool                     here = false;
+        std::promise<void>       ready;
+    };
+    std::vector<task> tasks(count);
+    std::vector<std::future<void>> done;
+    std::vector<std::future<void>> ready;
+    for (auto i = 0u; i < count; ++i) {
+        tasks[i].waiting = stmts[i].predecessors_;
+        std::set<const node *> seen;
+        tasks[i].here = stmts[i].shares_ ||
+                        runs_parallel_loop(*root.children[i], seen);
+        done.push_back(tasks[i].done.get_future());
+        ready.push_back(tasks[i].ready.get_future());
+    }
+
+    // The evaluators not in use by a worker.
+    std::mutex idle_mutex;
+    std::vector<std::unique_ptr<evaluator>> idle;
+    std::atomic<std::size_t> dispatches{0u};
+    auto evaluate = [&](std::size_t i)
+        {
+            std::unique_ptr<evaluator> eval;
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                if (!idle.empty()) {
+                    eval = std::move(idle.back());
+                    idle.pop_back();
+                }
+            }
+            if (!eval) {
+                eval = std::make_unique<evaluator>(eval_.frame_size());
+                eval->pool(pool);
+                eval->fork_limit(eval_.fork_limit());
+            }
+            auto &stmt = stmts[i];
+            for (auto s : stmt.reads_) {
+                eval->slot(s) = eval_.slot(s);
+            }
+            // A write may not happen, so the old value must be there to be
+            // given back.
+            for (auto s : stmt.writes_) {
+                eval->slot(s) = eval_.slot(s);
+            }
+            eval->output(tasks[i].out);
+            auto before = eval->dispatches();
+            try {
+                eval->accept(*root.children[i]);
+            } catch (...) {
+                dispatches += eval->dispatches() - before;
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                idle.emplace_back(std::move(eval));
+                throw;
+            }
+            for (auto s : stmt.writes_) {
+                eval_.slot(s) = eval->slot(s);
+            }
+            dispatches += eval->dispatches() - before;
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            idle.emplace_back(std::move(eval));
+        };
+
+    // Statements after one which fails are not run, as the main evaluator
+    // wouldn't reach them.
+    std::atomic<std::size_t> failed{count};
+    std::mutex finished_mutex;
+    std::condition_variable all_finished;
+    std::size_t finished = 0u;
+
+    std::function<void(std::size_t)> start;
+    auto run_task = [&](std::size_t i)
+        {
+            try {
+                if (i < failed) {
+                    evaluate(i);
+                }
+                tasks[i].done.set_value();
+            } catch (...) {
+                auto first = failed.load();
+                while (i < first && !failed.compare_exchange_weak(first, i)) {
+                }
+                tasks[i].done.set_exception(std::current_exception());
+            }
+            for (auto s : stmts[i].successors_) {
+                if (--tasks[s].waiting == 0u) {
+                    start(s);
+                }
+            }
+            std::lock_guard<std::mutex> lock(finished_mutex);
+            if (++finished == count) {
+                all_finished.notify_all();
+            }
+        };
+    start = [&](std::size_t i)
+        {
+            if (tasks[i].here) {
+                tasks[i].ready.set_value();
+            } else {
+                pool->submit([&run_task, i] { run_task(i); });
+            }
+        };
+    for (auto i = 0u; i < count; ++i) {
+        if (stmts[i].predecessors_ == 0u) {
+            start(i);
+        }
+    }
+
+    // Write the results as they become available, in order.
+    std::exception_ptr error;
+    for (auto i = 0u; i < count; ++i) {
+        if (tasks[i].here) {
+            // Everything before it is done, (those it depends on may be
+            // about to say so).  After a failure, it only passes that on.
+            ready[i].wait();
+            run_task(i);
+        }
+        if (error) {
+            continue;
+        }
+        done[i].wait();
+        eval_.output() << tasks[i].out.str() << std::flush;
+        try {
+            done[i].get();
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+    // Nothing here may go until every task is done with it.
+    std::unique_lock<std::mutex> lock(finished_mutex);
+    all_finished.wait(lock, [&] { return finished == count; });
+    eval_.add_dispatches(dispatches + 1u);   // (and the root)
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+namespace {
+
+/// Collect the variables of the scopes in n, and in the functions it calls.
+void
+gather_locals(const node &n, var_set &locals, var_set &funcs)
+{
+    if (auto p = n.get_parent(); p && p->scope_) {
+        for (auto &child : p->scope_->children) {
+            if (child->get_kind<variable>()) {
+                locals.insert(child.get());
+            }
+        }
+    }
+    if (auto callee = user_callee(n); callee && funcs.insert(callee).second) {
+        gather_locals(*callee, locals, funcs);
+    }
+    for (auto &child : n.children) {
+        gather_locals(*child, locals, funcs);
+    }
+}
+
+const node*
+referenced(const node &n)
+{
+    return n.get_kind<variable_ref>()->symbol_;
+}
+
+const std::string&
+name_of(const node *var)
+{
+    return var->get_kind<variable>()->name_;
+}
+
+/// Is every use of the array in n an element indexed by the loop variable,
+/// (so that no two iterations of the loop use the same element)?
+bool
+indexed_by(const node &n, const node *array, const node *var)
+{
+    if (n.get_kind<element>() || n.get_kind<element_assignment>()) {
+        if (referenced(*n.children[0]) == array &&
+            (!n.children[1]->get_kind<variable_ref>() ||
+             referenced(*n.children[1]) != var)) {
+            return false;
+        }
+        return std::all_of(n.children.begin() + 1, n.children.end(),
+                           [&](auto &child)
+                           { return indexed_by(*child, array, var); });
+    }
+    if (auto ref = n.get_kind<variable_ref>(); ref) {
+        return ref->symbol_ != array;
+    }
+    if (auto callee = user_callee(n); callee) {
+        var_set reads;
+        collect_reads(*callee->children[0], reads);
+        if (reads.count(array)) {
+            return false;
+        }
+    }
+    return std::all_of(n.children.begin(), n.children.end(),
+                       [&](auto &child)
+                       { return indexed_by(*child, array, var); });
+}
+
+/// Check one parallel loop.
+/// @return The problems found, by variable name.
+std::map<std::string, std::string>
+check_loop(const node &n, const parallel_loop &loop, access_analysis &access)
+{
+    std::map<std::string, std::string> problems;
+    auto var = referenced(*n.children[0]);
+    auto &body = *n.children.back();
+
+    var_set bounds;
+    collect_reads(*n.children[1], bounds);
+    collect_reads(*n.children[2], bounds);
+    if (bounds.count(var)) {
+        problems[name_of(var)] =
+            "The bounds of a parallel loop may not use its variable.";
+    }
+
+    var_set reductions;
+    var_set reads;
+    collect_reads(body, reads);
+    for (auto i = 0u; i < loop.reductions_.size(); ++i) {
+        auto r = referenced(*n.children[3 + i]);
+        reductions.insert(r);
+        if (r->get_kind<variable>()->cell_) {
+            problems[name_of(r)] = "Reduction variable '" + name_of(r) +
+                "' may not be shared.";
+        } else if (reads.count(r)) {
+            problems[name_of(r)] = "Reduction variable '" + name_of(r) +
+                "' is read in the body of a parallel loop.";
+        }
+    }
+
+    var_set locals, funcs;
+    gather_locals(body, locals, funcs);
+    var_set called;
+    for (auto f : funcs) {
+        auto w = access.writes(*f->children[0]);
+        called.insert(w.begin(), w.end());
+    }
+    auto exposed = access.exposed(body, var_set{var});
+    for (auto v : access.writes(body)) {
+        auto &name = name_of(v);
+        if (v == var) {
+            problems[name] = "The variable of a parallel loop may not be "
+                             "assigned in its body.";
+        } else if (reductions.count(v)) {
+            if (called.count(v)) {
+                problems[name] = "Reduction variable '" + name +
+                    "' is assigned by a function called from a parallel "
+                    "loop.";
+            }
+        } else if (v->get_kind<variable>()->cell_) {
+            // Updated atomically, (see atomic_marker).
+            continue;
+        } else if (v->get_kind<variable>()->length_ && !locals.count(v) &&
+                   !called.count(v) && indexed_by(body, v, var)) {
+            // Each iteration has elements of its own.
+            continue;
+        } else if (!locals.count(v)) {
+            problems[name] = "Variable '" + name + "' is declared outside "
+                             "a parallel loop, but assigned in it.";
+        } else if (exposed.count(v)) {
+            problems[name] = "Variable '" + name + "' may carry a value "
+                             "from one iteration of a parallel loop to the "
+                             "next.";
+        }
+    }
+    return problems;
+}
+
+std::size_t
+check_loops(node &n, access_analysis &access, std::ostream &diagnostics)
+{
+    std::size_t removed = 0u;
+    for (auto &child : n.children) {
+        auto loop = child->get_kind<parallel_loop>();
+        if (!loop) {
+            removed += check_loops(*child, access, diagnostics);
+            continue;
+        }
+        auto problems = check_loop(*child, *loop, access);
+        if (problems.empty()) {
+            removed += check_loops(*child, access, diagnostics);
+            continue;
+        }
+        for (auto &[name, problem] : problems) {
+            error_msg(diagnostics, std::as_const(*child), problem);
+        }
+        // Unlink the loop's scope from the enclosing one, then remove it.
+        if (auto par = loop->scope_->get_kind<scope>()->parent_scope_; par) {
+            auto &subs = par->get_kind<scope>()->subscopes_;
+            subs.erase(std::remove(subs.begin(), subs.end(),
+                                   loop->scope_.get()),
+                       subs.end());
+        }
+        child->children.clear();
+        child->set_kind(Node::error{ });
+        child->set_type<Node::error>();
+        ++removed;
+    }
+    return removed;
+}
+
+} // namespace
+
+std::size_t
+check_parallel_loops(node &root, std::ostream &diagnostics)
+{
+    access_analysis access;
+    return check_loops(root, access, diagnostics);
+}
+
+std::vector<bool>
+invariant_statements(const node &root, const std::vector<std::size_t> &inputs)
+{
+    auto overlaps = [](const std::vector<std::size_t> &a,
+                       const std::vector<std::size_t> &b)
+        {
+            // Both are sorted.
+            auto i = a.begin();
+            auto j = b.begin();
+            while (i != a.end() && j != b.end()) {
+                if (*i == *j) {
+                    return true;
+                }
+                *i < *j ? ++i : ++j;
+            }
+            return false;
+        };
+    auto merge = [](std::vector<std::size_t> &into,
+                    const std::vector<std::size_t> &from)
+        {
+            std::vector<std::size_t> result;
+            std::set_union(into.begin(), into.end(), from.begin(), from.end(),
+                           std::back_inserter(result));
+            into = std::move(result);
+        };
+
+    auto sorted = inputs;
+    std::sort(sorted.begin(), sorted.end());
+    access_analysis access;
+    std::vector<std::size_t> read_by_rest, written_by_rest;
+    std::vector<bool> invariant;
+    for (auto &child : root.children) {
+        auto writes = access.writes(*child);
+        auto exposed = access.exposed(*child);
+        var_set reads;
+        collect_reads(*child, reads);
+        reads.insert(writes.begin(), writes.end());
+        bool shared = std::any_of(reads.begin(), reads.end(),
+            [](auto var)
+            {
+                auto v = var->template get_kind<variable>();
+                return v && v->cell_;
+            });
+        auto read = slots(exposed);
+        auto written = slots(writes);
+        bool moves = !shared && !overlaps(read, sorted) &&
+                     !overlaps(read, written_by_rest) &&
+                     !overlaps(written, sorted) &&
+                     !overlaps(written, written_by_rest) &&
+                     !overlaps(written, read_by_rest);
+        if (!moves) {
+            merge(read_by_rest, read);
+            merge(written_by_rest, written);
+        }
+        invariant.push_back(moves);
+    }
+    return invariant;
+}
+
+} // namespace Calc
@@ -0,0 +1,189 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef DATAFLOW_H_INCLUDED
+#define DATAFLOW_H_INCLUDED
+
+#include "node.h"
+#include "liveness.h"
+
+#include <map>
+#include <ostream>
+#include <vector>
+
+namespace Calc {
+class evaluator;
+
+/// Find what a statement may read and write, following calls into the
+/// functions called, (through a summary of each, or every read it may make
+/// if it may recurse).  Summaries are cached, so an instance should only be
+/// used while the tree isn't changed.
+class access_analysis
+{
+public:
+    access_analysis() = default;
+    access_analysis(const access_analysis &) = delete;
+    access_analysis(access_analysis &&) = default;
+    ~access_analysis() = default;
+
+    access_analysis& operator=(const access_analysis &) = delete;
+    access_analysis& operator=(access_analysis &&) = default;
+
+    /// The variables n may read before writing them.  Parameters are left
+    /// out, since every call writes them before its body runs.
+    /// @param written The variables already written.
+    var_set exposed(const Node::node &n, var_set written = var_set{});
+
+    /// The variables n may write.
+    var_set writes(const Node::node &n);
+
+private:
+    /// Walk a statement in execution order, as upward_exposed() does.
+    void walk(const Node::node &n, var_set &written, var_set &exposed);
+
+    /// Add the variables an expression may read which aren't written yet.
+    void expression(const Node::node &n, const var_set &written,
+                    var_set &exposed);
+
+    /// The variables a call to func may read before writing them.
+    var_set function_reads(const Node::node &func);
+
+    /// Collect the variables n, (and anything it calls), may write.
+    void collect_writes(const Node::node &n, var_set &writes,
+                        var_set &funcs);
+
+    std::map<const Node::node *, var_set> functions_;
+    var_set                               active_;
+    var_set                               parameters_;
+};
+
+/// The dependences between the top-level statements of a tree, once
+/// frame_allocator has given every variable a slot.
+/// A slot is shared if some statement may read it before writing it, (so
+/// the value may come from an earlier statement).  A statement depends on
+/// the statements before it which write a shared slot it reads or writes,
+/// and on those which read a shared slot it writes.  Other slots only ever
+/// hold values within a single statement.
+class statement_graph
+{
+public:
+    /// One top-level statement.
+    struct statement
+    {
+        std::vector<std::size_t> reads_;        ///< Shared slots read first.
+        std::vector<std::size_t> writes_;       ///< Shared slots written.
+        std::vector<std::size_t> successors_;   ///< Those which wait for it.
+        std::size_t              predecessors_ = 0u;
+
+        /// Does it assign a shared variable, (which is seen outside of the
+        /// script, so isn't one of the slots)?
+        bool                     shares_ = false;
+    };
+
+    statement_graph() = default;
+    statement_graph(const statement_graph &) = delete;
+    statement_graph(statement_graph &&) = default;
+    ~statement_graph() = default;
+
+    statement_graph& operator=(const statement_graph &) = delete;
+    statement_graph& operator=(statement_graph &&) = default;
+
+    /// Find the dependences between the statements of root.
+    void run(const Node::node &root);
+
+    /// The statements, in order.
+    const auto& statements() const          { return statements_; }
+
+    /// The number of statements in the longest chain of dependences.
+    std::size_t depth() const;
+
+    /// Print the size of the graph.
+    void report(std::ostream &os) const;
+
+private:
+    std::vector<statement> statements_;
+};
+
+/// Evaluate the top-level statements of a tree on the evaluator's pool of
+/// threads, each as soon as those it depends on, (see statement_graph), are
+/// done.  Each statement runs on an evaluator of its worker's, which takes
+/// the shared slots it uses from the main evaluator, and gives back those
+/// it writes.  The results are written, in order, to the main evaluator's
+/// output.  Statements which may run a parallel loop, (whose wait would tie
+/// up a worker), or which assign a shared variable, (which other scripts
+/// see), are evaluated on the calling thread, in turn, after every statement
+/// before them has succeeded.  So a failure leaves the shared variables as
+/// evaluating in order would, though independent statements after it may
+/// have been evaluated, (their output is dropped).
+class parallel_evaluator
+{
+public:
+    /// @param eval The main evaluator.
+    explicit parallel_evaluator(evaluator &eval) : eval_(eval) { }
+    parallel_evaluator(const parallel_evaluator &) = delete;
+    parallel_evaluator(parallel_evaluator &&) = default;
+    ~parallel_evaluator() = default;
+
+    parallel_evaluator& operator=(const parallel_evaluator &) = delete;
+    parallel_evaluator& operator=(parallel_evaluator &&) = delete;
+
+    /// Evaluate root.  Programs too small to gain from threads, (by
+    /// cost_model's estimate), or with no independent statements, are
+    /// evaluated by the main evaluator alone, as they are if it has no
+    /// pool.
+    void run(Node::node &root);
+
+    /// Print the size of the graph.
+    void report(std::ostream &os) const     { graph_.report(os); }
+
+private:
+    evaluator       &eval_;
+    statement_graph graph_;
+};
+
+/// Check that the iterations of each parallel loop in an analyzed tree are
+/// independent, apart from the reductions.  In the body, (and the functions
+/// it calls), the loop variable may only be read, the reduction variables
+/// only assigned, (directly), and any other variable assigned must belong
+/// to the body or to a function called, and be written before it is read.
+/// Loops which break the rules are reported, and removed.
+/// @return The number of loops removed.
+std::size_t check_parallel_loops(Node::node &root, std::ostream &diagnostics);
+
+/// Find the top-level statements of a tree, (with its slots allocated),
+/// which don't depend on the initial values of the input slots, and which
+/// can be moved ahead of those which do: they read nothing written by a
+/// statement which stays, write nothing such a statement reads or writes,
+/// (or an input), and use no shared variables.  Evaluating the invariant
+/// statements once, in order, and then the rest for each set of inputs,
+/// from the values the invariant ones left, gives the same values as
+/// evaluating them all for each, (see batch).
+/// @return For each top-level statement, whether it is invariant.
+std::vector<bool> invariant_statements(const Node::node &root,
+                                       const std::vector<std::size_t> &inputs);
+
+} // namespace Calc
+
+#endif // DATAFLOW_H_INCLUDED
@@ -37,6 +37,47 @@ const char *funcColor = "red";
 
 using namespace Calc::Node;
 
+static const char*
+relation_name(relation op)
+{
+    switch (op) {
+    case relation::equal_to:         return "=";
+    case relation::not_equal:        return "!=";
+    case relation::less_than:        return "<";
+    case relation::less_or_equal:    return "<=";
+    case relation::greater_than:     return ">";
+    case relation::greater_or_equal: return ">=";
+    }
+    return "?";
+}
+
+static const char*
+array_op_name(array_op op)
+{
+    switch (op) {
+    case array_op::sum:        return "sum";
+    case array_op::min:        return "min";
+    case array_op::max:        return "max";
+    case array_op::dot:        return "dot";
+    case array_op::fill:       return "fill";
+    case array_op::prefix_sum: return "prefix_sum";
+    }
+    return "?";
+}
+
+static const char*
+reduction_name(reduction r)
+{
+    switch (r) {
+    case reduction::sum:         return "sum";
+    case reduction::min:         return "min";
+    case reduction::max:         return "max";
+    case reduction::logical_and: return "and";
+    case reduction::logical_or:  return "or";
+    }
+    return "?";
+}
+
 class dot_visitor : public node_visitor
 {
 public:
@@ -67,6 +108,7 @@ private:
     void print_links(const node &n,
                      std::string_view s,
                      const char *color = defaultColor);
+    void print_compare_links(const node &n, const compare_base &c);
 
 };
 
@@ -166,6 +208,25 @@ dot_visitor::print_node(node &n)
             name = "Target: ";
             name += c->name_;
         }
+    } else if (auto inc = n.get_kind<increment>(); inc) {
+        name = "+= " + std::to_string(inc->value_);
+    } else if (auto b = n.get_kind<array_builtin>(); b) {
+        name = array_op_name(b->op_);
+    } else if (auto e = n.get_kind<element>(); e && !e->checked_) {
+        name = "unchecked";
+    } else if (auto e = n.get_kind<element_assignment>();
+               e && !e->checked_) {
+        name = "unchecked";
+    } else if (auto c = n.get_compare(); c) {
+        name = relation_name(c->op_);
+        if (!c->rhs_) {
+            name += ' ';
+            name += std::to_string(c->value_);
+        }
+        if (auto e = n.get_kind<exit_on_compare>(); e && !e->name_.empty()) {
+            name += "\\nTarget: ";
+            name += e->name_;
+        }
     }
     os_ << "  x" << &n
         << " [color=" << decorator.get_color()
@@ -227,6 +288,22 @@ dot_visitor::pre_visit(node &n, loop_bottom_test_statement &l)
     print_links(n, linkNames);
 }
 
+void
+dot_visitor::pre_visit(node &n, parallel_loop &l)
+{
+    print_node(n);
+    LinkNames linkNames{"variable", "first", "last"};
+    for (auto r : l.reductions_) {
+        linkNames.emplace_back(reduction_name(r));
+    }
+    linkNames.emplace_back("body");
+    print_links(n, linkNames);
+    if (l.scope_) {
+        accept(*l.scope_);
+        print_link(n, *l.scope_, "scope");
+    }
+}
+
 void
 dot_visitor::pre_visit(node &n, variable_ref &r)
 {
@@ -451,6 +528,57 @@ dot_visitor::pre_visit(node &n, return_statement &s)
     print_links(n, "expression");
 }
 
+void
+dot_visitor::print_compare_links(const node &n, const compare_base &c)
+{
+    print_link(n, *c.lhs_, "lhs", varColor);
+    if (c.rhs_) {
+        print_link(n, *c.rhs_, "rhs", varColor);
+    }
+}
+
+void
+dot_visitor::pre_visit(node &n, increment &inc)
+{
+    print_node(n);
+    print_link(n, *inc.symbol_, "variable", varColor);
+}
+
+void
+dot_visitor::pre_visit(node &n, compare &c)
+{
+    print_node(n);
+    print_compare_links(n, c);
+}
+
+void
+dot_visitor::pre_visit(node &n, exit_on_compare &c)
+{
+    print_node(n);
+    print_compare_links(n, c);
+}
+
+void
+dot_visitor::pre_visit(node &n, element &)
+{
+    print_node(n);
+    print_links(n, LinkNames{"array", "index"});
+}
+
+void
+dot_visitor::pre_visit(node &n, element_assignment &)
+{
+    print_node(n);
+    print_links(n, LinkNames{"array", "index", "expression"});
+}
+
+void
+dot_visitor::pre_visit(node &n, array_builtin &)
+{
+    print_node(n);
+    print_links(n, "argument");
+}
+
 void
 print_dot(std::ostream &os, node &n)
 {
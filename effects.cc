@@ -0,0 +1,234 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "effects.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+/// Cost of a call which may never return.
+constexpr unsigned unbounded_cost = 1000u;
+
+/// Rough number of times a loop body is assumed to run.
+constexpr unsigned loop_factor = 10u;
+
+const function*
+user_function(const node *n)
+{
+    auto func = n ? n->get_kind<function>() : nullptr;
+    if (!func || func->is_intrinsic() || n->children.size() != 1) {
+        return nullptr;
+    }
+    return func;
+}
+
+bool
+safe_divisor(const node &n)
+{
+    auto num = n.get_kind<number>();
+    return num && num->value_ != 0 && num->value_ != -1;
+}
+
+/// Does the call match the function it calls?
+bool
+well_formed_call(const node &n, const function_call &fc)
+{
+    auto callee = fc.symbol_ ? fc.symbol_->get_kind<function>() : nullptr;
+    if (!callee) {
+        return false;
+    }
+    if (callee->is_intrinsic()) {
+        return n.children.size() == 1;
+    }
+    auto &s = callee->scope_;
+    return s && s->children.size() == n.children.size() &&
+           fc.symbol_->children.size() == 1;
+}
+
+/// Effects and failures made by n itself, (not its children, nor the
+/// function it calls).
+/// @return The function n calls, if it is a well formed call to one
+///         defined in the script.
+const node*
+own_facts(const node &n, bool &pure, bool &cannot_fail)
+{
+    if (n.get_kind<assignment_statement>() || n.get_kind<increment>() ||
+        n.get_kind<expression_statement>() || n.get_kind<parallel_loop>() ||
+        n.get_kind<element_assignment>()) {
+        pure = false;
+    }
+    if (auto b = n.get_kind<array_builtin>();
+        b && (b->op_ == array_op::fill || b->op_ == array_op::prefix_sum)) {
+        pure = false;
+    }
+    if (auto e = n.get_kind<element>(); e && e->checked_) {
+        cannot_fail = false;
+    }
+    if (auto e = n.get_kind<element_assignment>(); e && e->checked_) {
+        cannot_fail = false;
+    }
+    if (n.get_kind<loop_top_test_statement>() ||
+        n.get_kind<loop_bottom_test_statement>()) {
+        cannot_fail = false;
+    }
+    if ((n.get_kind<division>() || n.get_kind<modulus>()) &&
+        !safe_divisor(*n.children[1])) {
+        cannot_fail = false;
+    }
+    if (auto fc = n.get_kind<function_call>(); fc) {
+        if (!well_formed_call(n, *fc)) {
+            pure = false;
+            cannot_fail = false;
+        } else if (user_function(fc->symbol_)) {
+            return fc->symbol_;
+        }
+    }
+    return nullptr;
+}
+
+/// Effects and failures made directly by n, (not by functions it calls),
+/// and the functions it calls.
+void
+direct_facts(const node &n, bool &pure, bool &cannot_fail,
+             std::vector<const node *> &callees)
+{
+    if (n.get_kind<function>()) {
+        // A definition does nothing until it is called.
+        return;
+    }
+    if (auto callee = own_facts(n, pure, cannot_fail); callee) {
+        callees.push_back(callee);
+    }
+    for (auto &child : n.children) {
+        direct_facts(*child, pure, cannot_fail, callees);
+    }
+}
+
+} // namespace
+
+const effect_analysis::facts&
+effect_analysis::function_facts(const node &func)
+{
+    if (auto found = functions_.find(&func); found != functions_.end()) {
+        return found->second;
+    }
+    // Look at everything reachable from func.  If func can reach itself,
+    // it may recurse forever.
+    facts result;
+    std::vector<const node *> pending{&func};
+    std::set<const node *> seen;
+    while (!pending.empty()) {
+        auto f = pending.back();
+        pending.pop_back();
+        if (!seen.insert(f).second) {
+            continue;
+        }
+        std::vector<const node *> callees;
+        direct_facts(*f->children[0], result.pure_, result.cannot_fail_,
+                     callees);
+        if (std::find(callees.begin(), callees.end(), &func) != callees.end()) {
+            result.cannot_fail_ = false;
+        }
+        pending.insert(pending.end(), callees.begin(), callees.end());
+    }
+    // Insert before computing the cost, so that recursion terminates.
+    result.cost_ = unbounded_cost;
+    auto &cached = functions_[&func] = result;
+    if (result.cannot_fail_) {
+        cached.cost_ = cost(*func.children[0]);
+    }
+    return cached;
+}
+
+const effect_analysis::facts&
+effect_analysis::node_facts(const node &n)
+{
+    if (auto found = nodes_.find(&n); found != nodes_.end()) {
+        return found->second;
+    }
+    facts result;
+    if (n.get_kind<function>()) {
+        // A definition does nothing until it is called.
+        return nodes_[&n] = result;
+    }
+    auto callee = own_facts(n, result.pure_, result.cannot_fail_);
+    if (callee) {
+        auto &f = function_facts(*callee);
+        result.pure_ = result.pure_ && f.pure_;
+        result.cannot_fail_ = result.cannot_fail_ && f.cannot_fail_;
+    }
+    unsigned total = 1u;
+    for (auto &child : n.children) {
+        auto &f = node_facts(*child);
+        result.pure_ = result.pure_ && f.pure_;
+        result.cannot_fail_ = result.cannot_fail_ && f.cannot_fail_;
+        total += f.cost_;
+    }
+    if (auto fc = n.get_kind<function_call>(); fc) {
+        if (user_function(fc->symbol_)) {
+            total += function_facts(*fc->symbol_).cost_;
+        } else {
+            total += 1u;
+        }
+    }
+    if (n.get_kind<array_builtin>()) {
+        // A pass over the elements.
+        total += n.children[0]->get_kind<variable_ref>()->symbol_
+                     ->get_kind<variable>()->length_;
+    }
+    if (n.get_kind<loop_top_test_statement>() ||
+        n.get_kind<loop_bottom_test_statement>() ||
+        n.get_kind<parallel_loop>()) {
+        total *= loop_factor;
+    }
+    result.cost_ = std::min(total, unbounded_cost);
+    return nodes_[&n] = result;
+}
+
+bool
+effect_analysis::pure(const node &n)
+{
+    return node_facts(n).pure_;
+}
+
+bool
+effect_analysis::cannot_fail(const node &n)
+{
+    return node_facts(n).cannot_fail_;
+}
+
+unsigned
+effect_analysis::cost(const node &n)
+{
+    return node_facts(n).cost_;
+}
+
+} // namespace Calc
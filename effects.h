@@ -0,0 +1,84 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef EFFECTS_H_INCLUDED
+#define EFFECTS_H_INCLUDED
+
+#include "node.h"
+
+#include <map>
+#include <set>
+
+namespace Calc {
+
+/// Answer questions about what evaluating an expression may do.
+/// Results for functions, and for each node asked about, (and those below
+/// it), are cached, so each is worked out once.  So an instance should only
+/// be used while the tree is not being changed in ways which would alter
+/// them, (changing operand order and operator kinds is fine).
+class effect_analysis
+{
+public:
+    effect_analysis() = default;
+    effect_analysis(const effect_analysis &) = delete;
+    effect_analysis(effect_analysis &&) = default;
+    ~effect_analysis() = default;
+
+    effect_analysis& operator=(const effect_analysis &) = delete;
+    effect_analysis& operator=(effect_analysis &&) = default;
+
+    /// Is evaluating n free of side effects?  (No variables are assigned,
+    /// and nothing is printed, by n or by any function it calls.)
+    bool pure(const Node::node &n);
+
+    /// Does evaluating n always complete?  (No division which may trap, no
+    /// loops or recursion which may not terminate, no malformed calls.)
+    bool cannot_fail(const Node::node &n);
+
+    /// A relative estimate of how expensive evaluating n is.
+    unsigned cost(const Node::node &n);
+
+private:
+    struct facts
+    {
+        bool     pure_ = true;
+        bool     cannot_fail_ = true;
+        unsigned cost_ = 0u;
+    };
+
+    /// The facts about calling a function, computed from everything it
+    /// may call.
+    const facts& function_facts(const Node::node &func);
+
+    /// The facts about evaluating n, from those of its children.
+    const facts& node_facts(const Node::node &n);
+
+    std::map<const Node::node *, facts> functions_;
+    std::map<const Node::node *, facts> nodes_;
+};
+
+} // namespace Calc
+
+#endif // EFFECTS_H_INCLUDED
@@ -35,23 +35,35 @@
 namespace Calc {
 
 template <typename ...Args>
-void error_msg(const Node::node &n, const Args& ...args)
+void error_msg(std::ostream &os, const Node::node &n, const Args& ...args)
 {
-    std::cerr << "Error: ";
+    os << "Error: ";
     auto pos = n.begin();
-    std::cerr << pos.source << ": " << pos.line << ", " << pos.column << ": ";
-    (std::cerr << ... << args);
-    std::cerr << std::endl;
+    os << pos.source << ": " << pos.line << ", " << pos.column << ": ";
+    (os << ... << args);
+    os << std::endl;
 }
 
 template <typename ...Args>
-void error_msg(Node::node &n, const Args& ...args)
+void error_msg(std::ostream &os, Node::node &n, const Args& ...args)
 {
-    error_msg(std::cref(n), args...);
+    error_msg(os, std::cref(n), args...);
     n.set_kind(Node::error{ });
     n.set_type<Node::error>();
 }
 
+template <typename ...Args>
+void error_msg(const Node::node &n, const Args& ...args)
+{
+    error_msg(std::cerr, n, args...);
+}
+
+template <typename ...Args>
+void error_msg(Node::node &n, const Args& ...args)
+{
+    error_msg(std::cerr, n, args...);
+}
+
 } // namespace Calc
 
 
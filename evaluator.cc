@@ -24,8 +24,22 @@
  */
 
 #include "evaluator.h"
+#include "array_ops.h"
+#include "cost_model.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <sstream>
+#include <string>
+#include <stdexcept>
 
 #include <CompuBrite/CheckPoint.h>
 
@@ -34,6 +48,31 @@ namespace cbi = CompuBrite;
 
 using namespace Calc::Node;
 
+namespace {
+
+/// The stack kept free below a call, (for what is evaluated before the
+/// next call is checked, and for throwing the error).
+constexpr std::uintptr_t stack_reserve = 64u << 10;
+
+/// Collect the arrays whose elements are assigned in n, (not counting the
+/// functions it calls, which may not assign the elements of an array
+/// assigned in a parallel loop, see check_parallel_loops).
+void
+assigned_arrays(const node &n, std::set<node *> &arrays)
+{
+    if (n.get_kind<function>()) {
+        return;
+    }
+    if (n.get_kind<element_assignment>()) {
+        arrays.insert(n.children[0]->get_kind<variable_ref>()->symbol_);
+    }
+    for (auto &child : n.children) {
+        assigned_arrays(*child, arrays);
+    }
+}
+
+} // namespace
+
 void
 evaluator::pre_visit(node &n, declaration &)
 {
@@ -64,7 +103,7 @@ void
 evaluator::pre_visit(node &n, variable_ref &var)
 {
     auto ptr = var.symbol_;
-    set_result(values_[ptr]);
+    set_result(load(ptr));
 }
 
 void
@@ -87,6 +126,7 @@ evaluator::pre_visit(node &n, loop_top_test_statement &)
     auto &cond = *n.children[0];
     auto &body = *n.children[1];
     while (true) {
+        preemption_point();
         accept(cond);
         if (result_ == 0) {
             return;
@@ -110,6 +150,7 @@ evaluator::pre_visit(node &n, loop_bottom_test_statement &)
     auto &cond = *n.children[1];
     auto &body = *n.children[0];
     do {
+        preemption_point();
         try {
             accept(body);
         } catch (const loop_exiting &e) {
@@ -155,6 +196,18 @@ evaluator::pre_visit(node &n, exit_statement &es)
     }
 }
 
+void
+evaluator::pre_visit(node &n, exit_on_compare &ec)
+{
+    auto lhs = load(ec.lhs_);
+    auto rhs = ec.rhs_ ? load(ec.rhs_) : ec.value_;
+    // The condition is still the last value evaluated, as for exit_statement.
+    set_result(ec.test(lhs, rhs));
+    if (result_) {
+        throw loop_exiting{ec.name_};
+    }
+}
+
 void
 evaluator::pre_visit(node &n, return_statement &)
 {
@@ -163,20 +216,152 @@ evaluator::pre_visit(node &n, return_statement &)
 }
 
 void
-evaluator::pre_visit(node &n, assignment_statement &)
+evaluator::pre_visit(node &n, assignment_statement &a)
 {
-    accept(*n.children[1]);
     auto var = n.children[0]->get_kind<variable_ref>()->symbol_;
+    if (a.atomic_ != atomic_form::none) {
+        assign_shared(n, a.atomic_, var);
+    } else {
+        accept(*n.children[1]);
+        if (!reducing_.empty() && reduce(var, result_)) {
+            return;
+        }
+        value(var) = result_;
+    }
     auto name = var->get_kind<variable>()->name_;
-    values_[var] = result_;
-    std::cerr << "Result: " << name << " = " << result_ << std::endl;
+    *out_ << "Result: " << name << " = " << result_ << std::endl;
+}
+
+int&
+evaluator::element_at(const element_base &e, node *var, int index)
+{
+    auto v = var->get_kind<variable>();
+    if (e.checked_ && (index < 0 || index >= v->length_)) {
+        throw std::range_error("Index " + std::to_string(index) +
+                               " is out of bounds for '" + v->name_ + "[" +
+                               std::to_string(v->length_) + "]'.");
+    }
+    return values_[v->slot_ + index];
+}
+
+void
+evaluator::pre_visit(node &n, element &e)
+{
+    auto var = n.children[0]->get_kind<variable_ref>()->symbol_;
+    accept(*n.children[1]);
+    set_result(element_at(e, var, result_));
+}
+
+void
+evaluator::pre_visit(node &n, element_assignment &e)
+{
+    auto var = n.children[0]->get_kind<variable_ref>()->symbol_;
+    accept(*n.children[1]);
+    auto index = result_;
+    accept(*n.children[2]);
+    element_at(e, var, index) = result_;
+    *out_ << "Result: " << var->get_kind<variable>()->name_ << '[' << index
+          << "] = " << result_ << std::endl;
+}
+
+void
+evaluator::pre_visit(node &n, array_builtin &b)
+{
+    auto var = n.children[0]->get_kind<variable_ref>()->symbol_;
+    auto a = elements(var);
+    std::size_t length = var->get_kind<variable>()->length_;
+    switch (b.op_) {
+    case array_op::sum:
+        set_result(array_ops::sum(a, length));
+        break;
+    case array_op::min:
+        set_result(array_ops::min(a, length));
+        break;
+    case array_op::max:
+        set_result(array_ops::max(a, length));
+        break;
+    case array_op::dot: {
+        auto other = n.children[1]->get_kind<variable_ref>()->symbol_;
+        set_result(array_ops::dot(a, elements(other), length));
+        break;
+    }
+    case array_op::fill:
+        accept(*n.children[1]);
+        array_ops::fill(a, length, result_);
+        break;
+    case array_op::prefix_sum:
+        set_result(array_ops::prefix_sum(a, length));
+        break;
+    }
+}
+
+void
+evaluator::assign_shared(node &n, atomic_form form, node *var)
+{
+    auto &cell = *var->get_kind<variable>()->cell_;
+    auto &expr = *n.children[1];
+    switch (form) {
+    case atomic_form::add:
+    case atomic_form::subtract: {
+        // Evaluate the operand which isn't the variable itself.
+        auto &lhs = *expr.children[0];
+        auto ref = lhs.get_kind<variable_ref>();
+        accept(ref && ref->symbol_ == var ? *expr.children[1] : lhs);
+        auto delta = static_cast<unsigned>(result_);
+        if (form == atomic_form::subtract) {
+            delta = 0u - delta;
+        }
+        auto old = cell.fetch_add(static_cast<int>(delta));
+        set_result(static_cast<int>(static_cast<unsigned>(old) + delta));
+        break;
+    }
+    case atomic_form::update: {
+        // Evaluate the expression with the value last seen, until no other
+        // script has changed the variable in the meantime.
+        auto old = cell.load();
+        do {
+            pinned_ = var;
+            pinned_value_ = old;
+            try {
+                accept(expr);
+            } catch (...) {
+                // Later loads must see the cell, not a stale value.
+                pinned_ = nullptr;
+                throw;
+            }
+            pinned_ = nullptr;
+        } while (!cell.compare_exchange_weak(old, result_));
+        break;
+    }
+    default:
+        accept(expr);
+        cell.store(result_);
+        break;
+    }
+}
+
+void
+evaluator::pre_visit(node &n, increment &inc)
+{
+    auto var = inc.symbol_;
+    if (auto cell = var->get_kind<variable>()->cell_; cell) {
+        auto delta = static_cast<unsigned>(inc.value_);
+        set_result(static_cast<int>(
+            static_cast<unsigned>(cell->fetch_add(inc.value_)) + delta));
+    } else {
+        auto &v = value(var);
+        v += inc.value_;
+        set_result(v);
+    }
+    *out_ << "Result: " << var->get_kind<variable>()->name_ << " = "
+          << result_ << std::endl;
 }
 
 void
 evaluator::pre_visit(node &n, expression_statement &)
 {
     accept(*n.children[0]);
-    std::cerr << "Result: " << result_ << std::endl;
+    *out_ << "Result: " << result_ << std::endl;
 }
 
 void
@@ -199,62 +384,50 @@ evaluator::pre_visit(node &n, unary_plus &)
 }
 
 void
-evaluator::pre_visit(node &n, multiplication &)
+evaluator::pre_visit(node &n, multiplication &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     set_result(lhs * rhs);
 }
 
 void
-evaluator::pre_visit(node &n, division &)
+evaluator::pre_visit(node &n, division &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     set_result(lhs / rhs);
 }
 
 void
-evaluator::pre_visit(node &n, modulus &)
+evaluator::pre_visit(node &n, modulus &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     set_result(lhs % rhs);
 }
 
 void
-evaluator::pre_visit(node &n, addition &)
+evaluator::pre_visit(node &n, addition &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     set_result(lhs + rhs);
 }
 
 void
-evaluator::pre_visit(node &n, subtraction &)
+evaluator::pre_visit(node &n, subtraction &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     set_result(lhs - rhs);
 }
 
 void
-evaluator::pre_visit(node &n, logical_or &)
+evaluator::pre_visit(node &n, logical_or &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     if ((lhs != 0) || (rhs != 0)) {
         set_result(1);
         return;
@@ -289,12 +462,10 @@ evaluator::pre_visit(node &n, logical_not &)
 }
 
 void
-evaluator::pre_visit(node &n, logical_and &)
+evaluator::pre_visit(node &n, logical_and &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     if ((lhs != 0) && (rhs != 0)) {
         set_result(1);
         return;
@@ -321,12 +492,10 @@ evaluator::pre_visit(node &n, logical_and_then &)
 }
 
 void
-evaluator::pre_visit(node &n, equal_to &)
+evaluator::pre_visit(node &n, equal_to &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     if (lhs == rhs) {
         set_result(1);
         return;
@@ -335,12 +504,10 @@ evaluator::pre_visit(node &n, equal_to &)
 }
 
 void
-evaluator::pre_visit(node &n, not_equal &)
+evaluator::pre_visit(node &n, not_equal &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     if (lhs != rhs) {
         set_result(1);
         return;
@@ -349,12 +516,10 @@ evaluator::pre_visit(node &n, not_equal &)
 }
 
 void
-evaluator::pre_visit(node &n, less_than &)
+evaluator::pre_visit(node &n, less_than &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     if (lhs < rhs) {
         set_result(1);
         return;
@@ -363,12 +528,10 @@ evaluator::pre_visit(node &n, less_than &)
 }
 
 void
-evaluator::pre_visit(node &n, less_or_equal &)
+evaluator::pre_visit(node &n, less_or_equal &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     if (lhs <= rhs) {
         set_result(1);
         return;
@@ -377,12 +540,10 @@ evaluator::pre_visit(node &n, less_or_equal &)
 }
 
 void
-evaluator::pre_visit(node &n, greater_than &)
+evaluator::pre_visit(node &n, greater_than &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     if (lhs > rhs) {
         set_result(1);
         return;
@@ -391,12 +552,10 @@ evaluator::pre_visit(node &n, greater_than &)
 }
 
 void
-evaluator::pre_visit(node &n, greater_or_equal &)
+evaluator::pre_visit(node &n, greater_or_equal &op)
 {
-    accept(*n.children[0]);
-    auto lhs = result_;
-    accept(*n.children[1]);
-    auto rhs = result_;
+    int lhs, rhs;
+    operands(n, op, lhs, rhs);
     if (lhs >= rhs) {
         set_result(1);
         return;
@@ -404,12 +563,21 @@ evaluator::pre_visit(node &n, greater_or_equal &)
     set_result(0);
 }
 
+void
+evaluator::pre_visit(node &n, compare &c)
+{
+    auto lhs = load(c.lhs_);
+    auto rhs = c.rhs_ ? load(c.rhs_) : c.value_;
+    set_result(c.test(lhs, rhs));
+}
+
 void
 evaluator::pre_visit(node &n, function_call &fc)
 {
     cbi::CheckPoint::expect(CBI_HERE, fc.symbol_, "No defined function!");
     auto func_node = fc.symbol_->get_kind<function>();
     cbi::CheckPoint::expect(CBI_HERE, func_node, "func_node should not be null");
+    preemption_point();
 
     if (auto func = func_node->get_intrinsic(); func) {
         accept(*n.children[0]);
@@ -417,9 +585,13 @@ evaluator::pre_visit(node &n, function_call &fc)
         set_result(func(operand));
         return;
     }
-    // Not an intrinsic function.
+    if (func_node->frame_size_) {
+        call_recursive(n, *fc.symbol_);
+        return;
+    }
+    // Not an intrinsic function, and not recursive.
     // Evaluate each argument and assign it's value to the corresponding
-    // parameter.  Recursive functions are not yet supported.
+    // parameter.
     cbi::CheckPoint cp("ev-function-call");
     cp.print(CBI_HERE, "function call: ", func_node->name_);
     auto &scope = func_node->scope_;
@@ -428,7 +600,7 @@ evaluator::pre_visit(node &n, function_call &fc)
         accept(*arg);
         //auto var = (*param)->get_kind<variable>();
         //auto name = var->get_kind<variable>()->name_;
-        values_[(*param).get()] = result_;
+        value((*param).get()) = result_;
         cp.print(CBI_HERE, "Param: ", result_);
         ++param;
     }
@@ -440,4 +612,324 @@ evaluator::pre_visit(node &n, function_call &fc)
     }
 }
 
+void
+evaluator::call_recursive(node &n, node &func)
+{
+    // The arguments may read the parameters of an enclosing call, so they
+    // are all evaluated before any parameter is assigned.
+    std::vector<int> args;
+    args.reserve(n.children.size());
+    for (auto &arg : n.children) {
+        accept(*arg);
+        args.push_back(result_);
+    }
+    auto f = func.get_kind<function>();
+    // How deep a call may go depends on the expressions it nests in, so
+    // the stack left is measured, rather than the calls counted.
+    char here;
+    if (stack_floor_ &&
+        reinterpret_cast<std::uintptr_t>(&here) <
+            reinterpret_cast<std::uintptr_t>(stack_floor_) + stack_reserve) {
+        throw std::runtime_error("Calls to '" + f->name_ +
+                                 "' nested too deeply for the stack.");
+    }
+    auto first = values_.begin() + f->frame_;
+    Values saved(first, first + f->frame_size_);
+    auto param = f->scope_->children.begin();
+    for (auto arg : args) {
+        value((param++)->get()) = arg;
+    }
+    try {
+        accept(*func.children[0]);
+    } catch (const function_returning &) {
+    } catch (...) {
+        std::copy(saved.begin(), saved.end(), values_.begin() + f->frame_);
+        throw;
+    }
+    std::copy(saved.begin(), saved.end(), values_.begin() + f->frame_);
+}
+
+void
+evaluator::operands(node &n, const operation &op, int &lhs, int &rhs)
+{
+    if (op.fork_ && pool_ && fork_depth_ < fork_limit_ &&
+        pool_->size() > 1u) {
+        fork(n, lhs, rhs);
+        return;
+    }
+    accept(*n.children[0]);
+    lhs = result_;
+    accept(*n.children[1]);
+    rhs = result_;
+}
+
+void
+evaluator::fork(node &n, int &lhs, int &rhs)
+{
+    // Whoever claims the task first evaluates it.  If it is still waiting
+    // when the left operand is done, it is evaluated here, so a thread
+    // only ever waits for a task which is already running.
+    struct task
+    {
+        std::atomic<bool>       claimed{false};
+        Values                  values;
+        std::mutex              mutex;
+        std::condition_variable finished;
+        bool                    done = false;
+        int                     result = 0;
+        std::size_t             dispatches = 0u;
+        std::exception_ptr      error;
+    };
+    auto t = std::make_shared<task>();
+    t->values = values_;
+    auto &right = *n.children[1];
+    // The task may run while this evaluator carries on, (and changes its
+    // depth), so it takes copies of what it needs rather than this.
+    pool_->submit([t, &right, out = out_, pool = pool_,
+                   depth = fork_depth_ + 1u, limit = fork_limit_]
+        {
+            if (t->claimed.exchange(true)) {
+                return;
+            }
+            // Pure operands print nothing, and change only the slots of
+            // the functions they call, so a copy of the slots will do.
+            evaluator eval(0u, *out);
+            eval.values_ = std::move(t->values);
+            eval.pool_ = pool;
+            eval.fork_depth_ = depth;
+            eval.fork_limit_ = limit;
+            try {
+                eval.accept(right);
+                t->result = eval.result_;
+            } catch (...) {
+                t->error = std::current_exception();
+            }
+            t->dispatches = eval.dispatches();
+            std::lock_guard<std::mutex> lock(t->mutex);
+            t->done = true;
+            t->finished.notify_all();
+        });
+
+    std::exception_ptr error;
+    ++fork_depth_;
+    try {
+        accept(*n.children[0]);
+        lhs = result_;
+    } catch (...) {
+        error = std::current_exception();
+    }
+    if (!t->claimed.exchange(true)) {
+        // Nobody took it.  Evaluating the operands in order, the right one
+        // wouldn't have been reached after a failure.
+        if (!error) {
+            try {
+                accept(right);
+                rhs = result_;
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        --fork_depth_;
+    } else {
+        --fork_depth_;
+        std::unique_lock<std::mutex> lock(t->mutex);
+        t->finished.wait(lock, [&t] { return t->done; });
+        dispatches_ += t->dispatches;
+        if (!error) {
+            error = t->error;
+            rhs = t->result;
+        }
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+bool
+evaluator::reduce(node *var, int v)
+{
+    auto slot = var->get_kind<variable>()->slot_;
+    for (auto r = reducing_.rbegin(); r != reducing_.rend(); ++r) {
+        if (r->first == slot) {
+            auto &total = values_[slot];
+            total = parallel_loop::combine(r->second, total, v);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+evaluator::worth_parallel(const node &loop, std::int64_t iterations)
+{
+    // Below this many dispatches, handing out the work costs more than it
+    // saves.
+    constexpr std::uint64_t grain = 1u << 14;
+
+    auto found = iteration_costs_.find(&loop);
+    if (found == iteration_costs_.end()) {
+        cost_model model;
+        auto e = model.cost(*loop.children.back());
+        found = iteration_costs_.emplace(&loop,
+            e.bounded() ? e.cost_ : grain).first;
+    }
+    return found->second * static_cast<std::uint64_t>(iterations) >= grain;
+}
+
+void
+evaluator::pre_visit(node &n, parallel_loop &pl)
+{
+    accept(*n.children[1]);
+    std::int64_t first = result_;
+    accept(*n.children[2]);
+    std::int64_t last = result_;
+    auto iterations = last < first ? 0 : last - first + 1;
+    auto count = pl.reductions_.size();
+
+    if (pool_ && pool_->size() > 1u && iterations > 1 &&
+        worth_parallel(n, iterations)) {
+        run_parallel(n, pl, first, iterations);
+    } else {
+        auto var = n.children[0]->get_kind<variable_ref>()->symbol_;
+        for (auto i = 0u; i < count; ++i) {
+            auto r = n.children[3 + i]->get_kind<variable_ref>()->symbol_;
+            reducing_.emplace_back(r->get_kind<variable>()->slot_,
+                                   pl.reductions_[i]);
+        }
+        auto &body = *n.children.back();
+        try {
+            for (auto i = first; i <= last; ++i) {
+                preemption_point();
+                value(var) = static_cast<int>(i);
+                accept(body);
+            }
+        } catch (...) {
+            // Later assignments to the variables mustn't be reduced.
+            reducing_.resize(reducing_.size() - count);
+            throw;
+        }
+        reducing_.resize(reducing_.size() - count);
+    }
+
+    for (auto i = 0u; i < count; ++i) {
+        auto r = n.children[3 + i]->get_kind<variable_ref>()->symbol_;
+        *out_ << "Result: " << r->get_kind<variable>()->name_ << " = "
+              << value(r) << std::endl;
+    }
+}
+
+void
+evaluator::run_parallel(node &n, parallel_loop &pl, std::int64_t first,
+                        std::int64_t iterations)
+{
+    // The chunks depend only on the number of workers, and are combined in
+    // order, so the results are the same however the work is stolen.
+    auto chunks = static_cast<std::size_t>(
+        std::min<std::int64_t>(iterations, pool_->size() * 4));
+    auto var = n.children[0]->get_kind<variable_ref>()->symbol_;
+    auto count = pl.reductions_.size();
+    std::vector<node *> reductions;
+    for (auto i = 0u; i < count; ++i) {
+        reductions.push_back(
+            n.children[3 + i]->get_kind<variable_ref>()->symbol_);
+    }
+    auto &body = *n.children.back();
+    // Each iteration assigns only the elements at its own index, which are
+    // copied back from the chunk that ran it.
+    std::set<node *> arrays;
+    assigned_arrays(body, arrays);
+
+    struct chunk
+    {
+        std::ostringstream out;
+        std::vector<int>   partial;
+        std::vector<int>   elements;
+        std::size_t        dispatches = 0u;
+        std::exception_ptr error;
+    };
+    std::vector<chunk> parts(chunks);
+    std::mutex mutex;
+    std::condition_variable finished;
+    auto remaining = chunks;
+
+    auto run_chunk = [&](std::size_t c)
+        {
+            auto &part = parts[c];
+            evaluator eval(0u, part.out);
+            eval.values_ = values_;
+            for (auto i = 0u; i < count; ++i) {
+                auto slot = reductions[i]->get_kind<variable>()->slot_;
+                eval.reducing_.emplace_back(slot, pl.reductions_[i]);
+                eval.values_[slot] = parallel_loop::identity(pl.reductions_[i]);
+            }
+            auto lo = first + iterations * c / chunks;
+            auto hi = first + iterations * (c + 1) / chunks;
+            try {
+                for (auto i = lo; i < hi; ++i) {
+                    eval.value(var) = static_cast<int>(i);
+                    eval.accept(body);
+                }
+            } catch (...) {
+                part.error = std::current_exception();
+            }
+            for (auto r : reductions) {
+                part.partial.push_back(eval.value(r));
+            }
+            for (auto a : arrays) {
+                auto v = a->get_kind<variable>();
+                for (auto i = std::max<std::int64_t>(lo, 0);
+                     i < std::min<std::int64_t>(hi, v->length_); ++i) {
+                    part.elements.push_back(eval.values_[v->slot_ + i]);
+                }
+            }
+            part.dispatches = eval.dispatches();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--remaining == 0u) {
+                finished.notify_all();
+            }
+        };
+
+    // Split the chunks in halves, handing the upper halves to be stolen,
+    // until a single chunk is left to run.
+    std::function<void(std::size_t, std::size_t)> split =
+        [&](std::size_t lo, std::size_t hi)
+        {
+            while (hi - lo > 1u) {
+                auto mid = lo + (hi - lo) / 2u;
+                pool_->submit([&split, mid, hi] { split(mid, hi); });
+                hi = mid;
+            }
+            run_chunk(lo);
+        };
+    pool_->submit([&split, chunks] { split(0u, chunks); });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&remaining] { return remaining == 0u; });
+    }
+
+    for (auto c = 0u; c < chunks; ++c) {
+        auto &part = parts[c];
+        *out_ << part.out.str();
+        dispatches_ += part.dispatches;
+        if (part.error) {
+            std::rethrow_exception(part.error);
+        }
+        auto lo = first + iterations * c / chunks;
+        auto hi = first + iterations * (c + 1) / chunks;
+        auto element = part.elements.begin();
+        for (auto a : arrays) {
+            auto v = a->get_kind<variable>();
+            for (auto i = std::max<std::int64_t>(lo, 0);
+                 i < std::min<std::int64_t>(hi, v->length_); ++i) {
+                values_[v->slot_ + i] = *element++;
+            }
+        }
+        for (auto i = 0u; i < count; ++i) {
+            auto &total = value(reductions[i]);
+            total = parallel_loop::combine(pl.reductions_[i], total,
+                                           part.partial[i]);
+        }
+    }
+}
+
 } // namespace Calc
@@ -30,16 +30,29 @@
 #include "node.h"
 #include "visitor.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
 #include <map>
+#include <utility>
+#include <vector>
 
 namespace Calc {
+class thread_pool;
+
 /// Evaluate the parse tree.
 /// Once the parse has completed, traverse the parse tree evaluating the nodes to
 /// produce a result.
 class evaluator : public node_visitor
 {
 public:
-    evaluator() = default;
+    /// @param frame_size The number of variable slots, (see
+    /// frame_allocator).
+    /// @param out Where results are written.
+    explicit evaluator(std::size_t frame_size = 0u,
+                       std::ostream &out = std::cerr) :
+        values_(frame_size), out_(&out) { }
     evaluator(const evaluator &) = delete;
     evaluator(evaluator &&) = default;
     ~evaluator() = default;
@@ -53,10 +66,152 @@ public:
     /// Set the result of the current evaluation.
     void set_result(int res)                { result_ = res; }
 
+    /// The storage for a slot, (see frame_allocator).
+    int& slot(std::size_t i)                { return values_[i]; }
+
+    /// The value of a variable, (shared or not).
+    int load(Node::node *var)
+    {
+        auto v = var->get_kind<Node::variable>();
+        if (auto cell = v->cell_; cell) {
+            return var == pinned_ ? pinned_value_ : cell->load();
+        }
+        return values_[v->slot_];
+    }
+
+    /// Set every slot back to 0, (shared variables are left alone).
+    void reset()
+    {
+        values_.assign(values_.size(), 0);
+    }
+
+    /// Set every slot to its value in values, (as left by another
+    /// evaluation, see batch).
+    void reset(const std::vector<int> &values)
+    {
+        std::copy(values.begin(), values.end(), values_.begin());
+    }
+
+    /// The values of every slot.
+    const std::vector<int>& slots() const   { return values_; }
+
+    /// The number of variable slots.
+    std::size_t frame_size() const          { return values_.size(); }
+
+    /// Where results are written.
+    std::ostream& output() const            { return *out_; }
+    void output(std::ostream &out)          { out_ = &out; }
+
+    /// Count nodes dispatched elsewhere, (by another evaluator working on
+    /// the same tree), as dispatched by this one.
+    void add_dispatches(std::size_t n)      { dispatches_ += n; }
+
+    /// The threads to run parallel loops on, (nullptr to run them on this
+    /// one).
+    thread_pool* pool() const               { return pool_; }
+    void pool(thread_pool *p)               { pool_ = p; }
+
+    /// How deeply forks, (see fork_marker), may nest before the operands
+    /// are evaluated one after the other, (0 never forks).
+    unsigned fork_limit() const             { return fork_limit_; }
+    void fork_limit(unsigned limit)         { fork_limit_ = limit; }
+
+    /// The lowest address the stack evaluating on may grow down to, (nullptr
+    /// for no limit).  Calls to functions which may recurse then nest only
+    /// as deeply as the stack left allows, and a script which recurses too
+    /// deeply fails with an error, rather than overflowing a small stack,
+    /// (see scheduler).
+    void stack_floor(const void *floor)     { stack_floor_ = floor; }
+
+    /// Call hook at the next loop back-edge or function call after each
+    /// quantum nodes dispatched, (so that a scheduler can switch to another
+    /// script).
+    void preempt(std::function<void()> hook, std::size_t quantum)
+    {
+        preempt_ = std::move(hook);
+        quantum_ = quantum;
+        next_preempt_ = dispatches_ + quantum;
+    }
+
 private:
-    using ValueMap = std::map<Node::node*, int>;
-    ValueMap values_;
-    int      result_{0};
+    /// The storage for a variable.
+    int& value(Node::node *var)
+    {
+        return values_[var->get_kind<Node::variable>()->slot_];
+    }
+
+    /// The first element of an array.
+    int* elements(Node::node *var)
+    {
+        return &values_[var->get_kind<Node::variable>()->slot_];
+    }
+
+    /// The storage for an element of an array, (whose index is checked
+    /// unless it is known to be in bounds).
+    /// Throws std::range_error if the index is out of bounds.
+    int& element_at(const Node::element_base &e, Node::node *var, int index);
+
+    /// Assign a shared variable, (see atomic_marker).
+    void assign_shared(Node::node &n, Node::atomic_form form,
+                       Node::node *var);
+
+    /// A loop back-edge, or a function call.
+    void preemption_point()
+    {
+        if (preempt_ && dispatches_ >= next_preempt_) {
+            next_preempt_ = dispatches_ + quantum_;
+            preempt_();
+        }
+    }
+
+    /// Evaluate the operands of a binary operation.
+    void operands(Node::node &n, const Node::operation &op, int &lhs,
+                  int &rhs);
+
+    /// Evaluate the right operand as a task, which may be stolen, while
+    /// evaluating the left one here.
+    void fork(Node::node &n, int &lhs, int &rhs);
+
+    /// Call a function which may recurse, saving its slots around the call.
+    /// Throws std::runtime_error if too little of the stack is left.
+    void call_recursive(Node::node &n, Node::node &func);
+
+    /// If var is the variable of a reduction in progress, combine v with
+    /// it.
+    bool reduce(Node::node *var, int v);
+
+    /// Is a parallel loop big enough to be worth running on the pool?
+    bool worth_parallel(const Node::node &loop, std::int64_t iterations);
+
+    /// Run the iterations of a parallel loop on the pool, in chunks, each
+    /// on an evaluator of its own, then combine the chunks in order.
+    void run_parallel(Node::node &n, Node::parallel_loop &pl,
+                      std::int64_t first, std::int64_t iterations);
+
+    using Values = std::vector<int>;
+    Values       values_;
+    std::ostream *out_;
+    int          result_{0};
+    thread_pool  *pool_ = nullptr;
+    unsigned     fork_depth_{0u};
+    unsigned     fork_limit_{8u};
+    const void   *stack_floor_ = nullptr;
+
+    /// While an update to a shared variable is evaluated, the value it is
+    /// based on.
+    Node::node   *pinned_ = nullptr;
+    int          pinned_value_{0};
+
+    std::function<void()> preempt_;
+    std::size_t           quantum_{0u};
+    std::size_t           next_preempt_{0u};
+
+    /// The reductions of the parallel loops being run, (the slot, and how
+    /// it is combined), innermost last.
+    std::vector<std::pair<int, Node::reduction>> reducing_;
+
+    /// The estimated cost of an iteration of each parallel loop met so far.
+    std::map<const Node::node *, std::uint64_t> iteration_costs_;
 
 private:
     struct function_returning { };
@@ -0,0 +1,83 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "fork_marker.h"
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+/// Operands cheaper than this, (in effect_analysis units), aren't worth a
+/// task.  A call which may recurse is always worth one.
+constexpr unsigned grain = 200u;
+
+/// The binary operation part of n, or nullptr.  The short circuit
+/// operators are left out, since their right operand may not be evaluated
+/// at all.
+operation*
+binary_operation(node &n)
+{
+    if (n.children.size() != 2u || n.get_kind<function_call>() ||
+        n.get_kind<logical_and_then>() || n.get_kind<logical_or_else>()) {
+        return nullptr;
+    }
+    return n.get_operation();
+}
+
+} // namespace
+
+void
+fork_marker::mark(node &n)
+{
+    ++visited_;
+    for (auto &child : n.children) {
+        mark(*child);
+    }
+    auto op = binary_operation(n);
+    if (!op) {
+        return;
+    }
+    // (The facts are kept for each node, so asking at every level of a long
+    // chain of operations doesn't walk it again.)
+    auto &lhs = *n.children[0];
+    auto &rhs = *n.children[1];
+    op->fork_ = effects_.cost(lhs) >= grain && effects_.cost(rhs) >= grain &&
+                effects_.pure(lhs) && effects_.pure(rhs);
+    if (op->fork_) {
+        ++marked_;
+    }
+}
+
+std::size_t
+fork_marker::run(node &root)
+{
+    auto marked = marked_;
+    mark(root);
+    return marked_ - marked;
+}
+
+} // namespace Calc
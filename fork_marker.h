@@ -0,0 +1,67 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef FORK_MARKER_H_INCLUDED
+#define FORK_MARKER_H_INCLUDED
+
+#include "node.h"
+#include "effects.h"
+
+namespace Calc {
+
+/// Mark the binary operations whose operands may be evaluated at the same
+/// time, (see evaluator).  Both operands must be pure, so neither can see
+/// the other, and both expensive enough to be worth a task of their own,
+/// (in practice, both call a function which may recurse, as in
+/// "fib(n - 1) + fib(n - 2)").
+class fork_marker
+{
+public:
+    fork_marker() = default;
+    fork_marker(const fork_marker &) = delete;
+    fork_marker(fork_marker &&) = default;
+    ~fork_marker() = default;
+
+    fork_marker& operator=(const fork_marker &) = delete;
+    fork_marker& operator=(fork_marker &&) = default;
+
+    /// Mark the operations in an analyzed tree.
+    /// @return The number of operations marked.
+    std::size_t run(Node::node &root);
+
+    /// The number of nodes looked at so far.
+    std::size_t visited() const             { return visited_; }
+
+private:
+    void mark(Node::node &n);
+
+    effect_analysis effects_;
+    std::size_t     visited_{0u};
+    std::size_t     marked_{0u};
+};
+
+} // namespace Calc
+
+#endif // FORK_MARKER_H_INCLUDED
@@ -83,6 +83,12 @@ struct LBRACE : one< '{' > { };
 /// RBRACE <- '}'
 struct RBRACE : one< '}' > { };
 
+/// LBRACKET <- '['
+struct LBRACKET : one< '[' > { };
+
+/// RBRACKET <- ']'
+struct RBRACKET : one< ']' > { };
+
 /// LANGLE <- '<'
 struct LANGLE : one< '<' > { };
 
@@ -195,6 +201,33 @@ struct UNTIL : keyword < 'u', 'n', 't', 'i', 'l' > { };
 /// WHILE <- while !identifier_other
 struct WHILE : keyword < 'w', 'h', 'i', 'l', 'e' > { };
 
+/// PARALLEL <- parallel !identifier_other
+struct PARALLEL : keyword< 'p', 'a', 'r', 'a', 'l', 'l', 'e', 'l' > { };
+
+/// FOR <- for !identifier_other
+struct FOR : keyword< 'f', 'o', 'r' > { };
+
+/// FROM <- from !identifier_other
+struct FROM : keyword< 'f', 'r', 'o', 'm' > { };
+
+/// TO <- to !identifier_other
+struct TO : keyword< 't', 'o' > { };
+
+/// REDUCE <- reduce !identifier_other
+struct REDUCE : keyword< 'r', 'e', 'd', 'u', 'c', 'e' > { };
+
+/// SHARED <- shared !identifier_other
+struct SHARED : keyword< 's', 'h', 'a', 'r', 'e', 'd' > { };
+
+/// SUM <- sum !identifier_other
+struct SUM : keyword< 's', 'u', 'm' > { };
+
+/// MIN <- min !identifier_other
+struct MIN : keyword< 'm', 'i', 'n' > { };
+
+/// MAX <- max !identifier_other
+struct MAX : keyword< 'm', 'a', 'x' > { };
+
 /// AND <- ANDkw !(wsp THEN)
 struct AND : seq< ANDkw, not_at< wsp, THEN > > { };
 
@@ -207,11 +240,13 @@ struct OR : seq< ORkw, not_at< wsp, ELSE > > { };
 /// OR_ELSE
 struct OR_ELSE : seq< ORkw, wsp, ELSE > { };
 
-/// keywords <- AND / DEF / ELSE / EXIT / IF / LOOP / NOT / OR / THEN /
-///             UNTIL / VAR / WHILE / RETURN
+/// keywords <- AND / DEF / ELSE / EXIT / FOR / IF / LOOP / NOT / OR /
+///             PARALLEL / REDUCE / SHARED / THEN / UNTIL / VAR / WHILE /
+///             RETURN
+/// (FROM, TO, SUM, MIN and MAX are only keywords in a parallel loop.)
 struct keywords:
-    sor< AND, DEF, ELSE, EXIT, IF, LOOP, NOT, OR, RETURN, THEN,
-         UNTIL, VAR, WHILE > { };
+    sor< AND, DEF, ELSE, EXIT, FOR, IF, LOOP, NOT, OR, PARALLEL, REDUCE,
+         RETURN, SHARED, THEN, UNTIL, VAR, WHILE > { };
 
 /// logical_operator <- OR / AND / AND_THEN / OR_ELSE
 struct logical_operator : sor< AND_THEN, OR_ELSE, OR, AND > { };
@@ -242,8 +277,13 @@ struct expression_list : list<expression, COMMA, ws> { };
 struct function_call :
     seq< symbol_name, wss, LPAREN, wss, expression_list, wss, RPAREN > { };
 
-/// assignment <- symbol_name ASSIGN expression
-struct assignment : seq< symbol_name, wss, ASSIGN, wss, expression > { };
+/// element <- symbol_name LBRACKET expression RBRACKET
+struct element :
+    seq< symbol_name, wss, LBRACKET, wss, expression, wss, RBRACKET > { };
+
+/// assignment <- (element / symbol_name) ASSIGN expression
+struct assignment :
+    seq< sor< element, symbol_name >, wss, ASSIGN, wss, expression > { };
 
 /// expression <- relation (wss, logical_operator)*
 struct expression : list< relation, logical_operator, ws> { };
@@ -261,9 +301,10 @@ struct term : list< factor, multiplying_operator, ws > { };
 /// parenthezised_expr <- LPAREN expression RPAREN
 struct parenthesized_expr : seq< LPAREN, wss, expression, wss, RPAREN > { };
 
-/// primary <- function_call / integer / symbol_name / parenthesized_expr
+/// primary <- function_call / element / integer / symbol_name /
+///            parenthesized_expr
 struct primary :
-    sor< function_call, integer, symbol_name, parenthesized_expr> { };
+    sor< function_call, element, integer, symbol_name, parenthesized_expr> { };
 
 /// logical_negation <- NOT primary
 struct logical_negation: seq <NOT, wsp, primary> { };
@@ -294,8 +335,10 @@ struct assignment_statement : seq< assignment, wss, SEMI > { };
 /// expression_statement <- expression ';'
 struct expression_statement : seq< expression, wss, SEMI > { };
 
-/// decl_statement <- VAR symbol_name ';'
-struct decl_statement : seq< VAR, wsp, symbol_name, wss, SEMI > { };
+/// decl_statement <- SHARED? VAR symbol_name (LBRACKET integer RBRACKET)? ';'
+struct decl_statement :
+    seq< opt< SHARED, wsp >, VAR, wsp, symbol_name, wss,
+         opt< LBRACKET, wss, integer, wss, RBRACKET, wss >, SEMI > { };
 
 /// exit_statement <- EXIT (IF expression)? ';'
 struct exit_statement :
@@ -359,12 +402,31 @@ struct top_test :
 struct bottom_test :
     seq< compound_statement, wsp, sor< while_test, until_test>, wss, SEMI > { };
 
-/// loop_statement <- LOOP (top_test / bottom_test)
+/// reduction <- (SUM / MIN / MAX / ANDkw / ORkw) symbol_name
+struct reduction :
+    seq< sor< SUM, MIN, MAX, ANDkw, ORkw >, wsp, symbol_name > { };
+
+/// reductions <- REDUCE reduction (',' reduction)*
+struct reductions :
+    seq< REDUCE, wsp, list< reduction, COMMA, ws > > { };
+
+/// parallel_loop <- PARALLEL FOR symbol_name FROM expression TO expression
+///                  reductions? compound_statement
+struct parallel_loop :
+    seq<
+      PARALLEL, wsp, FOR, wsp, symbol_name, wsp,
+      FROM, wsp, expression, wsp,
+      TO, wsp, expression, wss,
+      opt< reductions, wss >,
+      compound_statement
+    > { };
+
+/// loop_statement <- LOOP (parallel_loop / top_test / bottom_test)
 /// A loop may have a loop_test at the top, or at the bottom, but not
 /// both.
 struct loop_statement :
     seq<
-      LOOP, wsp, sor < top_test, bottom_test >
+      LOOP, wsp, sor < parallel_loop, top_test, bottom_test >
     > { };
 
 /// statement <- loop_statement / compound_statement / simple_statement
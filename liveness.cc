@@ -0,0 +1,310 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "liveness.h"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+void
+gather_reads(const node &n, var_set &reads, var_set &funcs)
+{
+    if (auto ref = n.get_kind<variable_ref>(); ref) {
+        reads.insert(ref->symbol_);
+        return;
+    }
+    if (auto inc = n.get_kind<increment>(); inc) {
+        reads.insert(inc->symbol_);
+        return;
+    }
+    if (auto cmp = n.get_compare(); cmp) {
+        reads.insert(cmp->lhs_);
+        if (cmp->rhs_) {
+            reads.insert(cmp->rhs_);
+        }
+        return;
+    }
+    if (n.get_kind<function>()) {
+        // A definition reads nothing, only calls do.
+        return;
+    }
+    if (auto a = n.get_kind<assignment_statement>(); a) {
+        gather_reads(*n.children[1], reads, funcs);
+        return;
+    }
+    if (n.get_kind<declaration>()) {
+        return;
+    }
+    if (auto fc = n.get_kind<function_call>(); fc) {
+        auto callee = fc->symbol_;
+        if (callee && callee->get_kind<function>() &&
+            !callee->children.empty() && funcs.insert(callee).second) {
+            gather_reads(*callee->children[0], reads, funcs);
+        }
+    }
+    for (auto &child : n.children) {
+        gather_reads(*child, reads, funcs);
+    }
+}
+
+var_set
+intersect(const var_set &a, const var_set &b)
+{
+    var_set result;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                          std::inserter(result, result.begin()));
+    return result;
+}
+
+void
+reads_exposed(const node &n, const var_set &written, var_set &exposed)
+{
+    var_set reads;
+    collect_reads(n, reads);
+    for (auto var : reads) {
+        if (written.find(var) == written.end()) {
+            exposed.insert(var);
+        }
+    }
+}
+
+} // namespace
+
+void
+collect_reads(const node &n, var_set &reads)
+{
+    var_set funcs;
+    gather_reads(n, reads, funcs);
+}
+
+void
+upward_exposed(const node &n, var_set &written, var_set &exposed)
+{
+    if (n.get_kind<compound_statement>() || n.get_kind<root>()) {
+        for (auto &child : n.children) {
+            upward_exposed(*child, written, exposed);
+        }
+        return;
+    }
+    if (n.get_kind<assignment_statement>()) {
+        reads_exposed(*n.children[1], written, exposed);
+        written.insert(n.children[0]->get_kind<variable_ref>()->symbol_);
+        return;
+    }
+    if (auto inc = n.get_kind<increment>(); inc) {
+        reads_exposed(n, written, exposed);
+        written.insert(inc->symbol_);
+        return;
+    }
+    if (n.get_kind<if_statement>()) {
+        reads_exposed(*n.children[0], written, exposed);
+        auto then_written = written;
+        upward_exposed(*n.children[1], then_written, exposed);
+        if (n.children.size() == 3) {
+            auto else_written = written;
+            upward_exposed(*n.children[2], else_written, exposed);
+            // Only what both branches write is definitely written.
+            written = intersect(then_written, else_written);
+        }
+        return;
+    }
+    if (n.get_kind<loop_top_test_statement>()) {
+        reads_exposed(*n.children[0], written, exposed);
+        // The body may never execute, so nothing it writes escapes.
+        auto body_written = written;
+        upward_exposed(*n.children[1], body_written, exposed);
+        return;
+    }
+    if (n.get_kind<loop_bottom_test_statement>()) {
+        // The body always executes once, but an exit statement may leave it
+        // part way through, so again nothing it writes escapes.
+        auto body_written = written;
+        upward_exposed(*n.children[0], body_written, exposed);
+        reads_exposed(*n.children[1], body_written, exposed);
+        return;
+    }
+    if (n.get_kind<function>() || n.get_kind<declaration>()) {
+        return;
+    }
+    reads_exposed(n, written, exposed);
+}
+
+namespace {
+
+bool
+user_function(const node &n)
+{
+    auto func = n.get_kind<function>();
+    return func && !func->is_intrinsic() && n.children.size() == 1 &&
+           func->scope_;
+}
+
+void
+collect_callees(const node &n, std::vector<const node *> &callees)
+{
+    if (auto fc = n.get_kind<function_call>();
+        fc && fc->symbol_ && user_function(*fc->symbol_)) {
+        callees.push_back(fc->symbol_);
+    }
+    for (auto &child : n.children) {
+        collect_callees(*child, callees);
+    }
+}
+
+} // namespace
+
+bool
+may_recurse(const node &func)
+{
+    std::vector<const node *> pending;
+    var_set seen;
+    collect_callees(*func.children[0], pending);
+    while (!pending.empty()) {
+        auto callee = pending.back();
+        pending.pop_back();
+        if (callee == &func) {
+            return true;
+        }
+        if (seen.insert(callee).second) {
+            collect_callees(*callee->children[0], pending);
+        }
+    }
+    return false;
+}
+
+void
+frame_allocator::collect(node &n)
+{
+    if (user_function(n)) {
+        functions_.push_back(&n);
+    }
+    for (auto &child : n.children) {
+        collect(*child);
+    }
+}
+
+std::size_t
+frame_allocator::stack(node &n, std::size_t base, bool keep_all,
+                       std::vector<node *> &kept, Stacked &stacked,
+                       frame &f)
+{
+    // The statements are walked rather than the subscopes, since a scope
+    // without variables of its own isn't linked to its parent.
+    auto next = base;
+    if (auto p = n.get_parent(); p && p->scope_) {
+        // Only the variables of compound statements can be stacked, the
+        // others are globals or parameters.
+        bool keep = keep_all || !n.get_kind<compound_statement>();
+        var_set exposed;
+        if (!keep) {
+            var_set written;
+            upward_exposed(n, written, exposed);
+        }
+        for (auto &child : p->scope_->children) {
+            if (!child->get_kind<variable>()) {
+                continue;
+            }
+            ++f.variables_;
+            // Arrays are never stacked, they hold on to their elements.
+            if (keep || child->get_kind<variable>()->length_ ||
+                exposed.count(child.get())) {
+                kept.push_back(child.get());
+            } else {
+                stacked.emplace_back(child.get(), next++);
+            }
+        }
+    }
+    auto top = next;
+    for (auto &child : n.children) {
+        if (child->get_kind<function>()) {
+            // Functions have regions of their own.
+            continue;
+        }
+        top = std::max(top, stack(*child, next, keep_all, kept, stacked, f));
+    }
+    return top;
+}
+
+void
+frame_allocator::allocate(const std::string &name, node &n, bool keep_all)
+{
+    frame f;
+    f.name_ = name;
+    std::vector<node *> kept;
+    Stacked stacked;
+    auto depth = stack(n, 0u, keep_all, kept, stacked, f);
+
+    auto slot = size_;
+    for (auto var : kept) {
+        auto v = var->get_kind<variable>();
+        v->slot_ = slot;
+        slot += std::max(1, v->length_);
+    }
+    for (auto &[var, offset] : stacked) {
+        var->get_kind<variable>()->slot_ = slot + offset;
+    }
+    f.kept_ = kept.size();
+    f.slots_ = slot - size_ + depth;
+    if (auto func = n.get_kind<function>(); func && keep_all) {
+        func->frame_ = static_cast<int>(size_);
+        func->frame_size_ = static_cast<int>(f.slots_);
+    }
+    size_ += f.slots_;
+    frames_.push_back(f);
+}
+
+std::size_t
+frame_allocator::run(node &root)
+{
+    collect(root);
+    allocate("<top level>", root, false);
+    for (auto func : functions_) {
+        // The function node holds the parameters, its body the rest.
+        allocate(func->get_kind<function>()->name_, *func,
+                 may_recurse(*func));
+    }
+    return size_;
+}
+void
+frame_allocator::report(std::ostream &os) const
+{
+    std::size_t variables = 0u;
+    for (auto &f : frames_) {
+        os << "Frame " << f.name_ << ": " << f.variables_ << " variables, "
+           << f.kept_ << " kept, " << f.slots_ << " slots\n";
+        variables += f.variables_;
+    }
+    os << "Frames: " << variables << " variables in " << size_
+       << " slots\n";
+}
+
+} // namespace Calc
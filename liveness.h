@@ -0,0 +1,122 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef LIVENESS_H_INCLUDED
+#define LIVENESS_H_INCLUDED
+
+#include "node.h"
+
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Calc {
+
+using var_set = std::set<const Node::node *>;
+
+/// Walk a statement, (or expression), in execution order, and collect the
+/// variables which may be read before they are definitely written.
+/// @param n The statement or expression to walk.
+/// @param written On entry, the variables known to be written already.  On
+/// exit, the variables which are definitely written after n has completed.
+/// @param exposed Variables which are read before they are written.
+/// Calls to user functions are treated as reading every variable which the
+/// function body, (or anything it calls), may read.
+void upward_exposed(const Node::node &n, var_set &written, var_set &exposed);
+
+/// Collect every variable which may be read while evaluating n, including
+/// reads made by any functions it calls.
+void collect_reads(const Node::node &n, var_set &reads);
+
+/// May the function be called again before a call to it has returned?
+bool may_recurse(const Node::node &func);
+
+/// Assign storage slots to variables.
+/// Each function, and the top level, gets a region of slots to itself.
+/// Within a region, variables which are written before they are read every
+/// time their scope is entered, (so no value survives from one entry to the
+/// next), are stacked by scope, so that sibling scopes, which are never
+/// active at the same time, share slots.  Every other variable, (globals,
+/// parameters, anything read before it is written, and everything in a
+/// function which may recurse), keeps a slot of its own.  The region of a
+/// function which may recurse is recorded in the function, so that the
+/// evaluator can save it around each call.
+class frame_allocator
+{
+public:
+    /// Statistics for one region.
+    struct frame
+    {
+        std::string name_;                  ///< Function name, or top level.
+        std::size_t variables_ = 0u;        ///< Variables in the region.
+        std::size_t kept_ = 0u;             ///< Variables with their own slot.
+        std::size_t slots_ = 0u;            ///< Slots used by the region.
+    };
+
+    frame_allocator() = default;
+    frame_allocator(const frame_allocator &) = delete;
+    frame_allocator(frame_allocator &&) = default;
+    ~frame_allocator() = default;
+
+    frame_allocator& operator=(const frame_allocator &) = delete;
+    frame_allocator& operator=(frame_allocator &&) = default;
+
+    /// Allocate a slot for every variable in an analyzed tree.
+    /// @return The number of slots needed.
+    std::size_t run(Node::node &root);
+
+    /// The number of slots needed.
+    std::size_t size() const                { return size_; }
+
+    /// The regions allocated.
+    const auto& frames() const              { return frames_; }
+
+    /// Print the statistics for each region.
+    void report(std::ostream &os) const;
+
+private:
+    using Stacked = std::vector<std::pair<Node::node *, std::size_t>>;
+
+    /// Find every function in the tree.
+    void collect(Node::node &n);
+
+    /// Allocate the slots for a function, or the top level.
+    void allocate(const std::string &name, Node::node &n, bool keep_all);
+
+    /// Stack the variables of the blocks in n at base.
+    /// @return The top of the stack.
+    std::size_t stack(Node::node &n, std::size_t base, bool keep_all,
+                      std::vector<Node::node *> &kept, Stacked &stacked,
+                      frame &f);
+
+    std::vector<Node::node *> functions_;
+    std::vector<frame>        frames_;
+    std::size_t               size_{0u};
+};
+
+} // namespace Calc
+
+#endif // LIVENESS_H_INCLUDED
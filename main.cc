@@ -35,10 +35,42 @@
 #include "semantic_analysis.h"
 #include "selector.h"
 #include "dotter.h"
+#include "specializer.h"
+#include "peephole.h"
+#include "short_circuit.h"
+#include "liveness.h"
+#include "tree_shaker.h"
+#include "tree_clone.h"
+#include "pass_manager.h"
+#include "rewrite.h"
+#include "cost_model.h"
+#include "compiler_context.h"
+#include "thread_pool.h"
+#include "chunked_parse.h"
+#include "dataflow.h"
+#include "fork_marker.h"
+#include "atomic_marker.h"
+#include "bounds_check.h"
+#include "batch.h"
+#include "column_file.h"
+#include "reactive.h"
+#include "shard.h"
+#include "scheduler.h"
 
 #include <CompuBrite/CheckPoint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
 
 static void print_dot(const std::string &name, Calc::Node::node &root)
 {
@@ -68,51 +100,647 @@ static void print_stats()
     std::cout << "Sizeof (function_base) " << sizeof(function_base) << std::endl;
 }
 
-int main(int argc, char *argv[])
+/// Add the optimizations, and the frame allocation, to the pass manager.
+/// Reports are written to err.
+static void add_passes(Calc::pass_manager &passes,
+                       Calc::frame_allocator &frames,
+                       std::ostream &err)
 {
-    using namespace tao::pegtl;
     namespace cbi = CompuBrite;
+    using Calc::pass_manager;
+    using Calc::node_visitor;
 
-    print_stats();
+    passes.add_transform("shake", [&err](Calc::Node::node &root)
+        {
+            auto size = Calc::tree_size(root);
+            Calc::tree_shaker shaker;
+            shaker.run(root);
+            cbi::CheckPoint shake("shake");
+            if (shake.active()) {
+                shaker.report(err);
+            }
+            return pass_manager::result{size, shaker.removed()};
+        });
 
-    if (argc == 1) {
-        std::cerr << "usage: calc <statements>\n";
-        return 1;
+    passes.add_transform("specialize", [&err](Calc::Node::node &root)
+        {
+            auto size = Calc::tree_size(root);
+            Calc::specializer spec;
+            auto changed = spec.run(root);
+            cbi::CheckPoint specialize("specialize");
+            if (specialize.active()) {
+                spec.report(err);
+            }
+            return pass_manager::result{size, changed};
+        });
+
+    passes.begin_fixed_point();
+    passes.add_transform("algebra", [](Calc::Node::node &root)
+        {
+            Calc::rewrite::rewriter rules(Calc::rewrite::algebraic_rules());
+            auto changed = rules.run(root);
+            return pass_manager::result{rules.visited(), changed};
+        });
+    passes.add_transform("short-circuit",
+        pass_manager::visit<Calc::short_circuit>(node_visitor::POST_VISIT,
+            [](auto &v) { return v.lowered() + v.reordered(); }));
+    passes.end_fixed_point();
+
+    cbi::CheckPoint no_peephole("no-peephole");
+    if (!no_peephole.active()) {
+        passes.add_transform("peephole",
+            pass_manager::visit<Calc::peephole>(node_visitor::POST_VISIT,
+                [](auto &v) { return v.rewritten(); }));
     }
-    for (auto i = 1u; i < argc; ++i) {
-        try {
-            cbi::CheckPoint trace("trace");
-            if (trace.active()) {
-                argv_input in(argv, i);
-                complete_trace<Calc::grammar::grammar>(in);
+
+    passes.add_analysis("bounds", [](Calc::Node::node &root)
+        {
+            Calc::bounds_check checks;
+            auto cleared = checks.run(root);
+            return pass_manager::result{checks.visited(), cleared};
+        });
+
+    passes.add_analysis("atomics", [](Calc::Node::node &root)
+        {
+            Calc::atomic_marker marker;
+            auto marked = marker.run(root);
+            return pass_manager::result{marker.visited(), marked};
+        });
+
+    passes.add_analysis("fork", [](Calc::Node::node &root)
+        {
+            Calc::fork_marker marker;
+            auto marked = marker.run(root);
+            return pass_manager::result{marker.visited(), marked};
+        });
+
+    passes.add_analysis("frames", [&frames](Calc::Node::node &root)
+        {
+            frames.run(root);
+            return pass_manager::result{Calc::tree_size(root), 0u};
+        });
+}
+
+/// Evaluate the top-level statements one at a time, comparing the work
+/// done, (in nodes dispatched), and the time taken, with the estimates.
+static void measure(Calc::evaluator &eval, Calc::Node::node &root,
+                    std::ostream &err)
+{
+    using clock = std::chrono::steady_clock;
+    using us = std::chrono::microseconds;
+
+    Calc::cost_model model;
+    model.report(err, root);
+    auto estimates = model.statements(root);
+    for (auto i = 0u; i < root.children.size(); ++i) {
+        auto dispatches = eval.dispatches();
+        auto start = clock::now();
+        eval.accept(*root.children[i]);
+        auto time = std::chrono::duration_cast<us>(clock::now() - start);
+        err << "Measured statement " << i + 1 << ": "
+            << eval.dispatches() - dispatches << " dispatches in "
+            << time.count() << " us, (estimated " << estimates[i] << ")\n";
+    }
+}
+
+/// The command line options.
+struct options
+{
+    bool        time_passes = false;
+    bool        cost = false;
+    std::size_t jobs = std::thread::hardware_concurrency();
+    unsigned    fork_depth = 8u;
+    std::size_t tenants = 0u;
+    std::size_t stack_size = Calc::scheduler::default_stack_size;
+
+    /// The CSV file to evaluate each record of, (see Calc::batch), and
+    /// the variables to write for each, (empty for the default).
+    std::string              batch;
+    std::vector<std::string> results;
+
+    /// Evaluate the batch one record at a time, even if it could be
+    /// vectorized.
+    bool                     scalar = false;
+
+    /// The values of the batch's columns, ("name:low:high"), and whether to
+    /// vectorize in 32 bit lanes even where narrower ones would do.
+    std::vector<std::string> ranges;
+    bool                     wide = false;
+
+    /// The number of records each thread evaluates at a time.
+    std::size_t              chunk_size = 4096u;
+
+    /// Where the results of a batch whose input is a column file go, (as
+    /// another).
+    std::string              output;
+
+    /// The aggregates of a batch, (see Calc::batch::aggregate), and whether
+    /// to write the results of each record as well.
+    std::vector<std::string> aggregates;
+    bool                     rows = true;
+
+    /// Split the batch into this many shards, each evaluated by a worker
+    /// process, (see Calc::coordinator); 0 to evaluate it here.  At most
+    /// workers run at once, (0 for all of them), each failed shard is run
+    /// again up to retries times, and the launcher, if any, starts each
+    /// worker command.
+    std::size_t              shards = 0u;
+    std::size_t              workers = 0u;
+    std::size_t              retries = 2u;
+    std::string              launcher;
+
+    /// Evaluate only rows [first, last) of the batch, and write their
+    /// results as a shard, (as a worker of a coordinator).
+    bool                     shard = false;
+    std::size_t              shard_first = 0u;
+    std::size_t              shard_last = 0u;
+
+    /// The options passed on to each worker.
+    std::vector<std::string> worker_args;
+
+    /// Pass on the option ending at argv[last], and its count - 1
+    /// arguments, to each worker.
+    void forward(char *argv[], int last, int count)
+    {
+        worker_args.insert(worker_args.end(), argv + last - count + 1,
+                           argv + last + 1);
+    }
+
+    /// The files to convert between CSV and the column format.
+    std::string              convert_from;
+    std::string              convert_to;
+
+    /// Keep the results up to date as inputs are read from the standard
+    /// input, (see Calc::reactive).
+    bool                     reactive = false;
+
+    /// The index in argv of each file name.
+    std::vector<int> files;
+
+    /// The threads to parse and analyze each file on, (several files are
+    /// already run at the same time).
+    std::size_t file_threads() const
+    {
+        return files.size() > 1 ? 1u : jobs;
+    }
+
+    /// Suffix for the names of the dot files, (empty for a single file).
+    std::string dot_suffix(int index) const
+    {
+        if (files.size() < 2) {
+            return "";
+        }
+        auto pos = std::find(files.begin(), files.end(), index);
+        return "-" + std::to_string(pos - files.begin() + 1);
+    }
+};
+
+/// Run a compiled file as several tenants at once, each with an evaluator
+/// of its own, time-sliced on the threads of a scheduler.  The results of
+/// each tenant are printed in turn, (with its error, if it fails), followed
+/// by the scheduling statistics.
+/// @return The number of tenants which failed.
+static std::size_t run_tenants(const options &opts, Calc::Node::node &root,
+                               std::size_t frame_size, std::ostream &err)
+{
+    // Nodes dispatched by a tenant before it gives up its thread.
+    constexpr std::size_t quantum = 1u << 12;
+
+    Calc::scheduler sched(opts.file_threads(), opts.stack_size);
+    std::vector<std::ostringstream> outputs(opts.tenants);
+    for (auto &out : outputs) {
+        sched.spawn([&root, &out, frame_size]
+            {
+                Calc::evaluator eval(frame_size, out);
+                eval.preempt(&Calc::scheduler::yield, quantum);
+                eval.stack_floor(Calc::scheduler::stack_floor());
+                eval.accept(root);
+            });
+    }
+    sched.run();
+    std::size_t failed = 0u;
+    for (auto i = 0u; i < outputs.size(); ++i) {
+        err << outputs[i].str();
+        if (auto error = sched.error(i); error) {
+            // The other tenants carry on regardless.
+            ++failed;
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::exception &e) {
+                err << "Tenant " << i + 1u << " failed: " << e.what()
+                    << std::endl;
             }
-            file_input in(argv[i]);
-            auto root = parse_tree::parse<Calc::grammar::grammar, Calc::Node::node, Calc::grammar::selector>(in);
-            if (root) {
-                std::cerr << "Parse successful." << std::endl;
-                root->set_kind<Calc::Node::root>({nullptr});
-                std::ofstream os("calc-parse.dot");
-                parse_tree::print_dot(os, *root);
-                os.close();
-                {
-                    auto parent = root->get_kind<Calc::Node::root>();
-                    Calc::semantic_analysis sem(*root, *parent);
-                    Calc::traversal trav(sem, Calc::node_visitor::PRE_VISIT |
-                                              Calc::node_visitor::POST_VISIT);
-                    trav.traverse(*root);
-                }
+        }
+    }
+    sched.report(err);
+    return failed;
+}
+
+/// Evaluate a compiled file once for each record of the batch input.
+/// @return The exit code, (0 for success).
+static int run_batch(const options &opts, Calc::Node::node &root,
+                     std::size_t frame_size, std::ostream &out,
+                     std::ostream &err)
+{
+    std::ifstream in(opts.batch);
+    if (!in) {
+        err << "Cannot open " << opts.batch << std::endl;
+        return 6;
+    }
+    Calc::batch records(root, frame_size);
+    if (!opts.results.empty()) {
+        records.results(opts.results);
+    }
+    if (opts.scalar) {
+        records.scalar();
+    }
+    if (opts.wide) {
+        records.wide();
+    }
+    std::unique_ptr<Calc::thread_pool> pool;
+    if (opts.file_threads() > 1u) {
+        pool = std::make_unique<Calc::thread_pool>(opts.file_threads());
+        records.pool(pool.get());
+    }
+    records.chunk_size(opts.chunk_size);
+    records.rows(opts.rows);
+    bool rows_out = false;
+    try {
+        for (auto &spec : opts.aggregates) {
+            records.aggregate(spec);
+        }
+        for (auto &spec : opts.ranges) {
+            records.range(spec);
+        }
+        if (opts.shard) {
+            Calc::column_reader columns(opts.batch);
+            records.run(columns, opts.shard_first, opts.shard_last, out);
+        } else if (Calc::column_reader::detect(opts.batch)) {
+            if (opts.output.empty() && opts.aggregates.empty()) {
+                err << "A column file batch needs --output, or --aggregate"
+                    << std::endl;
+                return 6;
+            }
+            Calc::column_reader columns(opts.batch);
+            records.run(columns, opts.rows ? opts.output : std::string());
+        } else {
+            records.run(in, opts.batch, out);
+            rows_out = opts.rows;
+        }
+    } catch (const std::runtime_error &e) {
+        err << "Batch error: " << e.what() << std::endl;
+        return 6;
+    }
+    if (!opts.aggregates.empty()) {
+        // (Not after the rows, which are CSV of another shape.)
+        records.write_aggregates(rows_out ? err : out);
+    }
+    records.report(err);
+    return 0;
+}
+
+/// Evaluate a batch in shards, each by a worker process running this
+/// program on some of the rows, (see Calc::coordinator).
+/// @return The exit code, (0 for success).
+static int run_coordinator(const options &opts, char *argv[])
+{
+    if (!Calc::column_reader::detect(opts.batch)) {
+        std::cerr << "A batch with --shards needs a column file, (see "
+                     "--convert)" << std::endl;
+        return 6;
+    }
+
+    // The workers run this program, (found the same way if the launcher
+    // runs them elsewhere).
+    std::vector<std::string> command;
+    std::istringstream launcher(opts.launcher);
+    for (std::string word; launcher >> word; ) {
+        command.push_back(word);
+    }
+    char self[4096];
+    auto length = ::readlink("/proc/self/exe", self, sizeof(self) - 1u);
+    command.push_back(length > 0 ? std::string(self, length) : argv[0]);
+    command.push_back("--batch");
+    command.push_back(opts.batch);
+    command.insert(command.end(), opts.worker_args.begin(),
+                   opts.worker_args.end());
+    command.push_back(argv[opts.files.front()]);
 
-                print_dot("calc-ast.dot", *root);
-                Calc::evaluator eval;
-                eval.accept(*root);
-            } else {
-                std::cerr << "Parse fail." << std::endl;
-                return 1;
+    Calc::coordinator shards(command, std::cerr);
+    shards.shards(opts.shards);
+    shards.workers(opts.workers);
+    shards.retries(opts.retries);
+    try {
+        std::size_t rows;
+        {
+            Calc::column_reader columns(opts.batch);
+            rows = columns.rows();
+        }
+        shards.run(rows, opts.output, std::cout);
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Batch error: " << e.what() << std::endl;
+        return 6;
+    }
+    shards.report(std::cerr);
+    return 0;
+}
+
+/// Convert a CSV file to the column format, or a column file to CSV.
+/// @return The exit code, (0 for success).
+static int convert(const options &opts)
+{
+    try {
+        if (Calc::column_reader::detect(opts.convert_from)) {
+            Calc::column_reader in(opts.convert_from);
+            std::ofstream out(opts.convert_to);
+            Calc::columns_to_csv(in, out);
+            if (!out.flush()) {
+                std::cerr << "Cannot write " << opts.convert_to << std::endl;
+                return 6;
             }
-        } catch (const std::exception &e) {
-            std::cerr << "Parse error: " << e.what() << std::endl;
-            return 5;
+        } else {
+            std::ifstream in(opts.convert_from);
+            if (!in) {
+                std::cerr << "Cannot open " << opts.convert_from << std::endl;
+                return 6;
+            }
+            Calc::csv_to_columns(in, opts.convert_from, opts.convert_to);
         }
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Convert error: " << e.what() << std::endl;
+        return 6;
     }
     return 0;
 }
+
+/// Compile and run one file.
+/// @param index The index of the file name in argv.
+/// @param out Where the standard output of the file goes.
+/// @param err Where results and diagnostics go.
+/// @return The exit code, (0 for success).
+static int run_file(const options &opts, int index, char *argv[],
+                    std::ostream &out, std::ostream &err)
+{
+    using namespace tao::pegtl;
+    namespace cbi = CompuBrite;
+
+    try {
+        cbi::CheckPoint trace("trace");
+        if (trace.active()) {
+            argv_input in(argv, index);
+            complete_trace<Calc::grammar::grammar>(in);
+        }
+        mmap_input in(argv[index]);
+        auto root = Calc::parse_chunked(in.begin(), in.end(), argv[index],
+                                        opts.file_threads());
+        if (!root) {
+            err << "Parse fail." << std::endl;
+            return 1;
+        }
+        err << "Parse successful." << std::endl;
+        auto suffix = opts.dot_suffix(index);
+        root->set_kind<Calc::Node::root>({nullptr});
+        // The workers of a coordinator all run in the same directory, and
+        // would write over each other's dot files, so they write none.
+        if (!opts.shard) {
+            std::ofstream os("calc-parse" + suffix + ".dot");
+            parse_tree::print_dot(os, *root);
+        }
+        {
+            Calc::compiler_context context(err);
+            auto parent = root->get_kind<Calc::Node::root>();
+            Calc::semantic_analysis sem(context, *root, *parent,
+                                        opts.file_threads());
+            Calc::traversal trav(sem, Calc::node_visitor::PRE_VISIT |
+                                      Calc::node_visitor::POST_VISIT);
+            trav.traverse(*root);
+        }
+
+        Calc::pass_manager passes;
+        Calc::frame_allocator frames;
+        add_passes(passes, frames, err);
+        passes.run(*root);
+        if (opts.time_passes) {
+            passes.report(err);
+        }
+
+        if (!opts.shard) {
+            print_dot("calc-ast" + suffix + ".dot", *root);
+        }
+        if (!opts.batch.empty()) {
+            return run_batch(opts, *root, frames.size(), out, err);
+        }
+        Calc::evaluator eval(frames.size(), err);
+        std::unique_ptr<Calc::thread_pool> pool;
+        if (opts.file_threads() > 1u) {
+            pool = std::make_unique<Calc::thread_pool>(opts.file_threads());
+            eval.pool(pool.get());
+        }
+        eval.fork_limit(opts.fork_depth);
+        Calc::parallel_evaluator parallel(eval);
+        if (opts.reactive) {
+            std::unique_ptr<Calc::reactive> sheet;
+            try {
+                sheet = std::make_unique<Calc::reactive>(*root, eval);
+            } catch (const std::runtime_error &e) {
+                err << "Reactive error: " << e.what() << std::endl;
+                return 6;
+            }
+            sheet->run(err);
+            sheet->serve(std::cin, "<stdin>", err, err);
+            cbi::CheckPoint stats("stats");
+            if (stats.active()) {
+                sheet->report(out);
+            }
+        } else if (opts.tenants) {
+            if (run_tenants(opts, *root, frames.size(), err)) {
+                return 5;
+            }
+        } else if (opts.cost) {
+            measure(eval, *root, err);
+        } else {
+            parallel.run(*root);
+        }
+
+        cbi::CheckPoint stats("stats");
+        if (stats.active()) {
+            frames.report(out);
+            parallel.report(out);
+            out << "Dispatches: " << eval.dispatches() << std::endl;
+        }
+    } catch (const std::exception &e) {
+        err << "Parse error: " << e.what() << std::endl;
+        return 5;
+    }
+    return 0;
+}
+
+/// Compile and run several files at once, printing the output of each in
+/// the order given.  As when they are run one at a time, nothing is
+/// printed for the files after one which fails.
+static int run_files(const options &opts, char *argv[])
+{
+    struct buffers
+    {
+        std::ostringstream out;
+        std::ostringstream err;
+    };
+    auto count = opts.files.size();
+    std::vector<buffers> output(count);
+    std::vector<std::future<int>> results;
+
+    // Files after the first failure needn't be run.
+    std::atomic<std::size_t> failed{std::numeric_limits<std::size_t>::max()};
+
+    Calc::thread_pool pool(std::min(opts.jobs, count));
+    for (auto i = 0u; i < count; ++i) {
+        results.push_back(pool.async([&, i]
+            {
+                if (i > failed) {
+                    return 0;
+                }
+                auto code = run_file(opts, opts.files[i], argv,
+                                     output[i].out, output[i].err);
+                if (code != 0) {
+                    auto first = failed.load();
+                    while (i < first &&
+                           !failed.compare_exchange_weak(first, i)) {
+                    }
+                }
+                return code;
+            }));
+    }
+    for (auto i = 0u; i < count; ++i) {
+        auto code = results[i].get();
+        std::cout << output[i].out.str() << std::flush;
+        std::cerr << output[i].err.str() << std::flush;
+        if (code != 0) {
+            return code;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    print_stats();
+
+    const char *usage =
+        "usage: calc [--time-passes] [--cost] [--jobs N] [--fork-depth N] "
+        "[--tenants N]\n"
+        "            [--stack-size KiB] [--reactive]\n"
+        "            [--batch input.csv [--results var,...] [--scalar] "
+        "[--chunk-size N]\n"
+        "                                  [--range name:low:high]... "
+        "[--wide]\n"
+        "                                  [--output results.cols]\n"
+        "                                  [--aggregate spec]... [--no-rows]\n"
+        "                                  [--shards N [--workers N] "
+        "[--retries N]\n"
+        "                                   [--launcher command]]]\n"
+        "            <statements>...\n"
+        "       calc --convert from to, (from CSV to a column file, or back)\n";
+    options opts;
+    for (auto i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--time-passes") {
+            opts.time_passes = true;
+        } else if (arg == "--cost") {
+            opts.cost = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            opts.jobs = std::strtoul(argv[++i], nullptr, 10);
+            opts.forward(argv, i, 2);
+        } else if (arg == "--fork-depth" && i + 1 < argc) {
+            opts.fork_depth = std::strtoul(argv[++i], nullptr, 10);
+            opts.forward(argv, i, 2);
+        } else if (arg == "--tenants" && i + 1 < argc) {
+            opts.tenants = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--stack-size" && i + 1 < argc) {
+            opts.stack_size = std::strtoul(argv[++i], nullptr, 10) << 10;
+        } else if (arg == "--batch" && i + 1 < argc) {
+            opts.batch = argv[++i];
+        } else if (arg == "--results" && i + 1 < argc) {
+            std::istringstream names(argv[++i]);
+            opts.forward(argv, i, 2);
+            for (std::string name; std::getline(names, name, ','); ) {
+                opts.results.push_back(name);
+            }
+        } else if (arg == "--chunk-size" && i + 1 < argc) {
+            opts.chunk_size = std::strtoul(argv[++i], nullptr, 10);
+            opts.forward(argv, i, 2);
+        } else if (arg == "--output" && i + 1 < argc) {
+            opts.output = argv[++i];
+        } else if (arg == "--convert" && i + 2 < argc) {
+            opts.convert_from = argv[++i];
+            opts.convert_to = argv[++i];
+        } else if (arg == "--aggregate" && i + 1 < argc) {
+            opts.aggregates.push_back(argv[++i]);
+        } else if (arg == "--range" && i + 1 < argc) {
+            opts.ranges.push_back(argv[++i]);
+            opts.forward(argv, i, 2);
+        } else if (arg == "--wide") {
+            opts.wide = true;
+            opts.forward(argv, i, 1);
+        } else if (arg == "--no-rows") {
+            opts.rows = false;
+        } else if (arg == "--scalar") {
+            opts.scalar = true;
+            opts.forward(argv, i, 1);
+        } else if (arg == "--shards" && i + 1 < argc) {
+            opts.shards = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            opts.workers = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--retries" && i + 1 < argc) {
+            opts.retries = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--launcher" && i + 1 < argc) {
+            opts.launcher = argv[++i];
+        } else if (arg == "--shard" && i + 1 < argc) {
+            char *end = nullptr;
+            opts.shard = true;
+            opts.shard_first = std::strtoull(argv[++i], &end, 10);
+            opts.shard_last = *end == ',' ?
+                std::strtoull(end + 1, nullptr, 10) : 0u;
+        } else if (arg == "--reactive") {
+            opts.reactive = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Unknown option: " << arg << '\n' << usage;
+            return 1;
+        } else {
+            opts.files.push_back(i);
+        }
+    }
+    if (!opts.convert_from.empty()) {
+        return convert(opts);
+    }
+    if (opts.files.empty()) {
+        std::cerr << usage;
+        return 1;
+    }
+    if (opts.reactive && opts.files.size() > 1) {
+        std::cerr << "--reactive takes a single file\n" << usage;
+        return 1;
+    }
+    if (opts.shards) {
+        if (opts.batch.empty() || opts.files.size() != 1) {
+            std::cerr << "--shards takes --batch, and a single file\n"
+                      << usage;
+            return 1;
+        }
+        if (!opts.aggregates.empty() || !opts.rows) {
+            std::cerr << "--shards doesn't take --aggregate or --no-rows\n"
+                      << usage;
+            return 1;
+        }
+        return run_coordinator(opts, argv);
+    }
+    if (opts.files.size() == 1 || opts.jobs <= 1) {
+        for (auto i : opts.files) {
+            if (auto code = run_file(opts, i, argv, std::cout, std::cerr);
+                code != 0) {
+                return code;
+            }
+        }
+        return 0;
+    }
+    return run_files(opts, argv);
+}
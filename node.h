@@ -29,8 +29,10 @@
 #include "is_valid.h"
 
 #include <tao/pegtl/contrib/parse_tree.hpp>
+#include <atomic>
 #include <variant>
 #include <functional>
+#include <limits>
 
 namespace Calc::Node {
 struct node;
@@ -55,7 +57,15 @@ struct symbol_ref {
 };
 
 /// An operation of some kind.
-struct operation { };
+struct operation {
+    /// May the operands be evaluated at the same time?  (See fork_marker.)
+    bool fork_ = false;
+
+    /// The bits, (8 or 16), which every value in the operation, its
+    /// operands, and theirs, is known to fit in, so that it may be
+    /// vectorized in narrower lanes, or 0, (see value_range).
+    unsigned char narrow_ = 0u;
+};
 
 /// A statement of some kind.
 struct statement { };
@@ -66,6 +76,39 @@ struct symbol_name {
     void set_name(const std::string &name)       { name_ = name; }
 };
 
+/// A variable, (declared explicitly or not).
+struct variable_base : public symbol_name {
+    /// Where the value lives during evaluation, (see frame_allocator).
+    int slot_ = -1;
+
+    /// Where the value of a shared variable lives instead, (see
+    /// shared_store).
+    std::atomic<int> *cell_ = nullptr;
+
+    /// The number of elements of an array, which has that many slots from
+    /// slot_ on, (0 for other variables).
+    int length_ = 0;
+};
+
+/// A declaration, ("var x;" or "shared var x;").
+struct declaration_base : public statement {
+    bool shared_ = false;
+};
+
+/// How an assignment to a shared variable is made, (see atomic_marker).
+enum class atomic_form : unsigned char {
+    none,       ///< Not shared.
+    add,        ///< x := x + e, (or e + x), where e doesn't read x.
+    subtract,   ///< x := x - e, where e doesn't read x.
+    store,      ///< x := e, where e doesn't read x.
+    update      ///< Anything else, (compare and swap, until it sticks).
+};
+
+/// An assignment.
+struct assignment_base : public statement {
+    atomic_form atomic_ = atomic_form::none;
+};
+
 /// Exit statements may have an attached identifier. (To terminate an
 /// outer loop as well as an inner one.)
 struct exit_statement_base : public symbol_name { };
@@ -97,6 +140,11 @@ struct function_base : public parent
     Kind kind_;
     std::string name_;
 
+    /// The slots of a function which may recurse, which are saved around
+    /// each call to it, (see frame_allocator).
+    int frame_ = 0;
+    int frame_size_ = 0;
+
     Intrinsic get_intrinsic()
     {
         if (std::holds_alternative<Intrinsic>(kind_)) {
@@ -105,6 +153,12 @@ struct function_base : public parent
         return Intrinsic();
     }
 
+    bool is_intrinsic() const
+    {
+        return std::holds_alternative<Intrinsic>(kind_) &&
+               std::get<Intrinsic>(kind_);
+    }
+
     node *get_function()
     {
         if (std::holds_alternative<node*>(kind_)) {
@@ -117,6 +171,128 @@ struct function_base : public parent
 /// A function call base node kind
 struct function_call_base : public operation, public symbol_ref { };
 
+/// An assignment which adds a constant to a variable, (x := x + c).
+struct increment_base : public statement, public symbol_ref {
+    int value_ = 0;
+};
+
+/// The relation tested by a fused comparison.
+enum class relation : unsigned char {
+    equal_to, not_equal, less_than, less_or_equal, greater_than,
+    greater_or_equal
+};
+
+/// A comparison of a variable with either a constant, or another variable.
+struct compare_base {
+    relation op_ = relation::equal_to;
+    node *lhs_ = nullptr;   ///< The variable on the left.
+    node *rhs_ = nullptr;   ///< The variable on the right, or nullptr.
+    int value_ = 0;         ///< The constant on the right if rhs_ is nullptr.
+
+    bool test(int lhs, int rhs) const
+    {
+        switch (op_) {
+        case relation::equal_to:         return lhs == rhs;
+        case relation::not_equal:        return lhs != rhs;
+        case relation::less_than:        return lhs <  rhs;
+        case relation::less_or_equal:    return lhs <= rhs;
+        case relation::greater_than:     return lhs >  rhs;
+        case relation::greater_or_equal: return lhs >= rhs;
+        }
+        return false;
+    }
+
+    /// The relation to use if the operands are swapped.
+    static relation mirror(relation op)
+    {
+        switch (op) {
+        case relation::less_than:        return relation::greater_than;
+        case relation::less_or_equal:    return relation::greater_or_equal;
+        case relation::greater_than:     return relation::less_than;
+        case relation::greater_or_equal: return relation::less_or_equal;
+        default:                         return op;
+        }
+    }
+};
+
+/// A fused comparison, (v < c, or a < b).
+struct compare_operation : public operation, public compare_base { };
+
+/// An exit statement whose condition is a fused comparison.
+struct exit_compare_base : public exit_statement_base, public compare_base { };
+
+/// The ways in which the partial results of a parallel loop are combined.
+enum class reduction : unsigned char {
+    sum, min, max, logical_and, logical_or
+};
+
+/// A loop whose iterations may run at the same time, (loop parallel for).
+/// The children are the loop variable, its first and last values, the
+/// reduction variables, and the body.  The loop variable lives in the
+/// loop's own scope.
+struct parallel_loop_base : public parent, public statement
+{
+    /// How each reduction variable is combined, in order.
+    std::vector<reduction> reductions_;
+
+    /// The value which leaves a partial result unchanged.
+    static int identity(reduction r)
+    {
+        switch (r) {
+        case reduction::sum:         return 0;
+        case reduction::min:         return std::numeric_limits<int>::max();
+        case reduction::max:         return std::numeric_limits<int>::min();
+        case reduction::logical_and: return 1;
+        case reduction::logical_or:  return 0;
+        }
+        return 0;
+    }
+
+    /// Combine two partial results, (sums wrap around rather than
+    /// overflow, so that the order doesn't matter).
+    static int combine(reduction r, int lhs, int rhs)
+    {
+        switch (r) {
+        case reduction::sum:
+            return static_cast<int>(static_cast<unsigned>(lhs) +
+                                    static_cast<unsigned>(rhs));
+        case reduction::min:         return std::min(lhs, rhs);
+        case reduction::max:         return std::max(lhs, rhs);
+        case reduction::logical_and: return lhs && rhs;
+        case reduction::logical_or:  return lhs || rhs;
+        }
+        return rhs;
+    }
+};
+
+/// An element of an array, (a[i]).  The children are the array, and the
+/// index, (and the value, for an assignment).
+struct element_base {
+    /// Must the index be checked?  (Not if it is known to be in bounds,
+    /// see bounds_check.)
+    bool checked_ = true;
+};
+
+/// An assignment to an element of an array, (a[i] := e).
+struct element_assignment_base : public statement, public element_base { };
+
+/// The builtin functions on whole arrays.
+enum class array_op : unsigned char {
+    sum,        ///< sum(a), the sum of the elements.
+    min,        ///< min(a), the least element.
+    max,        ///< max(a), the greatest element.
+    dot,        ///< dot(a, b), the sum of the products of the elements.
+    fill,       ///< fill(a, v), set every element to v, giving v.
+    prefix_sum  ///< prefix_sum(a), each element becomes the sum of those up
+                ///< to it, giving the last.
+};
+
+/// A call of a builtin function on arrays.  The children are the array
+/// arguments, then the value for fill.
+struct array_builtin_base {
+    array_op op_ = array_op::sum;
+};
+
 /// Used as a sentinel to end the list of variants.
 struct error { };
 
@@ -167,11 +343,81 @@ struct node : public tao::pegtl::parse_tree::basic_node<node>
         return nullptr;
     }
 
+    template <typename U>
+    const U* get_kind() const noexcept
+    {
+        if (std::holds_alternative<U>(kind_)) {
+            return &std::get<U>(kind_);
+        }
+        return nullptr;
+    }
+
+    /// Get the scope holding part of the node, (for the root, compound
+    /// statements and functions), or nullptr for other node kinds.
+    parent* get_parent() noexcept
+    {
+        return std::visit([](auto &k) -> parent*
+            {
+                if constexpr (std::is_base_of_v<parent, std::decay_t<decltype(k)>>) {
+                    return &k;
+                }
+                return nullptr;
+            }, kind_);
+    }
+
+    const parent* get_parent() const noexcept
+    {
+        return const_cast<node *>(this)->get_parent();
+    }
+
+    /// Get the fused comparison part of the node, if any.
+    compare_base* get_compare() noexcept
+    {
+        return std::visit([](auto &k) -> compare_base*
+            {
+                if constexpr (std::is_base_of_v<compare_base, std::decay_t<decltype(k)>>) {
+                    return &k;
+                }
+                return nullptr;
+            }, kind_);
+    }
+
+    const compare_base* get_compare() const noexcept
+    {
+        return const_cast<node *>(this)->get_compare();
+    }
+
+    /// Get the operation part of the node, if any.
+    operation* get_operation() noexcept
+    {
+        return std::visit([](auto &k) -> operation*
+            {
+                if constexpr (std::is_base_of_v<operation, std::decay_t<decltype(k)>>) {
+                    return &k;
+                }
+                return nullptr;
+            }, kind_);
+    }
+
+    const operation* get_operation() const noexcept
+    {
+        return const_cast<node *>(this)->get_operation();
+    }
+
     node_kind kind_;
 };
 
 using Ptr = std::unique_ptr<node>;
 
+/// Does every path through the body of a function end with a return
+/// statement?  (If not, the function gives whatever value was evaluated
+/// last, which depends on how it was evaluated.)
+inline bool returns(const node &body)
+{
+    return !body.children.empty() &&
+           body.children.back()->get_kind<return_statement>();
+}
+
 } // namespace Calc
 
 #endif // NODE_H_INCLUDED
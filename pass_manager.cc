@@ -0,0 +1,124 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "pass_manager.h"
+
+#include <iomanip>
+
+namespace Calc {
+
+void
+pass_manager::add(const std::string &name, pass_kind kind, pass_function f)
+{
+    if (!in_group_) {
+        groups_.emplace_back();
+    }
+    groups_.back().passes_.push_back(stats_.size());
+    statistics s;
+    s.name_ = name;
+    s.kind_ = kind;
+    stats_.push_back(s);
+    functions_.push_back(std::move(f));
+}
+
+void
+pass_manager::add_analysis(const std::string &name, pass_function f)
+{
+    add(name, pass_kind::analysis, std::move(f));
+}
+
+void
+pass_manager::add_transform(const std::string &name, pass_function f)
+{
+    add(name, pass_kind::transform, std::move(f));
+}
+
+void
+pass_manager::begin_fixed_point(std::size_t max_iterations)
+{
+    groups_.emplace_back();
+    groups_.back().max_iterations_ = max_iterations;
+    in_group_ = true;
+}
+
+void
+pass_manager::end_fixed_point()
+{
+    in_group_ = false;
+}
+
+std::size_t
+pass_manager::run_pass(std::size_t index, Node::node &root)
+{
+    auto &s = stats_[index];
+    auto start = std::chrono::steady_clock::now();
+    auto r = functions_[index](root);
+    s.time_ += std::chrono::steady_clock::now() - start;
+    ++s.runs_;
+    s.visited_ += r.visited_;
+    s.changed_ += r.changed_;
+    return r.changed_;
+}
+
+void
+pass_manager::run(Node::node &root)
+{
+    for (auto &g : groups_) {
+        for (auto i = 0u; i < g.max_iterations_; ++i) {
+            std::size_t changed = 0u;
+            for (auto index : g.passes_) {
+                changed += run_pass(index, root);
+            }
+            if (changed == 0u) {
+                break;
+            }
+        }
+    }
+}
+
+void
+pass_manager::report(std::ostream &os) const
+{
+    using std::setw;
+    using us = std::chrono::microseconds;
+
+    os << std::left << setw(16) << "Pass" << setw(10) << "Kind"
+       << std::right << setw(6) << "Runs" << setw(12) << "Time (us)"
+       << setw(10) << "Visited" << setw(10) << "Changed" << '\n';
+    duration total{};
+    for (auto &s : stats_) {
+        os << std::left << setw(16) << s.name_
+           << setw(10) << (s.kind_ == pass_kind::analysis ? "analysis"
+                                                          : "transform")
+           << std::right << setw(6) << s.runs_
+           << setw(12) << std::chrono::duration_cast<us>(s.time_).count()
+           << setw(10) << s.visited_ << setw(10) << s.changed_ << '\n';
+        total += s.time_;
+    }
+    os << std::left << setw(32) << "Total" << std::right << setw(12)
+       << std::chrono::duration_cast<us>(total).count() << '\n';
+}
+
+} // namespace Calc
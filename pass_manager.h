@@ -0,0 +1,138 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef PASS_MANAGER_H_INCLUDED
+#define PASS_MANAGER_H_INCLUDED
+
+#include "node.h"
+#include "traversal.h"
+#include "visitor.h"
+
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Calc {
+
+/// Run analysis and transform passes over an analyzed tree, in the order
+/// they were added, and keep statistics for each.  Transforms added between
+/// begin_fixed_point() and end_fixed_point() are run as a group, which is
+/// repeated until none of them changes anything, (or a limit is reached).
+class pass_manager
+{
+public:
+    enum class pass_kind { analysis, transform };
+
+    /// What a single run of a pass did.
+    struct result
+    {
+        std::size_t visited_ = 0u;          ///< Nodes looked at.
+        std::size_t changed_ = 0u;          ///< Nodes changed, (or removed).
+    };
+
+    using pass_function = std::function<result(Node::node &)>;
+    using duration = std::chrono::steady_clock::duration;
+
+    /// Statistics for one pass, over all of its runs.
+    struct statistics
+    {
+        std::string name_;
+        pass_kind   kind_ = pass_kind::transform;
+        std::size_t runs_ = 0u;
+        std::size_t visited_ = 0u;
+        std::size_t changed_ = 0u;
+        duration    time_{};
+    };
+
+    pass_manager() = default;
+    pass_manager(const pass_manager &) = delete;
+    pass_manager(pass_manager &&) = default;
+    ~pass_manager() = default;
+
+    pass_manager& operator=(const pass_manager &) = delete;
+    pass_manager& operator=(pass_manager &&) = default;
+
+    /// Add a pass which looks at the tree but doesn't change it.
+    void add_analysis(const std::string &name, pass_function f);
+
+    /// Add a pass which changes the tree.
+    void add_transform(const std::string &name, pass_function f);
+
+    /// Start a group of transforms to be run to a fixed point.
+    void begin_fixed_point(std::size_t max_iterations = 8u);
+
+    /// End the current group.
+    void end_fixed_point();
+
+    /// Run all the passes.
+    void run(Node::node &root);
+
+    /// The statistics for each pass, in the order added.
+    const auto& passes() const              { return stats_; }
+
+    /// Print the statistics for each pass.
+    void report(std::ostream &os) const;
+
+    /// Make a pass which runs a visitor over the tree.
+    /// @param mode PRE_VISIT and/or POST_VISIT.
+    /// @param changed Given the visitor afterwards, returns the number of
+    /// nodes it changed.
+    template <typename Visitor, typename Changed>
+    static pass_function visit(int mode, Changed changed)
+    {
+        return [mode, changed](Node::node &root)
+            {
+                Visitor v;
+                traversal trav(v, mode);
+                trav.traverse(root);
+                return result{v.dispatches(), changed(v)};
+            };
+    }
+
+private:
+    /// Passes run together, (once, or to a fixed point).
+    struct group
+    {
+        std::vector<std::size_t> passes_;
+        std::size_t              max_iterations_ = 1u;
+    };
+
+    void add(const std::string &name, pass_kind kind, pass_function f);
+
+    /// Run a pass once, recording its statistics.
+    /// @return The number of nodes changed.
+    std::size_t run_pass(std::size_t index, Node::node &root);
+
+    std::vector<statistics>     stats_;
+    std::vector<pass_function>  functions_;
+    std::vector<group>          groups_;
+    bool                        in_group_{false};
+};
+
+} // namespace Calc
+
+#endif // PASS_MANAGER_H_INCLUDED
@@ -0,0 +1,167 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "peephole.h"
+
+#include <climits>
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+node*
+variable_of(const Ptr &n)
+{
+    auto ref = n->get_kind<variable_ref>();
+    return ref ? ref->symbol_ : nullptr;
+}
+
+} // namespace
+
+void
+peephole::fuse_compare(node &n, relation op)
+{
+    compare c;
+    auto lhs = n.children[0].get();
+    auto rhs = n.children[1].get();
+    if (!lhs->get_kind<variable_ref>()) {
+        // Try it the other way around, (c < v  =>  v > c).
+        std::swap(lhs, rhs);
+        op = compare_base::mirror(op);
+    }
+    auto lvar = lhs->get_kind<variable_ref>();
+    if (!lvar) {
+        return;
+    }
+    c.op_ = op;
+    c.lhs_ = lvar->symbol_;
+    if (auto rvar = rhs->get_kind<variable_ref>(); rvar) {
+        c.rhs_ = rvar->symbol_;
+    } else if (auto num = rhs->get_kind<number>(); num) {
+        c.value_ = num->value_;
+    } else {
+        return;
+    }
+    n.children.clear();
+    n.set_kind(std::move(c));
+    n.set_type<compare>();
+    ++rewritten_;
+}
+
+void
+peephole::post_visit(node &n, equal_to &)
+{
+    fuse_compare(n, relation::equal_to);
+}
+
+void
+peephole::post_visit(node &n, not_equal &)
+{
+    fuse_compare(n, relation::not_equal);
+}
+
+void
+peephole::post_visit(node &n, less_than &)
+{
+    fuse_compare(n, relation::less_than);
+}
+
+void
+peephole::post_visit(node &n, less_or_equal &)
+{
+    fuse_compare(n, relation::less_or_equal);
+}
+
+void
+peephole::post_visit(node &n, greater_than &)
+{
+    fuse_compare(n, relation::greater_than);
+}
+
+void
+peephole::post_visit(node &n, greater_or_equal &)
+{
+    fuse_compare(n, relation::greater_or_equal);
+}
+
+void
+peephole::post_visit(node &n, exit_statement &es)
+{
+    if (n.children.size() != 1) {
+        return;
+    }
+    auto c = n.children[0]->get_kind<compare>();
+    if (!c) {
+        return;
+    }
+    exit_on_compare e;
+    static_cast<compare_base &>(e) = *c;
+    e.name_ = es.name_;
+    n.children.clear();
+    n.set_kind(std::move(e));
+    n.set_type<exit_on_compare>();
+    ++rewritten_;
+}
+
+void
+peephole::post_visit(node &n, assignment_statement &)
+{
+    auto target = variable_of(n.children[0]);
+    auto &expr = n.children[1];
+    if (expr->children.size() != 2) {
+        return;
+    }
+    auto &lhs = expr->children[0];
+    auto &rhs = expr->children[1];
+    int value;
+    if (expr->get_kind<addition>()) {
+        if (variable_of(lhs) == target && rhs->get_kind<number>()) {
+            value = rhs->get_kind<number>()->value_;
+        } else if (variable_of(rhs) == target && lhs->get_kind<number>()) {
+            value = lhs->get_kind<number>()->value_;
+        } else {
+            return;
+        }
+    } else if (expr->get_kind<subtraction>()) {
+        auto num = rhs->get_kind<number>();
+        if (variable_of(lhs) != target || !num || num->value_ == INT_MIN) {
+            return;
+        }
+        value = -num->value_;
+    } else {
+        return;
+    }
+    increment inc;
+    inc.symbol_ = target;
+    inc.value_ = value;
+    n.children.clear();
+    n.set_kind(std::move(inc));
+    n.set_type<increment>();
+    ++rewritten_;
+}
+
+} // namespace Calc
@@ -0,0 +1,73 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef PEEPHOLE_H_INCLUDED
+#define PEEPHOLE_H_INCLUDED
+
+#include "node.h"
+#include "visitor.h"
+
+namespace Calc {
+
+/// Rewrite common statement and expression shapes into fused node kinds
+/// which the evaluator handles in a single dispatch:
+///   x := x + c, x := c + x, x := x - c     =>  increment
+///   v < c, c < v, a < b, (and the other relations)  =>  compare
+///   exit if (compare)                      =>  exit_on_compare
+/// Must run on the analyzed tree, (after semantic analysis), with a
+/// POST_VISIT traversal so comparisons are fused before the exit
+/// statements which use them.
+class peephole : public node_visitor
+{
+public:
+    peephole() = default;
+    peephole(const peephole &) = delete;
+    peephole(peephole &&) = default;
+    ~peephole() = default;
+
+    peephole& operator=(const peephole &) = delete;
+    peephole& operator=(peephole &&) = default;
+
+    void post_visit(Node::node &, Node::assignment_statement &) override;
+    void post_visit(Node::node &, Node::exit_statement &) override;
+    void post_visit(Node::node &, Node::equal_to &) override;
+    void post_visit(Node::node &, Node::not_equal &) override;
+    void post_visit(Node::node &, Node::less_than &) override;
+    void post_visit(Node::node &, Node::less_or_equal &) override;
+    void post_visit(Node::node &, Node::greater_than &) override;
+    void post_visit(Node::node &, Node::greater_or_equal &) override;
+
+    /// The number of nodes rewritten so far.
+    auto rewritten() const                  { return rewritten_; }
+
+private:
+    void fuse_compare(Node::node &n, Node::relation op);
+
+    std::size_t rewritten_{0u};
+};
+
+} // namespace Calc
+
+#endif // PEEPHOLE_H_INCLUDED
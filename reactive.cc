@@ -0,0 +1,266 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "reactive.h"
+#include "csv.h"
+#include "evaluator.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+reactive::reactive(node &root, evaluator &eval) :
+    root_(root), eval_(eval), initial_(eval.frame_size(), 0)
+{
+    // A shared variable lives in its cell, not in a slot, so its changes
+    // couldn't be seen, and re-evaluating an atomic update would apply it
+    // twice.  (They may only be declared at the top level.)
+    if (auto r = root_.get_kind<Node::root>(); r && r->scope_) {
+        for (auto &child : r->scope_->children) {
+            auto v = child->get_kind<variable>();
+            if (v && v->cell_) {
+                throw std::runtime_error("Shared variable '" + v->name_ +
+                                         "' cannot be used reactively.");
+            }
+        }
+    }
+    graph_.run(root_);
+    auto &stmts = graph_.statements();
+    for (auto i = 0u; i < stmts.size(); ++i) {
+        auto &stmt = stmts[i];
+        std::vector<std::size_t> used;
+        std::set_union(stmt.reads_.begin(), stmt.reads_.end(),
+                       stmt.writes_.begin(), stmt.writes_.end(),
+                       std::back_inserter(used));
+        for (auto s : used) {
+            users_[s].push_back(i);
+        }
+        for (auto s : stmt.writes_) {
+            writers_[s].push_back(i);
+        }
+    }
+    after_.resize(stmts.size());
+    output_.resize(stmts.size());
+}
+
+int
+reactive::before(std::size_t stmt, std::size_t slot) const
+{
+    auto found = writers_.find(slot);
+    if (found == writers_.end()) {
+        return initial_[slot];
+    }
+    auto &writers = found->second;
+    auto pos = std::lower_bound(writers.begin(), writers.end(), stmt);
+    if (pos == writers.begin()) {
+        return initial_[slot];
+    }
+    auto writer = *(pos - 1);
+    auto &writes = graph_.statements()[writer].writes_;
+    auto index = std::lower_bound(writes.begin(), writes.end(), slot) -
+                 writes.begin();
+    return after_[writer][index];
+}
+
+void
+reactive::changed(std::size_t stmt, std::size_t slot)
+{
+    auto found = users_.find(slot);
+    if (found == users_.end()) {
+        return;
+    }
+    auto &users = found->second;
+    auto pos = stmt == none ? users.begin()
+                            : std::upper_bound(users.begin(), users.end(),
+                                               stmt);
+    // The first statement after this one to write the slot hides the
+    // change from those after it, (unless what it leaves changes too).
+    auto &writers = writers_[slot];
+    for (; pos != users.end(); ++pos) {
+        dirty_.insert(*pos);
+        if (std::binary_search(writers.begin(), writers.end(), *pos)) {
+            break;
+        }
+    }
+}
+
+std::string
+reactive::evaluate(std::size_t stmt)
+{
+    auto &s = graph_.statements()[stmt];
+    for (auto slot : s.reads_) {
+        eval_.slot(slot) = before(stmt, slot);
+    }
+    // A write may not happen, so the old value must be there.
+    for (auto slot : s.writes_) {
+        eval_.slot(slot) = before(stmt, slot);
+    }
+    std::ostringstream out;
+    auto &saved = eval_.output();
+    eval_.output(out);
+    ++evaluated_;
+    try {
+        eval_.accept(*root_.children[stmt]);
+    } catch (...) {
+        eval_.output(saved);
+        throw;
+    }
+    eval_.output(saved);
+    return out.str();
+}
+
+void
+reactive::record(std::size_t stmt, std::string output, std::ostream &out,
+                 bool initial)
+{
+    auto &writes = graph_.statements()[stmt].writes_;
+    auto &after = after_[stmt];
+    after.resize(writes.size());
+    for (auto i = 0u; i < writes.size(); ++i) {
+        auto value = eval_.slot(writes[i]);
+        if (!initial && value != after[i]) {
+            changed(stmt, writes[i]);
+        }
+        after[i] = value;
+    }
+    if (initial || output != output_[stmt]) {
+        out << output;
+        output_[stmt] = std::move(output);
+    }
+}
+
+void
+reactive::run(std::ostream &out)
+{
+    dirty_.clear();
+    for (auto i = 0u; i < root_.children.size(); ++i) {
+        record(i, evaluate(i), out, true);
+    }
+}
+
+void
+reactive::set(std::string_view name, int value)
+{
+    auto r = root_.get_kind<root>();
+    node *var = nullptr;
+    if (r && r->scope_) {
+        for (auto &child : r->scope_->children) {
+            auto v = child->get_kind<variable>();
+            if (v && v->name_ == name) {
+                var = child.get();
+            }
+        }
+    }
+    if (!var) {
+        throw std::runtime_error("No top-level variable '" +
+                                 std::string(name) + "' to set.");
+    }
+    auto v = var->get_kind<variable>();
+    const char *why = nullptr;
+    if (v->cell_) {
+        why = "is shared";
+    } else if (v->length_) {
+        why = "is an array";
+    } else if (v->slot_ < 0) {
+        why = "has no slot, (see frame_allocator)";
+    }
+    if (why) {
+        throw std::runtime_error("'" + std::string(name) + "' " + why +
+                                 ", and cannot be set.");
+    }
+    ++updates_;
+    auto slot = static_cast<std::size_t>(v->slot_);
+    if (initial_[slot] != value) {
+        initial_[slot] = value;
+        changed(none, slot);
+    }
+}
+
+std::size_t
+reactive::recompute(std::ostream &out)
+{
+    std::size_t count = 0u;
+    while (!dirty_.empty()) {
+        auto stmt = *dirty_.begin();
+        auto output = evaluate(stmt);
+        dirty_.erase(dirty_.begin());
+        record(stmt, std::move(output), out, false);
+        ++count;
+    }
+    return count;
+}
+
+void
+reactive::serve(std::istream &in, const std::string &source,
+                std::ostream &out, std::ostream &err)
+{
+    std::string line;
+    std::vector<std::string_view> fields;
+    for (std::size_t number = 1u; std::getline(in, line); ++number) {
+        if (csv::trim(line).empty()) {
+            continue;
+        }
+        csv::split(line, fields);
+        std::vector<std::pair<std::string_view, int>> inputs;
+        for (auto field : fields) {
+            auto eq = field.find('=');
+            int value = 0;
+            if (eq == std::string_view::npos ||
+                csv::trim(field.substr(0, eq)).empty() ||
+                !csv::to_int(csv::trim(field.substr(eq + 1)), value)) {
+                inputs.clear();
+                err << source << ": " << number << ": Expected "
+                    << "'name = value', found '" << csv::trim(field) << "'."
+                    << std::endl;
+                break;
+            }
+            inputs.emplace_back(csv::trim(field.substr(0, eq)), value);
+        }
+        try {
+            for (auto &[name, value] : inputs) {
+                set(name, value);
+            }
+            recompute(out);
+        } catch (const std::runtime_error &e) {
+            err << source << ": " << number << ": Update error: "
+                << e.what() << std::endl;
+        }
+        out << std::flush;
+    }
+}
+
+void
+reactive::report(std::ostream &os) const
+{
+    os << "Reactive: " << updates_ << " inputs set, " << evaluated_
+       << " statements evaluated, (" << root_.children.size()
+       << " in the script)" << std::endl;
+}
+
+} // namespace Calc
@@ -0,0 +1,146 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef REACTIVE_H_INCLUDED
+#define REACTIVE_H_INCLUDED
+
+#include "node.h"
+#include "dataflow.h"
+
+#include <istream>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Calc {
+
+class evaluator;
+
+/// Keep a compiled script up to date as its inputs change, like a
+/// spreadsheet.  The inputs are the initial values of its top-level
+/// variables, (as the columns of a batch are).  After the script has been
+/// evaluated once, setting an input re-evaluates only the top-level
+/// statements which may see the change, in order, and prints only the
+/// output of those whose output changed.
+///
+/// The dependences come from statement_graph.  The value each statement
+/// leaves in each shared slot it writes is kept, so that a statement can
+/// be re-evaluated on its own, with the values it saw, (those left by the
+/// statements before it).  A change is passed on only when a statement
+/// leaves a different value, so the work done for an update is that of the
+/// statements affected, not of the whole script.  Scripts which declare
+/// shared variables, (see shared_store), are refused, since their values
+/// aren't kept in the slots.
+class reactive
+{
+public:
+    /// @param root An analyzed tree, with its slots allocated.
+    /// @param eval What to evaluate the statements with.
+    /// Throws std::runtime_error if the script declares a shared variable.
+    reactive(Node::node &root, evaluator &eval);
+    reactive(const reactive &) = delete;
+    reactive(reactive &&) = delete;
+    ~reactive() = default;
+
+    reactive& operator=(const reactive &) = delete;
+    reactive& operator=(reactive &&) = delete;
+
+    /// Evaluate every statement, printing the results.
+    void run(std::ostream &out);
+
+    /// Give a top-level variable a new initial value.  Nothing is
+    /// re-evaluated until recompute().
+    /// Throws std::runtime_error if it isn't a top-level variable, (or is an
+    /// array, or shared, or has no slot).
+    void set(std::string_view name, int value);
+
+    /// Re-evaluate the statements affected by the inputs set since the
+    /// last time, printing the output of those whose output changed.  If a
+    /// statement fails, those left are re-evaluated by the next call.
+    /// @return The number of statements re-evaluated.
+    std::size_t recompute(std::ostream &out);
+
+    /// Read updates, one per line, ("x = 5" or "x = 5, y = -2"), applying
+    /// each and recomputing, until the end of the input.  A malformed line,
+    /// or a statement which fails, is reported to err, and the rest are
+    /// still read.
+    /// @param source The name of the input, for error messages.
+    void serve(std::istream &in, const std::string &source,
+               std::ostream &out, std::ostream &err);
+
+    /// Print the number of updates, and the statements re-evaluated.
+    void report(std::ostream &os) const;
+
+private:
+    /// The value in a shared slot as the statement sees it, (left by the
+    /// last statement before it to write it, or the initial value).
+    int before(std::size_t stmt, std::size_t slot) const;
+
+    /// Mark the statements which see a change to a slot made by a
+    /// statement, (or by an input, if stmt is none).
+    void changed(std::size_t stmt, std::size_t slot);
+
+    /// Evaluate one statement with the values it sees.
+    /// @return Its output.
+    std::string evaluate(std::size_t stmt);
+
+    /// Keep what a statement left, and mark the statements which see its
+    /// changes, (unless this is the first evaluation, when nothing has
+    /// changed, and all of the output is printed).
+    void record(std::size_t stmt, std::string output, std::ostream &out,
+                bool initial);
+
+    static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+    Node::node      &root_;
+    evaluator       &eval_;
+    statement_graph graph_;
+
+    /// The initial value of each slot.
+    std::vector<int>                           initial_;
+
+    /// The value each statement left in each slot it writes, (in the order
+    /// of statement_graph::statement::writes_), and what it printed.
+    std::vector<std::vector<int>>              after_;
+    std::vector<std::string>                   output_;
+
+    /// The statements which write each shared slot, and those which may
+    /// see it, (read or write it), in order.
+    std::map<std::size_t, std::vector<std::size_t>> writers_;
+    std::map<std::size_t, std::vector<std::size_t>> users_;
+
+    /// The statements waiting to be re-evaluated.
+    std::set<std::size_t>                      dirty_;
+
+    std::size_t updates_{0u};
+    std::size_t evaluated_{0u};
+};
+
+} // namespace Calc
+
+#endif // REACTIVE_H_INCLUDED
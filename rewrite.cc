@@ -0,0 +1,207 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "rewrite.h"
+
+#include <climits>
+
+namespace Calc::rewrite {
+
+using namespace Node;
+
+pattern
+any(std::size_t slot)
+{
+    return [slot](node &n, bindings &b)
+        {
+            b.nodes_[slot] = &n;
+            return true;
+        };
+}
+
+pattern
+var(std::size_t slot)
+{
+    return [slot](node &n, bindings &b)
+        {
+            auto ref = n.get_kind<variable_ref>();
+            if (!ref) {
+                return false;
+            }
+            if (auto prev = b.nodes_[slot]; prev) {
+                return prev->get_kind<variable_ref>()->symbol_ == ref->symbol_;
+            }
+            b.nodes_[slot] = &n;
+            return true;
+        };
+}
+
+pattern
+constant(std::size_t slot)
+{
+    return [slot](node &n, bindings &b)
+        {
+            auto num = n.get_kind<number>();
+            if (!num) {
+                return false;
+            }
+            b.nodes_[slot] = &n;
+            b.values_[slot] = num->value_;
+            return true;
+        };
+}
+
+pattern
+literal(int value)
+{
+    return [value](node &n, bindings &)
+        {
+            auto num = n.get_kind<number>();
+            return num && num->value_ == value;
+        };
+}
+
+void
+locate(node &n, const bindings &b)
+{
+    n.source = b.origin_->source;
+    n.m_begin = b.origin_->m_begin;
+    n.m_end = b.origin_->m_end;
+}
+
+builder
+bound(std::size_t slot)
+{
+    // Each slot may only be used once in a replacement, since the sub-tree
+    // is moved, not copied.
+    return [slot](bindings &b)
+        {
+            return std::make_unique<node>(std::move(*b.nodes_[slot]));
+        };
+}
+
+builder
+value(int v)
+{
+    return value([v](const bindings &) { return v; });
+}
+
+builder
+value(std::function<int(const bindings &)> f)
+{
+    return [f](bindings &b)
+        {
+            auto n = std::make_unique<node>();
+            n->set_kind(number{f(b)});
+            n->set_type<number>();
+            locate(*n, b);
+            return n;
+        };
+}
+
+rewriter::rewriter(std::vector<rule> rules) :
+    rules_(std::move(rules)),
+    applied_(rules_.size())
+{
+}
+
+bool
+rewriter::apply(node &n)
+{
+    for (auto i = 0u; i < rules_.size(); ++i) {
+        auto &r = rules_[i];
+        bindings b;
+        b.origin_ = &n;
+        if (!r.match_(n, b) || (r.when_ && !r.when_(b))) {
+            continue;
+        }
+        auto replacement = r.replace_(b);
+        n = std::move(*replacement);
+        ++applied_[i];
+        ++rewritten_;
+        return true;
+    }
+    return false;
+}
+
+void
+rewriter::rewrite(node &n)
+{
+    for (auto &child : n.children) {
+        rewrite(*child);
+    }
+    ++visited_;
+
+    // Each rewrite makes the tree smaller, or leaves a constant in place of
+    // an operation, but guard against rules which undo each other.
+    for (auto i = 0u; i < 8u && apply(n); ++i) {
+    }
+}
+
+std::size_t
+rewriter::run(node &root)
+{
+    auto before = rewritten_;
+    rewrite(root);
+    return rewritten_ - before;
+}
+
+std::vector<rule>
+algebraic_rules()
+{
+    // Only variables and constants may be discarded, anything else might
+    // have side effects, or fail.
+    return {
+        {"e + 0", op<addition>(any(0), literal(0)), bound(0), nullptr},
+        {"0 + e", op<addition>(literal(0), any(0)), bound(0), nullptr},
+        {"e - 0", op<subtraction>(any(0), literal(0)), bound(0), nullptr},
+        {"e * 1", op<multiplication>(any(0), literal(1)), bound(0), nullptr},
+        {"1 * e", op<multiplication>(literal(1), any(0)), bound(0), nullptr},
+        {"e / 1", op<division>(any(0), literal(1)), bound(0), nullptr},
+        {"x * 0", op<multiplication>(var(0), literal(0)), value(0), nullptr},
+        {"0 * x", op<multiplication>(literal(0), var(0)), value(0), nullptr},
+        {"x % 1", op<modulus>(var(0), literal(1)), value(0), nullptr},
+        {"x - x", op<subtraction>(var(0), var(0)), value(0), nullptr},
+        {"x = x", op<equal_to>(var(0), var(0)), value(1), nullptr},
+        {"x != x", op<not_equal>(var(0), var(0)), value(0), nullptr},
+        {"x < x", op<less_than>(var(0), var(0)), value(0), nullptr},
+        {"x > x", op<greater_than>(var(0), var(0)), value(0), nullptr},
+        {"x <= x", op<less_or_equal>(var(0), var(0)), value(1), nullptr},
+        {"x >= x", op<greater_or_equal>(var(0), var(0)), value(1), nullptr},
+        {"+e", op<unary_plus>(any(0)), bound(0), nullptr},
+        {"- -e", op<unary_minus>(op<unary_minus>(any(0))), bound(0), nullptr},
+        {"(e + c) + d",
+            op<addition>(op<addition>(any(0), constant(1)), constant(2)),
+            make<addition>(bound(0), value([](const bindings &b)
+                { return b.values_[1] + b.values_[2]; })),
+            [](const bindings &b)
+            {
+                auto sum = static_cast<long long>(b.values_[1]) + b.values_[2];
+                return sum >= INT_MIN && sum <= INT_MAX;
+            }},
+    };
+}
+
+} // namespace Calc::rewrite
@@ -0,0 +1,180 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef REWRITE_H_INCLUDED
+#define REWRITE_H_INCLUDED
+
+#include "node.h"
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// A small language for tree rewriting rules.  A rule is a pattern, which
+/// matches a sub-tree and binds parts of it to numbered slots, and a
+/// builder, which makes the replacement from what was bound.  For example:
+///
+///     rule{"x * 1", op<multiplication>(any(0), literal(1)), bound(0)}
+///
+/// replaces any expression multiplied by one with the expression itself.
+namespace Calc::rewrite {
+
+/// What a pattern matched.
+struct bindings
+{
+    static constexpr std::size_t slots = 4u;
+
+    std::array<Node::node *, slots> nodes_{};   ///< Sub-trees bound.
+    std::array<int, slots>          values_{};  ///< Constants bound.
+    Node::node                      *origin_ = nullptr; ///< Node replaced.
+};
+
+/// Match a node, binding parts of it.
+using pattern = std::function<bool(Node::node &, bindings &)>;
+
+/// Make a replacement from the parts bound.
+using builder = std::function<Node::Ptr(bindings &)>;
+
+/// Match any expression.
+pattern any(std::size_t slot);
+
+/// Match a variable reference.  If the slot is used more than once in a
+/// pattern, each use must refer to the same variable.
+pattern var(std::size_t slot);
+
+/// Match any constant.
+pattern constant(std::size_t slot);
+
+/// Match one particular constant.
+pattern literal(int value);
+
+/// Match an operation whose operands match.
+template <typename Kind, typename... Operands>
+pattern op(Operands... operands)
+{
+    std::array<pattern, sizeof...(Operands)> ops{operands...};
+    return [ops](Node::node &n, bindings &b)
+        {
+            if (!n.get_kind<Kind>() || n.children.size() != ops.size()) {
+                return false;
+            }
+            for (auto i = 0u; i < ops.size(); ++i) {
+                if (!ops[i](*n.children[i], b)) {
+                    return false;
+                }
+            }
+            return true;
+        };
+}
+
+/// The sub-tree bound to a slot.
+builder bound(std::size_t slot);
+
+/// A constant.
+builder value(int v);
+
+/// A constant computed from what was bound.
+builder value(std::function<int(const bindings &)> f);
+
+/// Give a node made by a builder the position of the node replaced.
+void locate(Node::node &n, const bindings &b);
+
+/// An operation of the given kind on the operands made.
+template <typename Kind, typename... Operands>
+builder make(Operands... operands)
+{
+    std::array<builder, sizeof...(Operands)> ops{operands...};
+    return [ops](bindings &b)
+        {
+            auto n = std::make_unique<Node::node>();
+            n->set_kind(Kind{});
+            n->set_type<Kind>();
+            locate(*n, b);
+            for (auto &op : ops) {
+                n->children.push_back(op(b));
+            }
+            return n;
+        };
+}
+
+/// A rewriting rule.
+struct rule
+{
+    std::string name_;
+    pattern     match_;
+    builder     replace_;
+
+    /// An extra condition on what was bound, (optional).
+    std::function<bool(const bindings &)> when_;
+};
+
+/// Apply rules to every node of a tree, bottom up.  Each node is rewritten
+/// until no rule matches it, so rules may build on each other.  Rules must
+/// not discard anything which could have side effects, or fail.
+class rewriter
+{
+public:
+    explicit rewriter(std::vector<rule> rules);
+    rewriter(const rewriter &) = delete;
+    rewriter(rewriter &&) = default;
+    ~rewriter() = default;
+
+    rewriter& operator=(const rewriter &) = delete;
+    rewriter& operator=(rewriter &&) = default;
+
+    /// Rewrite a tree.
+    /// @return The number of rewrites made.
+    std::size_t run(Node::node &root);
+
+    /// The number of nodes visited so far.
+    auto visited() const                    { return visited_; }
+
+    /// The number of rewrites made so far.
+    auto rewritten() const                  { return rewritten_; }
+
+    /// The number of times each rule was applied, (in the order given).
+    const auto& applied() const             { return applied_; }
+
+    const auto& rules() const               { return rules_; }
+
+private:
+    void rewrite(Node::node &n);
+
+    /// Apply the first rule which matches n.
+    bool apply(Node::node &n);
+
+    std::vector<rule>           rules_;
+    std::vector<std::size_t>    applied_;
+    std::size_t                 visited_{0u};
+    std::size_t                 rewritten_{0u};
+};
+
+/// Algebraic identities, (x + 0, x * 1, x - x and so on).
+std::vector<rule> algebraic_rules();
+
+} // namespace Calc::rewrite
+
+#endif // REWRITE_H_INCLUDED
@@ -0,0 +1,268 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <system_error>
+#include <thread>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace Calc {
+
+namespace {
+
+/// A fiber's stack, mapped with a guard page below it, (stacks grow down).
+class fiber_stack
+{
+public:
+    fiber_stack() = default;
+    fiber_stack(const fiber_stack &) = delete;
+    fiber_stack(fiber_stack &&) = delete;
+    ~fiber_stack()                          { release(); }
+
+    fiber_stack& operator=(const fiber_stack &) = delete;
+    fiber_stack& operator=(fiber_stack &&) = delete;
+
+    /// Map a stack of at least size bytes.
+    /// Throws std::system_error if it can't be mapped.
+    void allocate(std::size_t size)
+    {
+        release();
+        auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        size = (size + page - 1u) / page * page;
+        auto map = ::mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (map == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(),
+                                    "Cannot map a stack");
+        }
+        if (::mprotect(map, page, PROT_NONE) != 0) {
+            auto error = errno;
+            ::munmap(map, size + page);
+            throw std::system_error(error, std::generic_category(),
+                                    "Cannot protect a stack");
+        }
+        map_ = map;
+        mapped_ = size + page;
+        base_ = static_cast<char *>(map) + page;
+        size_ = size;
+    }
+
+    void release()
+    {
+        if (map_) {
+            ::munmap(map_, mapped_);
+            map_ = nullptr;
+        }
+    }
+
+    void       *base() const            { return base_; }
+    std::size_t size() const            { return size_; }
+
+private:
+    void       *map_ = nullptr;
+    std::size_t mapped_ = 0u;
+    void       *base_ = nullptr;        ///< Just above the guard page.
+    std::size_t size_ = 0u;
+};
+
+} // namespace
+
+struct scheduler::fiber
+{
+    job                     job_;
+    ucontext_t              context_;
+    fiber_stack             stack_;
+    bool                    done_ = false;
+    std::exception_ptr      error_;
+    clock::duration         latency_{};  ///< From run() to completion.
+};
+
+thread_local scheduler::fiber *scheduler::current_ = nullptr;
+thread_local ucontext_t       *scheduler::worker_context_ = nullptr;
+
+scheduler::scheduler(std::size_t threads, std::size_t stack_size) :
+    threads_(std::max<std::size_t>(threads, 1u)),
+    stack_size_(std::max(stack_size, min_stack_size))
+{
+}
+
+scheduler::~scheduler() = default;
+
+std::size_t
+scheduler::spawn(job j)
+{
+    auto f = std::make_unique<fiber>();
+    f->job_ = std::move(j);
+    fibers_.push_back(std::move(f));
+    return fibers_.size() - 1u;
+}
+
+void
+scheduler::start()
+{
+    auto f = current_;
+    try {
+        f->job_();
+    } catch (...) {
+        f->error_ = std::current_exception();
+    }
+    f->done_ = true;
+    // Never returns, since the worker never resumes a finished fiber.
+    swapcontext(&f->context_, worker_context_);
+}
+
+const void*
+scheduler::stack_floor()
+{
+    return current_ ? current_->stack_.base() : nullptr;
+}
+
+void
+scheduler::yield()
+{
+    if (auto f = current_; f) {
+        swapcontext(&f->context_, worker_context_);
+    }
+}
+
+void
+scheduler::work(std::vector<fiber *> jobs, std::size_t index)
+{
+    auto begin = clock::now();
+    auto &stats = stats_[index];
+    ucontext_t context;
+    worker_context_ = &context;
+    std::deque<fiber *> ready;
+    for (auto f : jobs) {
+        try {
+            f->stack_.allocate(stack_size_);
+        } catch (const std::system_error &) {
+            // Not started, but finished, like a job which threw.
+            f->error_ = std::current_exception();
+            f->done_ = true;
+            continue;
+        }
+        getcontext(&f->context_);
+        f->context_.uc_stack.ss_sp = f->stack_.base();
+        f->context_.uc_stack.ss_size = f->stack_.size();
+        f->context_.uc_link = nullptr;
+        makecontext(&f->context_, &scheduler::start, 0);
+        ready.push_back(f);
+    }
+    while (!ready.empty()) {
+        auto f = ready.front();
+        ready.pop_front();
+        current_ = f;
+        auto resumed = clock::now();
+        swapcontext(&context, &f->context_);
+        auto now = clock::now();
+        current_ = nullptr;
+        stats.running_ += now - resumed;
+        ++stats.slices_;
+        if (f->done_) {
+            f->latency_ = now - begin;
+            f->stack_.release();
+        } else {
+            ready.push_back(f);
+        }
+    }
+    worker_context_ = nullptr;
+    stats.busy_ = clock::now() - begin;
+}
+
+void
+scheduler::run()
+{
+    auto begin = clock::now();
+    std::vector<std::vector<fiber *>> shares(threads_);
+    for (auto i = 0u; i < fibers_.size(); ++i) {
+        shares[i % threads_].push_back(fibers_[i].get());
+    }
+    stats_.assign(threads_, worker_stats{});
+    std::vector<std::thread> workers;
+    for (auto i = 1u; i < threads_; ++i) {
+        workers.emplace_back([this, &shares, i] { work(shares[i], i); });
+    }
+    work(shares[0], 0u);
+    for (auto &w : workers) {
+        w.join();
+    }
+    elapsed_ = clock::now() - begin;
+}
+
+std::exception_ptr
+scheduler::error(std::size_t index) const
+{
+    return fibers_[index]->error_;
+}
+
+void
+scheduler::report(std::ostream &os) const
+{
+    using us = std::chrono::microseconds;
+    auto micros = [](clock::duration d)
+        {
+            return std::chrono::duration_cast<us>(d).count();
+        };
+
+    std::size_t slices = 0u;
+    clock::duration overhead{};
+    for (auto &s : stats_) {
+        slices += s.slices_;
+        overhead += s.busy_ - s.running_;
+    }
+    os << "Scheduler: " << fibers_.size() << " jobs on " << threads_
+       << " threads, " << slices << " slices in " << micros(elapsed_)
+       << " us, " << micros(overhead) << " us switching";
+    if (slices) {
+        os << ", (" << std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           overhead).count() / slices
+           << " ns per slice)";
+    }
+    os << '\n';
+
+    if (fibers_.empty()) {
+        return;
+    }
+    std::vector<clock::duration> latencies;
+    for (auto &f : fibers_) {
+        latencies.push_back(f->latency_);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&latencies, &micros](unsigned percent)
+        {
+            return micros(latencies[(latencies.size() - 1u) * percent / 100u]);
+        };
+    os << "Completion: p50 " << at(50) << " us, p90 " << at(90)
+       << " us, p99 " << at(99) << " us, max " << at(100) << " us\n";
+}
+
+} // namespace Calc
@@ -0,0 +1,127 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef SCHEDULER_H_INCLUDED
+#define SCHEDULER_H_INCLUDED
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include <ucontext.h>
+
+namespace Calc {
+
+/// Run many jobs, (far more than there are threads), on a fixed set of
+/// worker threads.  Each job runs on a stack of its own, (a fiber), and
+/// gives up its thread by calling yield(), after which the worker switches
+/// to the next job in its queue.  Jobs are shared out between the workers
+/// when run() starts, and each stays on its worker, (so nothing kept in a
+/// thread_local moves under it); a worker takes its jobs in turn, so each
+/// gets a slice as often as the others.
+class scheduler
+{
+public:
+    using job = std::function<void()>;
+    using clock = std::chrono::steady_clock;
+
+    /// The size of the stack of each job, unless another is given.
+    static constexpr std::size_t default_stack_size = 512u << 10;
+    static constexpr std::size_t min_stack_size = 128u << 10;
+
+    /// @param threads The number of workers, (at least one).
+    /// @param stack_size The size of the stack of each job, (at least
+    ///                   min_stack_size, rounded up to whole pages).  Each
+    ///                   stack is mapped with an inaccessible page below
+    ///                   it, so a job which overflows its stack faults,
+    ///                   (killing the process), rather than writing over
+    ///                   memory which isn't its own.  Pages are only used
+    ///                   as the stack grows into them.
+    explicit scheduler(std::size_t threads,
+                       std::size_t stack_size = default_stack_size);
+    scheduler(const scheduler &) = delete;
+    scheduler(scheduler &&) = delete;
+    ~scheduler();
+
+    scheduler& operator=(const scheduler &) = delete;
+    scheduler& operator=(scheduler &&) = delete;
+
+    /// Add a job, to be started by run().
+    /// @return The index of the job.
+    std::size_t spawn(job j);
+
+    /// Run every job to completion.  If a job throws, (or its stack can't
+    /// be mapped), the exception is kept, (see error()), and the others
+    /// carry on.
+    void run();
+
+    /// Give the thread to the next job.  Does nothing outside of a job.
+    static void yield();
+
+    /// The lowest usable address of the stack of the job running on this
+    /// thread, (nullptr outside of a job), see evaluator::stack_floor().
+    static const void* stack_floor();
+
+    /// The exception thrown by a job, if any.
+    std::exception_ptr error(std::size_t index) const;
+
+    /// Print the scheduling statistics: slices, the time spent switching,
+    /// and the spread of the times the jobs took to complete.
+    void report(std::ostream &os) const;
+
+private:
+    struct fiber;
+
+    /// Run the jobs given to one worker.
+    void work(std::vector<fiber *> jobs, std::size_t index);
+
+    /// Where a fiber starts.
+    static void start();
+
+    /// The fiber running on this thread, and where to go when it yields.
+    static thread_local fiber      *current_;
+    static thread_local ucontext_t *worker_context_;
+
+    std::vector<std::unique_ptr<fiber>> fibers_;
+    std::size_t                         threads_;
+    std::size_t                         stack_size_;
+
+    /// Statistics, per worker.
+    struct worker_stats
+    {
+        std::size_t     slices_ = 0u;
+        clock::duration busy_{};        ///< Time spent in the worker loop.
+        clock::duration running_{};     ///< Time spent in the jobs.
+    };
+    std::vector<worker_stats> stats_;
+    clock::duration           elapsed_{};
+};
+
+} // namespace Calc
+
+#endif // SCHEDULER_H_INCLUDED
@@ -120,13 +120,11 @@ struct assign_node_type : parse_tree::apply<assign_node_type>
     static void transform( Ptr &n, States&&... st)
     {
         // statements
-        try_type<decl_statement, Node::declaration>(n)                ||
         try_type<function_definition, Node::function>(n)              ||
         try_type<expression_statement, Node::expression_statement>(n) ||
         try_type<exit_statement, Node::exit_statement>(n)             ||
         try_type<return_statement, Node::return_statement>(n)         ||
         try_type<if_statement, Node::if_statement>(n)                 ||
-        try_type<assignment_statement, Node::assignment_statement>(n) ||
         try_type<compound_statement, Node::compound_statement>(n)     ||
 
         // operations
@@ -142,6 +140,7 @@ struct assign_node_type : parse_tree::apply<assign_node_type>
         try_type<less_than, Node::less_than>(n)                       ||
         try_type<less_or_equal, Node::less_or_equal>(n)               ||
         try_type<function_call, Node::function_call>(n)               ||
+        try_type<element, Node::element>(n)                           ||
         try_type<addition, Node::addition>(n)                         ||
         try_type<subtraction,  Node::subtraction>(n)                  ||
         try_type<multiplication, Node::multiplication>(n)             ||
@@ -246,6 +245,70 @@ struct handle_exit_statement :
     }
 };
 
+/// Parallel loops: replace each reduction with its variable, and keep the
+/// way it is combined in the loop node.
+struct handle_parallel_loop :
+    parse_tree::apply< handle_parallel_loop >
+{
+    template <typename ... States >
+    static void transform( Ptr &n, States&&... st)
+    {
+        n->set_type<Node::parallel_loop>();
+        auto loop = n->set_kind(Node::parallel_loop{});
+        n->remove_content();
+        for (auto &child : n->children) {
+            if (!child->is_type<reduction>()) {
+                continue;
+            }
+            auto text = child->string();
+            auto op = text.substr(0, text.find_first_of(" \t\r\n"));
+            loop->reductions_.push_back(
+                op == "sum" ? Node::reduction::sum :
+                op == "min" ? Node::reduction::min :
+                op == "max" ? Node::reduction::max :
+                op == "and" ? Node::reduction::logical_and
+                            : Node::reduction::logical_or);
+            child = std::move(child->children.back());
+        }
+    }
+};
+
+/// Declarations, (noting whether the variable is shared).
+struct handle_declaration : parse_tree::apply< handle_declaration >
+{
+    template <typename ... States >
+    static void transform( Ptr &n, States&&... st)
+    {
+        n->set_type<Node::declaration>();
+        auto decl = n->set_kind(Node::declaration{});
+        decl->shared_ = n->string().compare(0, 6, "shared") == 0;
+        n->remove_content();
+    }
+};
+
+/// Assignments, either to a variable, or to an element of an array, whose
+/// array and index take the place of the element.
+struct handle_assignment : parse_tree::apply< handle_assignment >
+{
+    template <typename ... States >
+    static void transform( Ptr &n, States&&... st)
+    {
+        n->remove_content();
+        auto &target = n->children.front();
+        if (!target->get_kind<Node::element>()) {
+            n->set_type<Node::assignment_statement>();
+            n->set_kind(Node::assignment_statement{});
+            return;
+        }
+        n->set_type<Node::element_assignment>();
+        n->set_kind(Node::element_assignment{});
+        auto e = std::move(target);
+        n->children.erase(n->children.begin());
+        n->children.insert(n->children.begin(), std::move(e->children[1]));
+        n->children.insert(n->children.begin(), std::move(e->children[0]));
+    }
+};
+
 /// Used to select which nodes are created.
 template <typename Rule>
 using selector = parse_tree::selector<
@@ -270,12 +333,21 @@ using selector = parse_tree::selector<
   /// Special handling for exit statements
   handle_exit_statement::on< exit_statement >,
 
+  /// Keep the text of reductions, (for the operator), until the parallel
+  /// loop is handled.
+  parse_tree::store_content::on< reduction >,
+
+  /// Special handling for parallel loops
+  handle_parallel_loop::on< parallel_loop >,
+
+  handle_declaration::on< decl_statement >,
+
+  handle_assignment::on< assignment_statement >,
+
   /// Remove the content and classify the nodes for these.
   assign_node_type::on<
     function_definition,
-    decl_statement,
     if_statement,
-    assignment_statement,
     return_statement,
     expression_statement,
     addition,
@@ -296,7 +368,8 @@ using selector = parse_tree::selector<
     modulus,
     unary_plus,
     unary_minus,
-    function_call
+    function_call,
+    element
   >,
 
   parse_tree::remove_content::on<
@@ -25,8 +25,15 @@
 
 #include "semantic_analysis.h"
 #include "error.h"
+#include "dataflow.h"
+#include "shared_store.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <future>
 #include <iostream>
+#include <map>
 #include <set>
+#include <utility>
 
 #include <CompuBrite/CheckPoint.h>
 
@@ -36,33 +43,127 @@ namespace cbi = CompuBrite;
 using namespace Calc::Node;
 
 void
-checkKeyword(const node &n, const std::string &name)
+semantic_analysis::checkKeyword(const node &n, const std::string &name)
 {
     static std::set<std::string> keywords{
         "if", "else", "and", "then", "or", "and", "var", "def", "exit",
-        "while", "until", "loop"
+        "while", "until", "loop", "parallel", "for", "reduce", "shared"
     };
 
     if (auto found = keywords.find(name); found != keywords.end())  {
-        error_msg(n, "Warning: keyword '", name, "' used as symbol_name.");
+        error_msg(context_.diagnostics(), n,
+                  "Warning: keyword '", name, "' used as symbol_name.");
     }
 }
 
-semantic_analysis::semantic_analysis(Node::node &n, Node::parent &p)
+semantic_analysis::semantic_analysis(compiler_context &context,
+                                     Node::node &n, Node::parent &p,
+                                     std::size_t threads) :
+    context_(context),
+    threads_(threads)
 {
     push_scope(n, p);
     add_intrinsics();
+    if (threads_ > 1u) {
+        root_ = context_.current();
+        diagnostics_ = &context_.diagnostics();
+        segments_.emplace_back(std::make_unique<std::ostringstream>());
+        context_.diagnostics(*segments_.back());
+    }
+}
+
+semantic_analysis::semantic_analysis(compiler_context &context,
+                                     deferred &d) :
+    context_(context),
+    resuming_(&d)
+{
 }
 
 semantic_analysis::~semantic_analysis()
 {
-    pop_scope();
+    if (!resuming_) {
+        pop_scope();
+    }
+}
+
+void
+semantic_analysis::defer(node &n, function &f)
+{
+    f.name_ = n.children.front()->string();
+    root_->add_function(f.name_, n);
+
+    auto d = std::make_unique<deferred>();
+    d->func_ = &n;
+    d->children_ = std::move(n.children);
+    n.children.clear();
+    d->visible_ = context_.sequence();
+
+    // Keep the function's place amongst the global subscopes.
+    auto &subscopes = root_->scope().get_kind<scope>()->subscopes_;
+    d->slot_ = subscopes.size();
+    subscopes.push_back(nullptr);
+    deferred_.emplace_back(std::move(d));
+
+    segments_.emplace_back(std::make_unique<std::ostringstream>());
+    context_.diagnostics(*segments_.back());
+}
+
+void
+semantic_analysis::run_deferred()
+{
+    cbi::CheckPoint cp("semantic_analysis");
+    cp.print(CBI_HERE, "Deferred functions: ", deferred_.size());
+    {
+        // The global scope is only read from now on.
+        thread_pool pool(std::min(threads_, deferred_.size()));
+        std::vector<std::future<void>> done;
+        for (auto &d : deferred_) {
+            done.push_back(pool.async([this, &d]
+                {
+                    compiler_context context(d->diagnostics_);
+                    context.current(root_);
+                    context.visible(d->visible_);
+                    auto &n = *d->func_;
+                    n.children = std::move(d->children_);
+                    semantic_analysis sem(context, *d);
+                    traversal trav(sem, PRE_VISIT | POST_VISIT);
+                    trav.traverse(n);
+                }));
+        }
+        for (auto &f : done) {
+            f.get();
+        }
+    }
+
+    // Drop the places kept for functions whose scopes were empty.
+    auto &subscopes = root_->scope().get_kind<scope>()->subscopes_;
+    subscopes.erase(std::remove(subscopes.begin(), subscopes.end(), nullptr),
+                    subscopes.end());
+
+    *diagnostics_ << segments_.front()->str();
+    for (auto i = 0u; i < deferred_.size(); ++i) {
+        *diagnostics_ << deferred_[i]->diagnostics_.str()
+                      << segments_[i + 1]->str();
+    }
+    context_.diagnostics(*diagnostics_);
+    deferred_.clear();
+    segments_.clear();
+}
+
+void
+semantic_analysis::post_visit(node &n, root &)
+{
+    if (root_) {
+        run_deferred();
+    }
+    // Only now is every function body analyzed.
+    check_parallel_loops(n, context_.diagnostics());
 }
 
 void
 semantic_analysis::add_intrinsics()
 {
-    symbol_scope::add_intrinsic(
+    context_.current()->add_intrinsic(
         [](int x)
         {
             if (x < 0) {
@@ -70,7 +171,7 @@ semantic_analysis::add_intrinsics()
             }
             return x;
         }, "abs");
-    symbol_scope::add_intrinsic(
+    context_.current()->add_intrinsic(
         [](int x)
         {
             if (x < 0) {
@@ -86,7 +187,7 @@ semantic_analysis::add_intrinsics()
 void
 semantic_analysis::push_scope(Node::node &node, Node::parent &parent)
 {
-    auto ptr = std::make_unique<symbol_scope>(node, parent);
+    auto ptr = std::make_unique<symbol_scope>(context_, node, parent);
     cbi::CheckPoint cp("semantic_analysis");
     cp.print(CBI_HERE, "New scope: ", ptr.get());
     stack_.emplace(std::move(ptr));
@@ -134,7 +235,9 @@ semantic_analysis::pre_visit(node &n, exit_statement &es)
 {
     if (loops_ == 0u) {
         /// @todo Write error handler that will report position of the error.
-        error_msg(n, "Exit statement is only allowed inside loop bodies.");
+        error_msg(context_.diagnostics(), n, parallel_.empty()
+                  ? "Exit statement is only allowed inside loop bodies."
+                  : "Exit statement may not leave a parallel loop.");
         return;
     }
     // We're in a loop.  Is this a named exit statement, and does it refer
@@ -143,8 +246,9 @@ semantic_analysis::pre_visit(node &n, exit_statement &es)
         // Unnamed exit statement.  OK.
         return;
     }
-    for (auto scope = symbol_scope::current();
-         scope;
+    auto outer = parallel_.empty() ? nullptr : parallel_.back().scope_;
+    for (auto scope = context_.current();
+         scope && scope != outer;
          scope = scope->previous()) {
         if (scope->name() == es.name_) {
             // Found a match -- OK
@@ -152,7 +256,7 @@ semantic_analysis::pre_visit(node &n, exit_statement &es)
             return;
         }
     }
-    error_msg(n, "Exit statement label not found.");
+    error_msg(context_.diagnostics(), n, "Exit statement label not found.");
     return;
 }
 
@@ -161,7 +265,9 @@ semantic_analysis::pre_visit(node &n, return_statement &)
 {
     if (funcs_ == 0u) {
         /// @todo Write error handler that will report position of the error.
-        error_msg(n, "Return statement only allowed inside function bodies.");
+        error_msg(context_.diagnostics(), n, parallel_.empty()
+                  ? "Return statement only allowed inside function bodies."
+                  : "Return statement may not leave a parallel loop.");
         n.children.clear();
     }
 }
@@ -178,18 +284,49 @@ semantic_analysis::pre_visit(node &n, function_call &fc)
     n.children.erase(n.children.begin());
     auto &name = fnode->get_kind<variable>()->name_;
     checkKeyword(n, name);
-    auto r = symbol_scope::lookup(name);
+    if (array_call(n, name)) {
+        return;
+    }
+    auto r = context_.current()->lookup(name);
     fc.symbol_ = r;
 }
 
 void
-semantic_analysis::pre_visit(node &n, declaration &)
+semantic_analysis::pre_visit(node &n, declaration &d)
 {
     traversal_->disableSubTree();
     auto &child = n.children[0];
     auto &var = child->get_kind<variable>()->name_;
     checkKeyword(n, var);
-    symbol_scope::add(var, *child);
+    context_.current()->add(var, *child);
+    if (n.children.size() == 2) {
+        // An array, (var a[10];).
+        auto length = n.children[1]->get_kind<number>()->value_;
+        n.children.pop_back();
+        if (length <= 0) {
+            error_msg(context_.diagnostics(), std::as_const(n),
+                      "An array must have at least one element.");
+            length = 1;
+        }
+        if (d.shared_) {
+            error_msg(context_.diagnostics(), n,
+                      "Shared variables may not be arrays.");
+            return;
+        }
+        child->get_kind<variable_ref>()->symbol_->get_kind<variable>()
+            ->length_ = length;
+    }
+    if (!d.shared_) {
+        return;
+    }
+    if (!context_.current()->parent_node().get_kind<root>()) {
+        error_msg(context_.diagnostics(), n,
+                  "Shared variables may only be declared at the top level.");
+        return;
+    }
+    // The declared name is now a reference to the variable.
+    auto v = child->get_kind<variable_ref>()->symbol_->get_kind<variable>();
+    v->cell_ = &shared_store::cell(v->name_);
 }
 
 void
@@ -209,17 +346,28 @@ semantic_analysis::post_visit(node &, compound_statement &c)
 void
 semantic_analysis::pre_visit(node &n, function &f)
 {
+    if (root_ && context_.current() == root_) {
+        defer(n, f);
+        return;
+    }
+    auto resumed = resuming_ && resuming_->func_ == &n;
     ++funcs_;
     // First put the name of the function in the function node.
     auto iter = n.children.begin();
     f.name_ = (*iter)->string();
 
-    // Add the function to the current scope
-    symbol_scope::add_function(f.name_, n);
+    // Add the function to the current scope, (a deferred function was added
+    // when it was put aside).
+    if (!resumed) {
+        context_.current()->add_function(f.name_, n);
+    }
 
     // Push a new scope for this function.
     push_scope(n, f);
-    symbol_scope::current()->scope().get_kind<scope>()->function_ = 1;
+    context_.current()->scope().get_kind<scope>()->function_ = 1;
+    if (resumed) {
+        context_.current()->reserve(resuming_->slot_);
+    }
 
     for (++iter; iter != n.children.end(); ++iter) {
         // Now, put the parameters into the function's scope.
@@ -228,7 +376,7 @@ semantic_analysis::pre_visit(node &n, function &f)
             break;
         }
         auto &var = child->get_kind<variable>()->name_;
-        symbol_scope::add(var, *child);
+        context_.current()->add(var, *child);
     }
     n.children.erase(n.children.begin(), iter);
 }
@@ -236,18 +384,22 @@ semantic_analysis::pre_visit(node &n, function &f)
 void
 semantic_analysis::post_visit(node &n, function &f)
 {
+    if (root_ && context_.current() == root_) {
+        // Deferred, see run_deferred().
+        return;
+    }
     --funcs_;
     pop_scope();
     // Now, unlink this function from it's parent, and link it to
     // the current scope.
 #if 0
-    auto &parent_node = symbol_scope::current()->parent_node();
-    auto &scope = symbol_scope::current()->scope();
+    auto &parent_node = context_.current()->parent_node();
+    auto &scope = context_.current()->scope();
     auto iter = parent_node.children.begin();
     for (; iter != parent_node.children.end(); ++iter) {
         auto &child = *iter;
         if (child.get() == &n) {
-            auto &parent = symbol_scope::current()->parent();
+            auto &parent = context_.current()->parent();
             scope.emplace_back(std::move(child));
             parent_node.children.erase(iter);
             break;
@@ -257,14 +409,144 @@ semantic_analysis::post_visit(node &n, function &f)
 }
 
 void
-semantic_analysis::pre_visit(node &n, variable &)
+semantic_analysis::pre_visit(node &n, parallel_loop &pl)
+{
+    // The reduction variables belong to the enclosing scopes.
+    auto first = n.children.begin() + 3;
+    for (auto iter = first; iter != first + pl.reductions_.size(); ++iter) {
+        resolve(**iter);
+    }
+    // The loop variable has a scope of its own, so each iteration can have
+    // a copy.
+    push_scope(n, pl);
+    auto &var = *n.children[0];
+    auto &name = var.get_kind<variable>()->name_;
+    checkKeyword(var, name);
+    context_.current()->add(name, var);
+    parallel_.push_back({loops_, funcs_, context_.current()});
+    loops_ = 0u;
+    funcs_ = 0u;
+}
+
+void
+semantic_analysis::post_visit(node &, parallel_loop &)
+{
+    loops_ = parallel_.back().loops_;
+    funcs_ = parallel_.back().funcs_;
+    parallel_.pop_back();
+    pop_scope();
+}
+
+void
+semantic_analysis::resolve(node &n)
 {
     auto &name = n.get_kind<variable>()->name_;
     checkKeyword(n, name);
-    auto r = symbol_scope::lookup(name);
+    auto r = context_.current()->lookup(name);
+    if (auto v = r->get_kind<variable>(); v && v->length_) {
+        error_msg(context_.diagnostics(), std::as_const(n), "'", name,
+                  "' is an array, and must be indexed.");
+    }
     n.set_kind(variable_ref{r});
     n.set_type<variable_ref>();
     n.remove_content();
 }
 
+variable*
+semantic_analysis::resolve_array(node &n)
+{
+    auto var = n.get_kind<variable>();
+    if (!var) {
+        return nullptr;
+    }
+    auto &name = var->name_;
+    checkKeyword(n, name);
+    auto r = context_.current()->lookup(name);
+    n.set_kind(variable_ref{r});
+    n.set_type<variable_ref>();
+    n.remove_content();
+    auto v = r->get_kind<variable>();
+    return v && v->length_ ? v : nullptr;
+}
+
+bool
+semantic_analysis::array_call(node &n, const std::string &name)
+{
+    static const std::map<std::string, std::pair<array_op, std::size_t>>
+        builtins{
+            {"sum", {array_op::sum, 1u}},
+            {"min", {array_op::min, 1u}},
+            {"max", {array_op::max, 1u}},
+            {"dot", {array_op::dot, 2u}},
+            {"fill", {array_op::fill, 2u}},
+            {"prefix_sum", {array_op::prefix_sum, 1u}}
+        };
+    auto found = builtins.find(name);
+    if (found == builtins.end() || n.children.empty()) {
+        return false;
+    }
+    // Only an array argument makes it a builtin, (rather than a function
+    // which happens to have the same name).
+    auto &first = *n.children[0];
+    auto var = first.get_kind<variable>();
+    if (!var) {
+        return false;
+    }
+    auto r = context_.current()->lookup(var->name_);
+    if (auto v = r->get_kind<variable>(); !v || !v->length_) {
+        return false;
+    }
+
+    auto [op, arity] = found->second;
+    n.set_kind(array_builtin{op});
+    n.set_type<array_builtin>();
+    if (n.children.size() != arity) {
+        error_msg(context_.diagnostics(), n, "'", name, "' takes ", arity,
+                  arity == 1u ? " argument." : " arguments.");
+        n.children.clear();
+        return true;
+    }
+    auto array = resolve_array(first);
+    if (op != array_op::dot) {
+        return true;
+    }
+    auto other = resolve_array(*n.children[1]);
+    if (!other) {
+        error_msg(context_.diagnostics(), n,
+                  "Both arguments of 'dot' must be arrays.");
+    } else if (other->length_ != array->length_) {
+        error_msg(context_.diagnostics(), n,
+                  "The arguments of 'dot' must have the same length.");
+    }
+    return true;
+}
+
+void
+semantic_analysis::pre_visit(node &n, element &)
+{
+    auto &array = *n.children[0];
+    auto name = array.get_kind<variable>()->name_;
+    if (!resolve_array(array)) {
+        error_msg(context_.diagnostics(), n, "'", name,
+                  "' is not an array.");
+    }
+}
+
+void
+semantic_analysis::pre_visit(node &n, element_assignment &)
+{
+    auto &array = *n.children[0];
+    auto name = array.get_kind<variable>()->name_;
+    if (!resolve_array(array)) {
+        error_msg(context_.diagnostics(), n, "'", name,
+                  "' is not an array.");
+    }
+}
+
+void
+semantic_analysis::pre_visit(node &n, variable &)
+{
+    resolve(n);
+}
+
 } // namespace Calc
@@ -30,9 +30,11 @@
 #include "node.h"
 #include "visitor.h"
 #include "symbol_scope.h"
+#include "compiler_context.h"
 #include "traversal.h"
 
 #include <memory>
+#include <sstream>
 #include <stack>
 #include <vector>
 
@@ -40,10 +42,19 @@ namespace Calc {
 /// Evaluate the parse tree.
 /// Once the parse has completed, traverse the parse tree evaluating the nodes to
 /// produce a result.
+///
+/// With more than one thread, the bodies of top-level functions are put
+/// aside as they are reached, and analyzed once the rest of the program
+/// has been, each on a worker of its own.  A body only sees the global
+/// symbols added before it, and its implicit declarations go into its own
+/// scopes, so the result, (diagnostics included), is the same as that of
+/// a single thread.
 class semantic_analysis : public node_visitor
 {
 public:
-    semantic_analysis(Node::node &node, Node::parent &parent);
+    /// @param threads The number of workers to analyze function bodies on.
+    semantic_analysis(compiler_context &context, Node::node &node,
+                      Node::parent &parent, std::size_t threads = 1u);
     semantic_analysis(const semantic_analysis &) = delete;
     semantic_analysis(semantic_analysis &&) = default;
     ~semantic_analysis();
@@ -51,6 +62,9 @@ public:
     semantic_analysis& operator=(const semantic_analysis &) = delete;
     semantic_analysis& operator=(semantic_analysis &&) = default;
 
+    /// Visit the root, after visiting its children.
+    void post_visit(Node::node &, Node::root &) override;
+
     /// Visit a declaration
     void pre_visit(Node::node &, Node::declaration &) override;
 
@@ -87,12 +101,24 @@ public:
     /// Visit a bottomo test loop statement
     void post_visit(Node::node &, Node::loop_bottom_test_statement &) override;
 
+    /// Visit a parallel loop
+    void pre_visit(Node::node &, Node::parallel_loop &) override;
+
+    /// Visit a parallel loop after visiting its children.
+    void post_visit(Node::node &, Node::parallel_loop &) override;
+
     /// Visit a function call
     /// @todo Lookup the symbol, (from the 1st child node), and attach the
     /// proper function to the function_call node, then delete the 1st
     /// child node.
     void pre_visit(Node::node &, Node::function_call &) override;
 
+    /// Visit an element of an array.
+    void pre_visit(Node::node &, Node::element &) override;
+
+    /// Visit an assignment to an element of an array.
+    void pre_visit(Node::node &, Node::element_assignment &) override;
+
     /// Push a new scope onto the symbol_scope stack.
     void push_scope(Node::node &node, Node::parent &parent);
 
@@ -100,16 +126,78 @@ public:
     void pop_scope();
 
 private:
+    /// A top-level function whose body is analyzed later.
+    struct deferred
+    {
+        Node::node              *func_;
+        std::vector<Node::Ptr>  children_;  ///< Its name, parameters and body.
+        std::size_t             visible_;   ///< The global symbols it sees.
+        std::size_t             slot_;      ///< Its place in the subscopes.
+        std::ostringstream      diagnostics_;
+    };
+
+    /// Analyze a deferred function in the given context.
+    semantic_analysis(compiler_context &context, deferred &d);
+
+    /// Put a top-level function aside.
+    void defer(Node::node &n, Node::function &f);
+
+    /// Analyze the deferred functions, and write the diagnostics in order.
+    void run_deferred();
+
     /// Add intrinsic functions and/or variables.
     void add_intrinsics();
 
+    /// Warn about keywords used as names.
+    void checkKeyword(const Node::node &n, const std::string &name);
+
+    /// Look up a variable, and make n a reference to it.
+    void resolve(Node::node &n);
+
+    /// Look up an array, and make n a reference to it.
+    /// @return The array, or nullptr if the variable isn't one.
+    Node::variable* resolve_array(Node::node &n);
+
+    /// Make a call of a builtin function on arrays, (sum(a), and so on), an
+    /// array_builtin node.
+    /// @return false if it isn't one, (the first argument isn't an array).
+    bool array_call(Node::node &n, const std::string &name);
+
 private:
     using ScopePtr = std::unique_ptr<symbol_scope>;
     using ScopeStack = std::stack<ScopePtr, std::vector<ScopePtr>>;
 
+    compiler_context &context_;
     ScopeStack stack_;
     size_t     loops_{0u};
     size_t     funcs_{0u};
+    size_t     threads_{1u};
+
+    /// The global scope, if functions may be deferred.
+    symbol_scope *root_ = nullptr;
+
+    /// The functions put aside, in order.
+    std::vector<std::unique_ptr<deferred>> deferred_;
+
+    /// The diagnostics before the first deferred function, and after each.
+    std::vector<std::unique_ptr<std::ostringstream>> segments_;
+
+    /// Where the diagnostics go in the end.
+    std::ostream *diagnostics_ = nullptr;
+
+    /// The deferred function being analyzed, if any.
+    deferred *resuming_ = nullptr;
+
+    /// The parallel loops being analyzed, innermost last.  Exit and return
+    /// statements may not leave them, so the counts of loops and functions
+    /// enclosing each are saved, and start again from zero.
+    struct parallel
+    {
+        size_t       loops_;
+        size_t       funcs_;
+        symbol_scope *scope_;
+    };
+    std::vector<parallel> parallel_;
 };
 
 } // namespace Calc
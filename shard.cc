@@ -0,0 +1,401 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "shard.h"
+#include "column_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace Calc {
+
+namespace {
+
+[[noreturn]] void
+malformed(const std::string &what)
+{
+    throw std::runtime_error("Malformed shard: " + what);
+}
+
+/// The last line of what a worker wrote to its standard error, (which says
+/// why it failed, if anything does).
+std::string
+last_line(const std::string &text)
+{
+    auto end = text.find_last_not_of("\r\n");
+    if (end == std::string::npos) {
+        return "";
+    }
+    auto start = text.rfind('\n', end);
+    start = start == std::string::npos ? 0u : start + 1u;
+    return text.substr(start, end + 1u - start);
+}
+
+} // namespace
+
+constexpr char shard_header::magic[8];
+
+void
+write_shard(std::ostream &os, const std::vector<std::string> &names,
+            std::size_t first, std::size_t rows,
+            const std::vector<const int *> &columns)
+{
+    shard_header h;
+    std::memcpy(h.magic_, shard_header::magic, sizeof(h.magic_));
+    h.version_ = shard_header::current;
+    h.columns_ = static_cast<std::uint32_t>(names.size());
+    h.first_ = first;
+    h.rows_ = rows;
+    os.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    for (auto &name : names) {
+        auto length = static_cast<std::uint32_t>(name.size());
+        os.write(reinterpret_cast<const char *>(&length), sizeof(length));
+        os.write(name.data(), name.size());
+    }
+    for (auto column : columns) {
+        os.write(reinterpret_cast<const char *>(column), rows * sizeof(int));
+    }
+    os.flush();
+}
+
+shard
+read_shard(const std::string &bytes)
+{
+    shard_header h;
+    if (bytes.size() < sizeof(h)) {
+        malformed("No header, (" + std::to_string(bytes.size()) +
+                  " bytes).");
+    }
+    std::memcpy(&h, bytes.data(), sizeof(h));
+    if (std::memcmp(h.magic_, shard_header::magic, sizeof(h.magic_)) != 0) {
+        malformed("Not a shard.");
+    }
+    if (h.version_ != shard_header::current) {
+        malformed("Unknown version, (or the other byte order).");
+    }
+
+    shard s;
+    s.first_ = h.first_;
+    s.rows_ = h.rows_;
+    std::size_t at = sizeof(h);
+    for (auto i = 0u; i < h.columns_; ++i) {
+        std::uint32_t length;
+        if (bytes.size() - at < sizeof(length)) {
+            malformed("Truncated names.");
+        }
+        std::memcpy(&length, bytes.data() + at, sizeof(length));
+        at += sizeof(length);
+        if (bytes.size() - at < length) {
+            malformed("Truncated names.");
+        }
+        s.names_.emplace_back(bytes.data() + at, length);
+        at += length;
+    }
+    auto left = bytes.size() - at;
+    if (h.columns_ &&
+        (h.rows_ > left / sizeof(int) / h.columns_ ||
+         left != h.columns_ * h.rows_ * sizeof(int))) {
+        malformed("Expected " + std::to_string(h.rows_) + " rows, found " +
+                  std::to_string(left) + " bytes.");
+    }
+    for (auto i = 0u; i < h.columns_; ++i) {
+        auto &column = s.columns_.emplace_back(s.rows_);
+        std::memcpy(column.data(), bytes.data() + at, s.rows_ * sizeof(int));
+        at += s.rows_ * sizeof(int);
+    }
+    return s;
+}
+
+coordinator::coordinator(std::vector<std::string> command,
+                         std::ostream &progress) :
+    command_(std::move(command)), progress_(progress)
+{
+}
+
+coordinator::process
+coordinator::launch(std::size_t shard, std::size_t first, std::size_t last)
+{
+    auto args = command_;
+    args.push_back("--shard");
+    args.push_back(std::to_string(first) + "," + std::to_string(last));
+    std::vector<char *> argv;
+    for (auto &arg : args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+
+    int out[2], err[2];
+    if (::pipe2(out, O_CLOEXEC) != 0) {
+        throw std::runtime_error("Cannot create a pipe for a worker.");
+    }
+    if (::pipe2(err, O_CLOEXEC) != 0) {
+        ::close(out[0]);
+        ::close(out[1]);
+        throw std::runtime_error("Cannot create a pipe for a worker.");
+    }
+    auto pid = ::fork();
+    if (pid == 0) {
+        ::dup2(out[1], STDOUT_FILENO);
+        ::dup2(err[1], STDERR_FILENO);
+        ::execvp(argv[0], argv.data());
+        const char message[] = "Cannot run the worker command.\n";
+        auto written = ::write(STDERR_FILENO, message, sizeof(message) - 1u);
+        static_cast<void>(written);
+        ::_exit(127);
+    }
+    ::close(out[1]);
+    ::close(err[1]);
+    if (pid < 0) {
+        ::close(out[0]);
+        ::close(err[0]);
+        throw std::runtime_error("Cannot start a worker.");
+    }
+    process p;
+    p.shard_ = shard;
+    p.pid_ = pid;
+    p.out_ = out[0];
+    p.err_ = err[0];
+    return p;
+}
+
+std::size_t
+coordinator::run(std::size_t rows, const std::string &output,
+                 std::ostream &out)
+{
+    auto start = clock::now();
+    rows_ = rows;
+    used_ = std::max<std::size_t>(1u, std::min(shards_, rows));
+    auto bound = [this, rows](std::size_t shard)
+        {
+            return rows / used_ * shard + rows % used_ * shard / used_;
+        };
+
+    std::deque<std::size_t> pending;
+    for (auto i = 0u; i < used_; ++i) {
+        pending.push_back(i);
+    }
+    std::vector<std::size_t> attempts(used_);
+    std::vector<process> running;
+    auto limit = workers_ ? workers_ : used_;
+
+    // Shards are written in order, so those done early wait for the ones
+    // before them.
+    std::map<std::size_t, shard> done;
+    std::size_t next = 0u, finished = 0u, rows_done = 0u;
+    std::vector<std::string> names;
+    std::unique_ptr<column_writer> file;
+    auto write = [&](const shard &s)
+        {
+            if (s.first_ == 0u) {
+                if (!output.empty()) {
+                    file = std::make_unique<column_writer>(output, names,
+                                                           rows);
+                } else {
+                    auto separator = "";
+                    for (auto &name : names) {
+                        out << separator << name;
+                        separator = ",";
+                    }
+                    out << '\n';
+                }
+            }
+            if (file) {
+                for (auto i = 0u; i < s.columns_.size(); ++i) {
+                    std::copy(s.columns_[i].begin(), s.columns_[i].end(),
+                              file->column(i) + s.first_);
+                }
+                return;
+            }
+            for (auto row = 0u; row < s.rows_; ++row) {
+                auto separator = "";
+                for (auto &column : s.columns_) {
+                    out << separator << column[row];
+                    separator = ",";
+                }
+                out << '\n';
+            }
+        };
+
+    // Gather what a worker wrote, once it has exited.
+    auto finish = [&](process &p, int status)
+        {
+            auto i = p.shard_;
+            auto first = bound(i), last = bound(i + 1u);
+            std::string failure;
+            shard s;
+            if (WIFSIGNALED(status)) {
+                failure = "killed by signal " +
+                          std::to_string(WTERMSIG(status));
+            } else if (WEXITSTATUS(status) != 0) {
+                failure = "exit code " + std::to_string(WEXITSTATUS(status));
+            } else {
+                try {
+                    s = read_shard(p.output_);
+                    if (s.first_ != first || s.rows_ != last - first) {
+                        failure = "the wrong rows";
+                    } else if (!names.empty() && s.names_ != names) {
+                        failure = "results named differently";
+                    }
+                } catch (const std::runtime_error &e) {
+                    failure = e.what();
+                }
+            }
+            if (!failure.empty()) {
+                if (auto line = last_line(p.errors_); !line.empty()) {
+                    failure += ": " + line;
+                }
+                if (attempts[i]++ < retries_) {
+                    ++retried_;
+                    progress_ << "Shard " << i + 1u << " of " << used_
+                              << " failed, (" << failure
+                              << "), running it again" << std::endl;
+                    pending.push_back(i);
+                    return;
+                }
+                throw std::runtime_error("Shard " + std::to_string(i + 1u) +
+                                         ", (rows " + std::to_string(first) +
+                                         " to " + std::to_string(last) +
+                                         "), failed: " + failure);
+            }
+            if (names.empty()) {
+                names = s.names_;
+            }
+            rows_done += s.rows_;
+            progress_ << "Shards: " << ++finished << " of " << used_
+                      << " done, (" << rows_done << " of " << rows
+                      << " rows)" << std::endl;
+            done.emplace(i, std::move(s));
+            for (auto it = done.find(next); it != done.end();
+                 it = done.find(next)) {
+                write(it->second);
+                done.erase(it);
+                ++next;
+            }
+        };
+
+    try {
+        while (next < used_) {
+            while (!pending.empty() && running.size() < limit) {
+                auto i = pending.front();
+                pending.pop_front();
+                running.push_back(launch(i, bound(i), bound(i + 1u)));
+            }
+
+            std::vector<pollfd> fds;
+            for (auto &p : running) {
+                for (auto fd : {p.out_, p.err_}) {
+                    if (fd >= 0) {
+                        fds.push_back({fd, POLLIN, 0});
+                    }
+                }
+            }
+            if (!fds.empty() && ::poll(fds.data(), fds.size(), -1) < 0 &&
+                errno != EINTR) {
+                throw std::runtime_error("Cannot wait for the workers.");
+            }
+            auto ready = [&fds](int fd)
+                {
+                    return std::any_of(fds.begin(), fds.end(),
+                        [fd](const pollfd &p) { return p.fd == fd &&
+                                                       p.revents; });
+                };
+            char buffer[1u << 16];
+            for (auto &p : running) {
+                for (auto [fd, text] : {std::pair{&p.out_, &p.output_},
+                                        std::pair{&p.err_, &p.errors_}}) {
+                    if (*fd < 0 || !ready(*fd)) {
+                        continue;
+                    }
+                    auto n = ::read(*fd, buffer, sizeof(buffer));
+                    if (n > 0) {
+                        text->append(buffer, n);
+                    } else if (n == 0 || errno != EINTR) {
+                        ::close(*fd);
+                        *fd = -1;
+                    }
+                }
+            }
+
+            // A worker is done with once it has closed both its outputs.
+            for (auto p = running.begin(); p != running.end(); ) {
+                if (p->out_ >= 0 || p->err_ >= 0) {
+                    ++p;
+                    continue;
+                }
+                int status = 0;
+                while (::waitpid(p->pid_, &status, 0) < 0 && errno == EINTR) {
+                }
+                auto finished_process = std::move(*p);
+                p = running.erase(p);
+                finish(finished_process, status);
+            }
+        }
+    } catch (...) {
+        for (auto &p : running) {
+            ::kill(p.pid_, SIGTERM);
+            for (auto fd : {p.out_, p.err_}) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+            int status;
+            while (::waitpid(p.pid_, &status, 0) < 0 && errno == EINTR) {
+            }
+        }
+        elapsed_ += clock::now() - start;
+        throw;
+    }
+    elapsed_ += clock::now() - start;
+    return rows;
+}
+
+void
+coordinator::report(std::ostream &os) const
+{
+    using us = std::chrono::microseconds;
+    auto micros = std::chrono::duration_cast<us>(elapsed_).count();
+    os << "Coordinator: " << rows_ << " records in " << micros << " us";
+    if (micros) {
+        os << ", (" << rows_ * 1000000u / micros << " records per second)";
+    }
+    os << ", " << used_ << (used_ == 1u ? " shard" : " shards");
+    if (retried_) {
+        os << ", " << retried_ << " run again";
+    }
+    os << '\n';
+}
+
+} // namespace Calc
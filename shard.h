@@ -0,0 +1,155 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef SHARD_H_INCLUDED
+#define SHARD_H_INCLUDED
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Calc {
+
+/// The layout of a shard, the results of some of the rows of a batch, as a
+/// worker process writes them to its coordinator:
+///
+///     header          (below)
+///     names           for each result, its length, (4 bytes), and its
+///                     characters, (not terminated)
+///     columns         for each result, rows_ 4 byte integers
+///
+/// Numbers are in the byte order of the machine which wrote it, (version_
+/// shows whether that is the reader's).
+struct shard_header
+{
+    static constexpr char          magic[8] = {'c', 'a', 'l', 'c',
+                                               's', 'h', 'r', 'd'};
+    static constexpr std::uint32_t current = 1u;
+
+    char          magic_[8];
+    std::uint32_t version_;
+    std::uint32_t columns_;
+    std::uint64_t first_;   ///< The first row.
+    std::uint64_t rows_;
+};
+
+/// The results of some of the rows of a batch.
+struct shard
+{
+    std::size_t                   first_ = 0u;
+    std::size_t                   rows_ = 0u;
+    std::vector<std::string>      names_;
+    std::vector<std::vector<int>> columns_;     ///< For each name.
+};
+
+/// Write results as a shard.
+/// @param columns The values of each result, (rows of them).
+void write_shard(std::ostream &os, const std::vector<std::string> &names,
+                 std::size_t first, std::size_t rows,
+                 const std::vector<const int *> &columns);
+
+/// Read a shard from the bytes a worker wrote.
+/// Throws std::runtime_error if they aren't exactly one shard.
+shard read_shard(const std::string &bytes);
+
+/// Evaluate a batch which is too big for one process: the rows of a column
+/// file are split into shards, (ranges of rows), each of which is evaluated
+/// by a worker process, which writes its results as a shard to a pipe.
+/// The coordinator gathers the results, and writes them in order, as the
+/// batch would.  A shard whose worker fails is run again, by a new one.
+///
+/// The worker is a command, run with "--shard first,last" added, (see
+/// main.cc); it may start with a launcher, (ssh, taskset and so on), so that
+/// the workers run elsewhere, or in some other way.  The workers run at the
+/// same time, up to a limit.
+class coordinator
+{
+public:
+    /// @param command The worker command and its arguments.
+    /// @param progress Where progress, and failed shards, are reported.
+    coordinator(std::vector<std::string> command, std::ostream &progress);
+    coordinator(const coordinator &) = delete;
+    coordinator(coordinator &&) = delete;
+    ~coordinator() = default;
+
+    coordinator& operator=(const coordinator &) = delete;
+    coordinator& operator=(coordinator &&) = delete;
+
+    /// The number of shards to split the rows into, (no more than there
+    /// are rows).
+    void shards(std::size_t count)          { shards_ = count ? count : 1u; }
+
+    /// The number of workers to run at once, (0 for one for each shard).
+    void workers(std::size_t count)         { workers_ = count; }
+
+    /// The number of times to run a shard again after its worker fails.
+    void retries(std::size_t count)         { retries_ = count; }
+
+    /// Evaluate rows [0, rows) of the batch, and write their results as a
+    /// column file, or if output is empty, as CSV.
+    /// @return The number of rows.
+    /// Throws std::runtime_error if a shard fails too often, or the
+    /// results can't be written.
+    std::size_t run(std::size_t rows, const std::string &output,
+                    std::ostream &out);
+
+    /// Print the number of rows, the shards, and how fast they were
+    /// evaluated.
+    void report(std::ostream &os) const;
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    /// A running worker.
+    struct process
+    {
+        std::size_t shard_;         ///< Its index.
+        int         pid_ = -1;
+        int         out_ = -1;      ///< Its standard output.
+        int         err_ = -1;      ///< Its standard error.
+        std::string output_;
+        std::string errors_;
+    };
+
+    /// Start a worker for a shard.
+    process launch(std::size_t shard, std::size_t first, std::size_t last);
+
+    std::vector<std::string> command_;
+    std::ostream             &progress_;
+    std::size_t              shards_{1u};
+    std::size_t              workers_{0u};
+    std::size_t              retries_{2u};
+    std::size_t              rows_{0u};
+    std::size_t              used_{0u};      ///< Shards, (fewer if few rows).
+    std::size_t              retried_{0u};   ///< Shards run again.
+    clock::duration          elapsed_{};
+};
+
+} // namespace Calc
+
+#endif // SHARD_H_INCLUDED
@@ -0,0 +1,50 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef SHARED_STORE_H_INCLUDED
+#define SHARED_STORE_H_INCLUDED
+
+#include <atomic>
+#include <string>
+
+namespace Calc {
+
+/// The variables shared by every script run in the process, (declared
+/// "shared var x;").  A cell is looked up by name, under a lock, when a
+/// script is compiled; while scripts run it is only ever read and written
+/// with atomic operations.  Cells live as long as the process, and scripts
+/// which declare the same name share the same cell.
+class shared_store
+{
+public:
+    shared_store() = delete;
+
+    /// The cell for a shared variable, (made, holding 0, on first use).
+    static std::atomic<int>& cell(const std::string &name);
+};
+
+} // namespace Calc
+
+#endif // SHARED_STORE_H_INCLUDED
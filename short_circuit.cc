@@ -0,0 +1,111 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "short_circuit.h"
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+bool
+short_circuit::invisible(const node &n)
+{
+    return effects_.pure(n) && effects_.cannot_fail(n);
+}
+
+void
+short_circuit::reorder(node &n)
+{
+    auto &lhs = n.children[0];
+    auto &rhs = n.children[1];
+    if (effects_.cost(*rhs) < effects_.cost(*lhs) &&
+        invisible(*lhs) && invisible(*rhs)) {
+        std::swap(lhs, rhs);
+        ++reordered_;
+    }
+}
+
+template <typename Kind>
+void
+short_circuit::lower(node &n)
+{
+    if (!invisible(*n.children[1])) {
+        return;
+    }
+    n.set_kind(Kind{});
+    n.set_type<Kind>();
+    ++lowered_;
+    reorder(n);
+}
+
+void
+short_circuit::post_visit(node &n, logical_and &)
+{
+    lower<logical_and_then>(n);
+}
+
+void
+short_circuit::post_visit(node &n, logical_or &)
+{
+    lower<logical_or_else>(n);
+}
+
+void
+short_circuit::post_visit(node &n, logical_and_then &)
+{
+    reorder(n);
+}
+
+void
+short_circuit::post_visit(node &n, logical_or_else &)
+{
+    reorder(n);
+}
+
+void
+short_circuit::post_visit(node &n, addition &)
+{
+    reorder(n);
+}
+
+void
+short_circuit::post_visit(node &n, multiplication &)
+{
+    reorder(n);
+}
+
+void
+short_circuit::post_visit(node &n, equal_to &)
+{
+    reorder(n);
+}
+
+void
+short_circuit::post_visit(node &n, not_equal &)
+{
+    reorder(n);
+}
+
+} // namespace Calc
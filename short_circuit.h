@@ -0,0 +1,83 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef SHORT_CIRCUIT_H_INCLUDED
+#define SHORT_CIRCUIT_H_INCLUDED
+
+#include "node.h"
+#include "visitor.h"
+#include "effects.h"
+
+namespace Calc {
+
+/// Lower "and" and "or" to "and then" and "or else" when the right side is
+/// pure and cannot fail, (so skipping it can't be observed), and put the
+/// cheaper operand of commutative operations first when both operands are
+/// pure and cannot fail.  Use with a POST_VISIT traversal.
+class short_circuit : public node_visitor
+{
+public:
+    short_circuit() = default;
+    short_circuit(const short_circuit &) = delete;
+    short_circuit(short_circuit &&) = default;
+    ~short_circuit() = default;
+
+    short_circuit& operator=(const short_circuit &) = delete;
+    short_circuit& operator=(short_circuit &&) = default;
+
+    void post_visit(Node::node &, Node::logical_and &) override;
+    void post_visit(Node::node &, Node::logical_or &) override;
+    void post_visit(Node::node &, Node::logical_and_then &) override;
+    void post_visit(Node::node &, Node::logical_or_else &) override;
+    void post_visit(Node::node &, Node::addition &) override;
+    void post_visit(Node::node &, Node::multiplication &) override;
+    void post_visit(Node::node &, Node::equal_to &) override;
+    void post_visit(Node::node &, Node::not_equal &) override;
+
+    /// The number of operators lowered so far.
+    auto lowered() const                    { return lowered_; }
+
+    /// The number of operations whose operands were swapped so far.
+    auto reordered() const                  { return reordered_; }
+
+private:
+    /// Can this operand be skipped, or moved, without anyone noticing?
+    bool invisible(const Node::node &n);
+
+    /// Put the cheaper operand first, if that is safe.
+    void reorder(Node::node &n);
+
+    /// Change a strict logical operator to its short circuit equivalent.
+    template <typename Kind>
+    void lower(Node::node &n);
+
+    effect_analysis effects_;
+    std::size_t     lowered_{0u};
+    std::size_t     reordered_{0u};
+};
+
+} // namespace Calc
+
+#endif // SHORT_CIRCUIT_H_INCLUDED
@@ -0,0 +1,336 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "specializer.h"
+#include "constant_folder.h"
+#include "liveness.h"
+#include "traversal.h"
+#include "tree_clone.h"
+
+#include <CompuBrite/CheckPoint.h>
+#include <algorithm>
+#include <sstream>
+
+namespace Calc {
+namespace cbi = CompuBrite;
+
+using namespace Calc::Node;
+
+namespace {
+
+/// Is n a function defined in the script, (rather than an intrinsic)?
+function*
+user_function(node *n)
+{
+    if (!n) {
+        return nullptr;
+    }
+    auto func = n->get_kind<function>();
+    if (!func || func->is_intrinsic() || n->children.size() != 1 ||
+        !func->scope_) {
+        return nullptr;
+    }
+    return func;
+}
+
+bool
+assigns(const node &n, const node *var)
+{
+    if (n.get_kind<assignment_statement>() &&
+        n.children[0]->get_kind<variable_ref>()->symbol_ == var) {
+        return true;
+    }
+    if (auto inc = n.get_kind<increment>(); inc && inc->symbol_ == var) {
+        return true;
+    }
+    for (auto &child : n.children) {
+        if (assigns(*child, var)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+substitute(node &n, const node *var, int value)
+{
+    if (auto ref = n.get_kind<variable_ref>(); ref && ref->symbol_ == var) {
+        n.set_kind(number{value});
+        n.set_type<number>();
+        return;
+    }
+    if (auto cmp = n.get_compare(); cmp) {
+        if (cmp->rhs_ == var) {
+            cmp->rhs_ = nullptr;
+            cmp->value_ = value;
+        }
+        if (cmp->lhs_ == var) {
+            if (cmp->rhs_) {
+                // Swap the sides, so the variable is on the left.
+                cmp->lhs_ = cmp->rhs_;
+                cmp->rhs_ = nullptr;
+                cmp->value_ = value;
+                cmp->op_ = compare_base::mirror(cmp->op_);
+            } else if (n.get_kind<compare>()) {
+                n.set_kind(number{cmp->test(value, cmp->value_)});
+                n.set_type<number>();
+            } else {
+                // An exit on a constant condition, (or not at all).
+                auto c = *n.get_kind<exit_on_compare>();
+                bool exits = c.test(value, c.value_);
+                n.set_kind(exit_statement{});
+                n.set_type<exit_statement>();
+                n.get_kind<exit_statement>()->name_ = c.name_;
+                n.emplace_back(std::make_unique<node>());
+                auto &cond = *n.children.back();
+                cond.set_kind(number{exits});
+                cond.set_type<number>();
+            }
+        }
+        return;
+    }
+    for (auto &child : n.children) {
+        substitute(*child, var, value);
+    }
+}
+
+void
+collect_locals(const node &n, var_set &locals)
+{
+    // Walk the statements rather than the subscopes, since a scope without
+    // variables of its own isn't linked to its parent.
+    if (n.get_kind<function>()) {
+        return;
+    }
+    if (auto p = n.get_parent(); p && p->scope_) {
+        for (auto &var : p->scope_->children) {
+            if (var->get_kind<variable>()) {
+                locals.insert(var.get());
+            }
+        }
+    }
+    for (auto &child : n.children) {
+        collect_locals(*child, locals);
+    }
+}
+
+std::string
+signature_name(const std::string &name, const specializer::Signature &args)
+{
+    std::ostringstream os;
+    os << name << '[';
+    auto sep = "";
+    for (auto &arg : args) {
+        os << sep;
+        if (arg) {
+            os << *arg;
+        } else {
+            os << '_';
+        }
+        sep = ",";
+    }
+    os << ']';
+    return os.str();
+}
+
+} // namespace
+
+void
+specializer::collect(node &n, node *owner)
+{
+    if (user_function(&n)) {
+        owner_[&n] = owner;
+    } else if (n.get_kind<function_call>()) {
+        calls_.push_back(&n);
+    }
+    for (auto &child : n.children) {
+        collect(*child, &n);
+    }
+}
+
+std::size_t
+specializer::run(node &root)
+{
+    cbi::CheckPoint cp("specializer");
+    collect(root, nullptr);
+    std::size_t rewritten = 0u;
+    // Specializing may create new calls with constant arguments, (inside
+    // the clones), so calls_ may grow as we go.
+    for (auto i = 0u; i < calls_.size(); ++i) {
+        if (specialize(*calls_[i])) {
+            ++rewritten;
+        }
+    }
+    cp.print(CBI_HERE, "Rewrote ", rewritten, " calls\n");
+    return rewritten;
+}
+
+bool
+specializer::recursive(node &func)
+{
+    if (auto found = recursive_.find(&func); found != recursive_.end()) {
+        return found->second;
+    }
+    return recursive_[&func] = may_recurse(func);
+}
+
+bool
+specializer::keeps_state(node &func)
+{
+    if (auto found = keeps_state_.find(&func); found != keeps_state_.end()) {
+        return found->second;
+    }
+    auto &scope_node = *func.get_kind<function>()->scope_;
+    var_set locals;
+    collect_locals(*func.children[0], locals);
+
+    // The parameters are written by the call.
+    var_set written;
+    for (auto &param : scope_node.children) {
+        written.insert(param.get());
+    }
+    var_set exposed;
+    upward_exposed(*func.children[0], written, exposed);
+    auto result = std::any_of(exposed.begin(), exposed.end(),
+        [&locals](auto var) { return locals.count(var) != 0; });
+    keeps_state_[&func] = result;
+    return result;
+}
+
+bool
+specializer::specialize(node &call)
+{
+    auto &fc = *call.get_kind<function_call>();
+    auto func = user_function(fc.symbol_);
+    if (!func) {
+        return false;
+    }
+    auto &callee = *fc.symbol_;
+    auto &params = func->scope_->children;
+
+    Signature args(params.size());
+    bool any = false;
+    for (auto i = 0u; i < params.size() && i < call.children.size(); ++i) {
+        auto num = call.children[i]->get_kind<number>();
+        if (num && !assigns(*callee.children[0], params[i].get())) {
+            args[i] = num->value_;
+            any = true;
+        }
+    }
+    // A function which may end without a return gives the last value
+    // evaluated, which the missing arguments, and the folding, would change.
+    if (!any || !returns(*callee.children[0]) || recursive(callee) ||
+        keeps_state(callee)) {
+        return false;
+    }
+
+    std::size_t index;
+    if (auto found = index_.find(Key{&callee, args}); found != index_.end()) {
+        index = found->second;
+    } else {
+        auto clone = make_clone(callee, args);
+        if (!clone) {
+            return false;
+        }
+        index = specs_.size();
+        index_[Key{&callee, args}] = index;
+        specs_.push_back({func->name_, clone, args, 0u, tree_size(*clone)});
+        nodes_ += specs_.back().nodes_;
+    }
+
+    auto &spec = specs_[index];
+    for (auto i = args.size(); i-- > 0; ) {
+        if (args[i]) {
+            call.children.erase(call.children.begin() + i);
+        }
+    }
+    fc.symbol_ = spec.clone_;
+    ++spec.calls_;
+    return true;
+}
+
+node*
+specializer::make_clone(node &callee, const Signature &args)
+{
+    auto size = tree_size(callee);
+    if (specs_.size() >= budget_.max_clones_ ||
+        nodes_ + size > budget_.max_nodes_) {
+        return nullptr;
+    }
+    auto &func = *callee.get_kind<function>();
+    auto &params = func.scope_->children;
+
+    clone_map map;
+    auto copy = clone_tree(callee, map);
+    auto &body = *copy->children[0];
+    auto &clone_func = *copy->get_kind<function>();
+    auto &clone_params = clone_func.scope_->children;
+    for (auto i = args.size(); i-- > 0; ) {
+        if (args[i]) {
+            substitute(body, map[params[i].get()], *args[i]);
+            clone_params.erase(clone_params.begin() + i);
+        }
+    }
+    clone_func.name_ = signature_name(func.name_, args);
+
+    constant_folder folder;
+    traversal trav(folder, node_visitor::POST_VISIT);
+    trav.traverse(body);
+
+    // Link the new scope in beside the original.
+    auto &clone_scope = *clone_func.scope_->get_kind<scope>();
+    if (clone_scope.parent_scope_ && !clone_params.empty()) {
+        clone_scope.parent_scope_->get_kind<scope>()->subscopes_.emplace_back(
+            clone_func.scope_.get());
+    }
+
+    // Put the clone right after the original definition, and look for more
+    // calls to specialize inside of it.
+    auto ptr = copy.get();
+    auto owner = owner_[&callee];
+    auto &siblings = owner->children;
+    auto pos = std::find_if(siblings.begin(), siblings.end(),
+        [&callee](auto &c) { return c.get() == &callee; });
+    siblings.insert(pos + 1, std::move(copy));
+    collect(*ptr, owner);
+    return ptr;
+}
+
+void
+specializer::report(std::ostream &os) const
+{
+    std::size_t calls = 0u;
+    for (auto &spec : specs_) {
+        os << "Specialized: " << spec.clone_->get_kind<function>()->name_
+           << " from " << spec.original_ << ", " << spec.calls_
+           << " call(s), " << spec.nodes_ << " nodes\n";
+        calls += spec.calls_;
+    }
+    os << "Specializations: " << specs_.size() << " of "
+       << budget_.max_clones_ << " allowed, " << calls << " call(s), "
+       << nodes_ << " of " << budget_.max_nodes_ << " nodes\n";
+}
+
+} // namespace Calc
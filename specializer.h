@@ -0,0 +1,120 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef SPECIALIZER_H_INCLUDED
+#define SPECIALIZER_H_INCLUDED
+
+#include "node.h"
+
+#include <map>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+namespace Calc {
+
+/// Specialize function calls with constant arguments.
+/// For each call to a user defined function where some of the arguments
+/// are constants, a copy of the function is made with those parameters
+/// replaced by the constants, the copy is folded, and the call is
+/// redirected to the copy.  Calls with the same function and constants
+/// share a copy.  Functions which are recursive, which assign to the
+/// parameter, which keep state in their locals from one call to the next,
+/// or which may end without a return statement, (giving the last value
+/// evaluated), are not specialized, since the copy would behave
+/// differently.
+class specializer
+{
+public:
+    /// Limits on how much the tree is allowed to grow.
+    struct budget
+    {
+        std::size_t max_clones_ = 32u;      ///< Functions created, in total.
+        std::size_t max_nodes_  = 4096u;    ///< Nodes created, in total.
+    };
+
+    /// The constant bound to each parameter, if any.
+    using Signature = std::vector<std::optional<int>>;
+
+    /// A specialized copy of a function.
+    struct specialization
+    {
+        std::string original_;              ///< Name of the function copied.
+        Node::node  *clone_ = nullptr;      ///< The residual function.
+        Signature   args_;                  ///< Constants bound.
+        std::size_t calls_ = 0u;            ///< Call sites using clone_.
+        std::size_t nodes_ = 0u;            ///< Size of clone_.
+    };
+
+    specializer() = default;
+    explicit specializer(const budget &b) : budget_(b) { }
+    specializer(const specializer &) = delete;
+    specializer(specializer &&) = default;
+    ~specializer() = default;
+
+    specializer& operator=(const specializer &) = delete;
+    specializer& operator=(specializer &&) = default;
+
+    /// Specialize the calls in an analyzed tree.
+    /// @return The number of call sites rewritten.
+    std::size_t run(Node::node &root);
+
+    /// The specializations created so far.
+    const auto& specializations() const     { return specs_; }
+
+    /// Print the specializations created.
+    void report(std::ostream &os) const;
+
+private:
+    /// Find function definitions, (and what they are defined in), and calls.
+    void collect(Node::node &n, Node::node *owner);
+
+    /// Attempt to specialize a single call.
+    bool specialize(Node::node &call);
+
+    /// Create a specialized copy of a function.
+    Node::node* make_clone(Node::node &func, const Signature &args);
+
+    /// Does the function call itself, (directly or not)?
+    bool recursive(Node::node &func);
+
+    /// Can locals of the function be read before they are written?
+    bool keeps_state(Node::node &func);
+
+    using Key = std::pair<Node::node *, Signature>;
+
+    budget                                  budget_;
+    std::vector<specialization>             specs_;
+    std::map<Key, std::size_t>              index_;
+    std::map<Node::node *, Node::node *>    owner_;
+    std::map<Node::node *, bool>            recursive_;
+    std::map<Node::node *, bool>            keeps_state_;
+    std::vector<Node::node *>               calls_;
+    std::size_t                             nodes_{0u};
+};
+
+} // namespace Calc
+
+#endif // SPECIALIZER_H_INCLUDED
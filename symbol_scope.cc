@@ -31,17 +31,17 @@ namespace Calc {
 
 namespace cbi = CompuBrite;
 
-symbol_scope* symbol_scope::current_ = nullptr;
-
-symbol_scope::symbol_scope(Node::node &n, Node::parent &p) :
+symbol_scope::symbol_scope(compiler_context &context, Node::node &n,
+                           Node::parent &p) :
     parent_node_(n),
-    parent_(p)
+    parent_(p),
+    context_(context)
 {
     cbi::CheckPoint cp("symbol_scope");
-    previous_ = current_;
-    current_ = this;
+    previous_ = context_.current();
+    context_.current(this);
 
-    cp.print(CBI_HERE, "previous_ = ", previous_, ", current_ = ", current_, '\n');
+    cp.print(CBI_HERE, "previous_ = ", previous_, ", current_ = ", this, '\n');
     scope_ = std::make_unique<Node::node>();
     scope_ -> set_type<Node::scope>();
 
@@ -53,14 +53,18 @@ symbol_scope::symbol_scope(Node::node &n, Node::parent &p) :
 symbol_scope::~symbol_scope()
 {
     cbi::CheckPoint cp("symbol_scope");
-    cp.print(CBI_HERE, "previous_ = ", previous_, ", current_ = ", current_, '\n');
-    current_ = previous_;
+    cp.print(CBI_HERE, "previous_ = ", previous_, ", current_ = ", this, '\n');
+    context_.current(previous_);
     if (previous_) {
         auto s = scope().get_kind<Node::scope>();
         s->parent_scope_ = previous_->scope_.get();
         auto par = s->parent_scope_->get_kind<Node::scope>();
         if (!scope_->children.empty()) {
-            par->subscopes_.emplace_back(scope_.get());
+            if (slot_ < par->subscopes_.size()) {
+                par->subscopes_[slot_] = scope_.get();
+            } else {
+                par->subscopes_.emplace_back(scope_.get());
+            }
         }
     }
     if (!scope_->children.empty()) {
@@ -72,16 +76,27 @@ Node::node*
 symbol_scope::lookup(const std::string &name)
 {
     cbi::CheckPoint cp("lookup");
-    for (auto frame = current_; frame != nullptr; frame = frame->previous_) {
+    for (auto frame = this; frame != nullptr; frame = frame->previous_) {
         auto found = frame->table_.find(name);
         if (found == frame->table_.end()) {
             cp.print(CBI_HERE,
                 "Lookup failed for: ", name, " in Frame: ", frame);
             continue;
         }
-        cp.print(CBI_HERE,
-            "Lookup found: ", name, " as: ", found->second, " in frame: ", frame);
-        return found->second;
+        // Symbols of another context, (the scopes enclosing a function body
+        // analyzed on its own), are only seen if they were added before the
+        // body was reached.
+        auto limit = &frame->context_ == &context_
+                   ? std::numeric_limits<std::size_t>::max()
+                   : context_.visible();
+        auto &symbols = found->second;
+        for (auto s = symbols.rbegin(); s != symbols.rend(); ++s) {
+            if (s->sequence_ <= limit) {
+                cp.print(CBI_HERE, "Lookup found: ", name, " as: ", s->node_,
+                         " in frame: ", frame);
+                return s->node_;
+            }
+        }
     }
     // If we got here, we can't find the symbol. Insert a new symbol in the
     // current frame, add it to the current scope, and return that value.
@@ -91,8 +106,8 @@ symbol_scope::lookup(const std::string &name)
     auto ptr = node.get();
     node->set_kind(Node::variable{name});
     node->set_type<Node::variable>();
-    current_->table_[name] = node.get();
-    current_->scope_->children.emplace_back(std::move(node));
+    insert(name, ptr);
+    scope_->children.emplace_back(std::move(node));
     return ptr;
 }
 
@@ -110,17 +125,17 @@ symbol_scope::add(const std::string &name, Node::node &var)
     var.set_kind(Node::variable_ref{ node.get() });
     var.set_type<Node::variable_ref>( );
     var.remove_content();
-    cp.print(CBI_HERE, "Adding ", n, ": ", node.get(), ", to frame: ", current_);
-    current_->table_[n] = node.get();
-    current_->scope_->children.emplace_back(std::move(node));
+    cp.print(CBI_HERE, "Adding ", n, ": ", node.get(), ", to frame: ", this);
+    insert(n, node.get());
+    scope_->children.emplace_back(std::move(node));
 }
 
 void
 symbol_scope::add_function(const std::string &name, Node::node &func)
 {
     cbi::CheckPoint cp("add");
-    cp.print(CBI_HERE, "Frame: ", current_, ", name: ", name, ", func: ", &func);
-    current_->table_[name] = &func;
+    cp.print(CBI_HERE, "Frame: ", this, ", name: ", name, ", func: ", &func);
+    insert(name, &func);
 }
 
 void
@@ -133,8 +148,14 @@ symbol_scope::add_intrinsic(std::function<int(int)> func,
     f.name_ = name;
     f.kind_ = func;
     node->set_kind(std::move(f));
-    current_->table_[name] = node.get();
-    current_->scope_->children.emplace_back(std::move(node));
+    insert(name, node.get());
+    scope_->children.emplace_back(std::move(node));
+}
+
+void
+symbol_scope::insert(const std::string &name, Node::node *node)
+{
+    table_[name].push_back({node, context_.next_sequence()});
 }
 
 } // namespace Calc
@@ -29,18 +29,29 @@
 
 #include <map>
 #include <functional>
+#include <limits>
+#include <vector>
 
 #include "node.h"
+#include "compiler_context.h"
 
 namespace Calc {
 
 class symbol_scope
 {
 public:
-    using Symbols = std::map<std::string, Node::node *>;
+    /// A symbol, and its place in the order symbols were added.
+    struct symbol
+    {
+        Node::node  *node_;
+        std::size_t sequence_;
+    };
 
-    /// Create a new stack frame and push it onto the stack.
-    symbol_scope(Node::node &n, Node::parent &p);
+    /// Each binding of a name, (names may be declared again), oldest first.
+    using Symbols = std::map<std::string, std::vector<symbol>>;
+
+    /// Create a new stack frame and push it onto the context's stack.
+    symbol_scope(compiler_context &context, Node::node &n, Node::parent &p);
 
     /// Destroy a stack frame, pop it off the stack.
     ~symbol_scope();
@@ -48,40 +59,44 @@ public:
     /// Set the name of the current scope
     void name(const std::string &n)         { name_ = n; }
 
-    /// lookup a symbol name
-    /// @return a reference to the symbol, creating it in the current
+    /// lookup a symbol name, in this stack frame and those enclosing it.
+    /// @return a reference to the symbol, creating it in this
     /// stack frame if necessary.
-    static Node::node* lookup(const std::string &name);
+    Node::node* lookup(const std::string &name);
 
-    /// Add a new symbol to the current scope.
+    /// Add a new symbol to this scope.
     /// @param name the symbol to add.
     /// @param var the node which declares the variable.
-    /// Creates a new variable node, and adds it to the current scope.
+    /// Creates a new variable node, and adds it to this scope.
     /// Changes var to be a variable reference instead.
-    static void add(const std::string &name, Node::node &var);
+    void add(const std::string &name, Node::node &var);
 
-    /// Add a new function name to the current scope.
+    /// Add a new function name to this scope.
     /// @param name The name of the function
     /// @param func The node which contains the function definition.
-    static void add_function(const std::string &name, Node::node &func);
+    void add_function(const std::string &name, Node::node &func);
 
     /// Get a reference to the current scope node.
     auto& scope()                           { return *scope_; }
 
-    /// Get the current symbol scope
-    static auto current()                   { return current_; }
-
-    /// Add an intrinsic function to the current scope
+    /// Add an intrinsic function to this scope
     /// @param func The function to call
     /// @param name The name of the function.
-    static void add_intrinsic(std::function<int(int)> func,
-                              const std::string &name);
+    void add_intrinsic(std::function<int(int)> func,
+                       const std::string &name);
+
+    /// When this scope is popped, put it at a place reserved earlier in the
+    /// enclosing scope's subscopes, rather than at the end.
+    void reserve(std::size_t index)         { slot_ = index; }
 
     auto& parent()                          { return parent_; }
     auto& parent_node()                     { return parent_node_; }
     auto  previous() const                  { return previous_; }
     const auto& name() const                { return name_; }
 private:
+    /// Bind a name in this scope.
+    void insert(const std::string &name, Node::node *node);
+
 
     /// The symbol table for this scope.
     Symbols             table_;
@@ -100,8 +115,11 @@ private:
 
     Node::parent        &parent_;
 
-    /// A pointer to the current symbol_scope.
-    static symbol_scope *current_;
+    /// The compilation this scope belongs to.
+    compiler_context    &context_;
+
+    /// The place reserved for this scope in the enclosing scope's subscopes.
+    std::size_t         slot_ = std::numeric_limits<std::size_t>::max();
 };
 
 } // namespace Calc
@@ -0,0 +1,130 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace Calc {
+
+namespace {
+
+/// The pool, and the index, of the worker running on this thread, if any.
+thread_local const void  *current_pool = nullptr;
+thread_local std::size_t current_index = 0u;
+
+} // namespace
+
+thread_pool::thread_pool(std::size_t threads)
+{
+    threads = std::max<std::size_t>(threads, 1u);
+    for (auto i = 0u; i < threads; ++i) {
+        queues_.emplace_back(std::make_unique<queue>());
+    }
+    workers_.reserve(threads);
+    for (auto i = 0u; i < threads; ++i) {
+        workers_.emplace_back([this, i] { work(i); });
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+}
+
+void
+thread_pool::submit(task t)
+{
+    auto index = current_pool == this
+               ? current_index
+               : next_++ % queues_.size();
+    {
+        auto &q = *queues_[index];
+        std::lock_guard<std::mutex> lock(q.mutex_);
+        // Counted before it can be taken, so the count never goes below 0.
+        ++pending_;
+        q.tasks_.push_back(std::move(t));
+    }
+    {
+        // So that a worker can't miss the task between testing for one
+        // and waiting.
+        std::lock_guard<std::mutex> lock(mutex_);
+    }
+    ready_.notify_one();
+}
+
+bool
+thread_pool::take(std::size_t index, task &t)
+{
+    {
+        auto &own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex_);
+        if (!own.tasks_.empty()) {
+            t = std::move(own.tasks_.back());
+            own.tasks_.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+    for (auto i = 1u; i < queues_.size(); ++i) {
+        auto &other = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(other.mutex_);
+        if (!other.tasks_.empty()) {
+            t = std::move(other.tasks_.front());
+            other.tasks_.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+thread_pool::work(std::size_t index)
+{
+    current_pool = this;
+    current_index = index;
+    while (true) {
+        task t;
+        if (take(index, t)) {
+            t();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return stopping_ || pending_ > 0u; });
+        if (stopping_ && pending_ == 0u) {
+            return;
+        }
+    }
+}
+
+} // namespace Calc
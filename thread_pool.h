@@ -0,0 +1,109 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Calc {
+
+/// A fixed set of worker threads which steal work from each other.
+/// Each worker has a queue of its own.  Tasks submitted by a worker go on
+/// its own queue, which it runs newest first, (so a task which splits its
+/// work into halves keeps working on the most recent half); others are
+/// shared out between the queues.  A worker whose queue is empty takes the
+/// oldest task from another's, (the biggest piece of split work).  No order
+/// is promised between tasks.
+class thread_pool
+{
+public:
+    using task = std::function<void()>;
+
+    /// @param threads The number of workers, (at least one is started).
+    explicit thread_pool(std::size_t threads =
+                             std::thread::hardware_concurrency());
+    thread_pool(const thread_pool &) = delete;
+    thread_pool(thread_pool &&) = delete;
+
+    /// Finish the tasks already submitted, then stop the workers.
+    ~thread_pool();
+
+    thread_pool& operator=(const thread_pool &) = delete;
+    thread_pool& operator=(thread_pool &&) = delete;
+
+    /// Queue a task.
+    void submit(task t);
+
+    /// Queue a function, and get a future for its result.
+    template <typename F>
+    auto async(F f) -> std::future<decltype(f())>
+    {
+        using R = decltype(f());
+        auto t = std::make_shared<std::packaged_task<R()>>(std::move(f));
+        auto result = t->get_future();
+        submit([t] { (*t)(); });
+        return result;
+    }
+
+    /// The number of workers.
+    std::size_t size() const                { return workers_.size(); }
+
+private:
+    /// The tasks of one worker.
+    struct queue
+    {
+        std::mutex       mutex_;
+        std::deque<task> tasks_;
+    };
+
+    void work(std::size_t index);
+
+    /// Take a task, from the worker's own queue if it has any, otherwise
+    /// from another's.
+    bool take(std::size_t index, task &t);
+
+    std::vector<std::unique_ptr<queue>> queues_;
+    std::atomic<std::size_t>            pending_{0u};
+    std::atomic<std::size_t>            next_{0u};
+
+    /// Idle workers wait on these.
+    std::mutex               mutex_;
+    std::condition_variable  ready_;
+    std::vector<std::thread> workers_;
+    bool                     stopping_{false};
+};
+
+} // namespace Calc
+
+#endif // THREAD_POOL_H_INCLUDED
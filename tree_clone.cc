@@ -0,0 +1,166 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "tree_clone.h"
+#include "overloaded.h"
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+Node::Ptr
+copy_tree(const node &n, clone_map &map);
+
+void
+copy_scope(const parent &from, parent &to, clone_map &map)
+{
+    if (from.scope_) {
+        to.scope_ = copy_tree(*from.scope_, map);
+    }
+}
+
+Node::Ptr
+copy_tree(const node &n, clone_map &map)
+{
+    auto copy = std::make_unique<node>();
+    copy->type    = n.type;
+    copy->source  = n.source;
+    copy->m_begin = n.m_begin;
+    copy->m_end   = n.m_end;
+    map[&n] = copy.get();
+
+    // Nodes with a scope hold a unique_ptr, so they must be copied by hand.
+    std::visit(overloaded{
+        [&](const root &r)
+        {
+            root k;
+            copy_scope(r, k, map);
+            copy->kind_ = std::move(k);
+        },
+        [&](const compound_statement &c)
+        {
+            compound_statement k;
+            k.name_ = c.name_;
+            copy_scope(c, k, map);
+            copy->kind_ = std::move(k);
+        },
+        [&](const parallel_loop &l)
+        {
+            parallel_loop k;
+            k.reductions_ = l.reductions_;
+            copy_scope(l, k, map);
+            copy->kind_ = std::move(k);
+        },
+        [&](const function &f)
+        {
+            function k;
+            k.kind_ = f.kind_;
+            k.name_ = f.name_;
+            copy_scope(f, k, map);
+            copy->kind_ = std::move(k);
+        },
+        [&](const auto &k)
+        {
+            copy->kind_ = k;
+        }
+        }, n.kind_);
+
+    for (auto &child : n.children) {
+        copy->children.emplace_back(copy_tree(*child, map));
+    }
+    return copy;
+}
+
+void
+relink(node *&ptr, const clone_map &map)
+{
+    if (auto found = map.find(ptr); found != map.end()) {
+        ptr = found->second;
+    }
+}
+
+void
+relink_tree(node &n, const clone_map &map)
+{
+    std::visit([&map](auto &k)
+        {
+            using K = std::decay_t<decltype(k)>;
+            if constexpr (std::is_base_of_v<symbol_ref, K>) {
+                relink(k.symbol_, map);
+            }
+            if constexpr (std::is_base_of_v<compare_base, K>) {
+                relink(k.lhs_, map);
+                if (k.rhs_) {
+                    relink(k.rhs_, map);
+                }
+            }
+            if constexpr (std::is_same_v<scope, K>) {
+                relink(k.parent_scope_, map);
+                for (auto &sub : k.subscopes_) {
+                    relink(sub, map);
+                }
+            }
+            if constexpr (std::is_same_v<function, K>) {
+                if (std::holds_alternative<node *>(k.kind_)) {
+                    relink(std::get<node *>(k.kind_), map);
+                }
+            }
+        }, n.kind_);
+
+    if (auto p = n.get_parent(); p && p->scope_) {
+        relink_tree(*p->scope_, map);
+    }
+
+    for (auto &child : n.children) {
+        relink_tree(*child, map);
+    }
+}
+
+} // namespace
+
+Node::Ptr
+clone_tree(const node &n, clone_map &map)
+{
+    auto copy = copy_tree(n, map);
+    relink_tree(*copy, map);
+    return copy;
+}
+
+std::size_t
+tree_size(const node &n)
+{
+    std::size_t size = 1;
+    if (auto p = n.get_parent(); p && p->scope_) {
+        size += tree_size(*p->scope_);
+    }
+    for (auto &child : n.children) {
+        size += tree_size(*child);
+    }
+    return size;
+}
+
+} // namespace Calc
@@ -0,0 +1,51 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef TREE_CLONE_H_INCLUDED
+#define TREE_CLONE_H_INCLUDED
+
+#include "node.h"
+
+#include <map>
+
+namespace Calc {
+
+/// Map from an original node to its copy.
+using clone_map = std::map<const Node::node *, Node::node *>;
+
+/// Make a deep copy of a sub-tree, including the scopes hanging off of
+/// any parent nodes in it.  References to nodes inside the sub-tree,
+/// (variables, functions, scopes), are re-linked to the copies,
+/// references to nodes outside the sub-tree are left alone.
+/// @param n The root of the sub-tree to copy.
+/// @param map Filled in with every original node and its copy.
+Node::Ptr clone_tree(const Node::node &n, clone_map &map);
+
+/// Count the nodes in a sub-tree, including scopes.
+std::size_t tree_size(const Node::node &n);
+
+} // namespace Calc
+
+#endif // TREE_CLONE_H_INCLUDED
@@ -0,0 +1,171 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "tree_shaker.h"
+#include "tree_clone.h"
+
+#include <algorithm>
+
+namespace Calc {
+
+using namespace Node;
+
+namespace {
+
+/// Is n a function defined in the script, (rather than an intrinsic)?
+bool
+user_function(const node &n)
+{
+    auto func = n.get_kind<function>();
+    return func && !func->is_intrinsic();
+}
+
+} // namespace
+
+void
+tree_shaker::reach(const node &n)
+{
+    if (auto fc = n.get_kind<function_call>();
+        fc && fc->symbol_ && user_function(*fc->symbol_)) {
+        if (reachable_.insert(fc->symbol_).second) {
+            pending_.push_back(fc->symbol_);
+        }
+    }
+    for (auto &child : n.children) {
+        if (!user_function(*child)) {
+            reach(*child);
+        }
+    }
+}
+
+void
+tree_shaker::remove_functions(node &n)
+{
+    auto &children = n.children;
+    for (auto iter = children.begin(); iter != children.end(); ) {
+        auto &child = **iter;
+        if (!user_function(child) || reachable_.count(&child)) {
+            remove_functions(child);
+            ++iter;
+            continue;
+        }
+        // Unlink the function's scope from the enclosing one.
+        if (auto &s = child.get_kind<function>()->scope_; s) {
+            if (auto par = s->get_kind<scope>()->parent_scope_; par) {
+                auto &subs = par->get_kind<scope>()->subscopes_;
+                subs.erase(std::remove(subs.begin(), subs.end(), s.get()),
+                           subs.end());
+            }
+        }
+        ++functions_;
+        removed_ += tree_size(child);
+        iter = children.erase(iter);
+    }
+}
+
+void
+tree_shaker::reference(const node &n)
+{
+    if (n.get_kind<declaration>()) {
+        return;
+    }
+    if (auto ref = n.get_kind<variable_ref>(); ref) {
+        referenced_.insert(ref->symbol_);
+    } else if (auto inc = n.get_kind<increment>(); inc) {
+        referenced_.insert(inc->symbol_);
+    } else if (auto cmp = n.get_compare(); cmp) {
+        referenced_.insert(cmp->lhs_);
+        referenced_.insert(cmp->rhs_);
+    }
+    for (auto &child : n.children) {
+        reference(*child);
+    }
+}
+
+void
+tree_shaker::remove_variables(node &n)
+{
+    auto &children = n.children;
+    for (auto iter = children.begin(); iter != children.end(); ) {
+        auto &child = **iter;
+        if (child.get_kind<declaration>() &&
+            !referenced_.count(
+                child.children[0]->get_kind<variable_ref>()->symbol_)) {
+            removed_ += tree_size(child);
+            iter = children.erase(iter);
+            continue;
+        }
+        remove_variables(child);
+        ++iter;
+    }
+
+    // Parameters are written by each call, so only the variables of the
+    // root and compound statements are candidates.
+    if (n.get_kind<function>()) {
+        return;
+    }
+    if (auto p = n.get_parent(); p && p->scope_) {
+        auto &vars = p->scope_->children;
+        for (auto iter = vars.begin(); iter != vars.end(); ) {
+            if ((*iter)->get_kind<variable>() &&
+                !referenced_.count(iter->get())) {
+                ++variables_;
+                ++removed_;
+                iter = vars.erase(iter);
+            } else {
+                ++iter;
+            }
+        }
+    }
+}
+
+std::size_t
+tree_shaker::run(node &root)
+{
+    reach(root);
+    while (!pending_.empty()) {
+        auto func = pending_.back();
+        pending_.pop_back();
+        for (auto &child : func->children) {
+            reach(*child);
+        }
+    }
+    remove_functions(root);
+
+    // Look for references only once the dead functions are gone, so that
+    // the variables only they used go too.
+    reference(root);
+    remove_variables(root);
+    return removed_;
+}
+
+void
+tree_shaker::report(std::ostream &os) const
+{
+    os << "Tree shaking removed " << functions_ << " functions, "
+       << variables_ << " variables, " << removed_ << " nodes\n";
+}
+
+} // namespace Calc
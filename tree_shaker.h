@@ -0,0 +1,88 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef TREE_SHAKER_H_INCLUDED
+#define TREE_SHAKER_H_INCLUDED
+
+#include "node.h"
+
+#include <ostream>
+#include <set>
+#include <vector>
+
+namespace Calc {
+
+/// Remove what a script can never use.
+/// Functions are kept if they can be reached through calls from the
+/// top-level statements, the rest are removed, along with their scopes.
+/// Variables which are declared but never otherwise referenced are
+/// removed, along with their declarations.  (A variable which is assigned
+/// but never read is kept, since the assignment is printed.)
+class tree_shaker
+{
+public:
+    tree_shaker() = default;
+    tree_shaker(const tree_shaker &) = delete;
+    tree_shaker(tree_shaker &&) = default;
+    ~tree_shaker() = default;
+
+    tree_shaker& operator=(const tree_shaker &) = delete;
+    tree_shaker& operator=(tree_shaker &&) = default;
+
+    /// Shake an analyzed tree.
+    /// @return The number of nodes removed, (including scopes).
+    std::size_t run(Node::node &root);
+
+    std::size_t functions() const           { return functions_; }
+    std::size_t variables() const           { return variables_; }
+    std::size_t removed() const             { return removed_; }
+
+    /// Print what was removed.
+    void report(std::ostream &os) const;
+
+private:
+    /// Find the functions called from n, (but not from functions in n).
+    void reach(const Node::node &n);
+
+    /// Remove the functions which weren't reached.
+    void remove_functions(Node::node &n);
+
+    /// Find the variables referenced in n, other than by declarations.
+    void reference(const Node::node &n);
+
+    /// Remove the variables which weren't referenced.
+    void remove_variables(Node::node &n);
+
+    std::set<const Node::node *>    reachable_;
+    std::vector<const Node::node *> pending_;
+    std::set<const Node::node *>    referenced_;
+    std::size_t                     functions_{0u};
+    std::size_t                     variables_{0u};
+    std::size_t                     removed_{0u};
+};
+
+} // namespace Calc
+
+#endif // TREE_SHAKER_H_INCLUDED
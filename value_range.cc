@@ -0,0 +1,466 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "value_range.h"
+
+namespace Calc {
+
+using namespace Calc::Node;
+
+namespace {
+
+/// The rounds a loop is looked at before the slots still changing are
+/// taken to hold anything.
+constexpr unsigned widen_after = 4u;
+
+/// The values of an int operation: those given, if none overflow.
+interval
+wrap(std::int64_t low, std::int64_t high)
+{
+    interval result{low, high};
+    return result.fits(32u) ? result : interval::full();
+}
+
+std::int64_t
+magnitude(const interval &r)
+{
+    return std::max(-r.low_, r.high_);
+}
+
+/// The narrowest lanes which hold the values, (32 bits for every int).
+unsigned
+narrowest(const interval &r)
+{
+    return r.fits(8u) ? 8u : r.fits(16u) ? 16u : 32u;
+}
+
+/// The values of an operation, given those of its operands.
+interval
+arithmetic(const node &n, const interval &lhs, const interval &rhs)
+{
+    if (n.get_kind<addition>()) {
+        return wrap(lhs.low_ + rhs.low_, lhs.high_ + rhs.high_);
+    }
+    if (n.get_kind<subtraction>()) {
+        return wrap(lhs.low_ - rhs.high_, lhs.high_ - rhs.low_);
+    }
+    if (n.get_kind<multiplication>()) {
+        std::int64_t products[] = {lhs.low_ * rhs.low_, lhs.low_ * rhs.high_,
+                                   lhs.high_ * rhs.low_,
+                                   lhs.high_ * rhs.high_};
+        return wrap(*std::min_element(std::begin(products),
+                                      std::end(products)),
+                    *std::max_element(std::begin(products),
+                                      std::end(products)));
+    }
+    if (n.get_kind<division>()) {
+        // (Dividing by 0 gives no value at all.)
+        if (rhs.low_ > 0 || rhs.high_ < 0) {
+            std::int64_t quotients[] = {lhs.low_ / rhs.low_,
+                                        lhs.low_ / rhs.high_,
+                                        lhs.high_ / rhs.low_,
+                                        lhs.high_ / rhs.high_};
+            return wrap(*std::min_element(std::begin(quotients),
+                                          std::end(quotients)),
+                        *std::max_element(std::begin(quotients),
+                                          std::end(quotients)));
+        }
+        return wrap(-magnitude(lhs), magnitude(lhs));
+    }
+    if (n.get_kind<modulus>()) {
+        // The remainder is smaller than the divisor, and has the sign of
+        // the dividend.
+        auto bound = std::min(magnitude(lhs),
+                              std::max<std::int64_t>(magnitude(rhs) - 1, 0));
+        return {lhs.low_ < 0 ? -bound : 0, lhs.high_ > 0 ? bound : 0};
+    }
+    if (n.get_kind<unary_minus>()) {
+        return wrap(-lhs.high_, -lhs.low_);
+    }
+    if (n.get_kind<unary_plus>()) {
+        return lhs;
+    }
+    if (n.get_kind<equal_to>() || n.get_kind<not_equal>() ||
+        n.get_kind<less_than>() || n.get_kind<less_or_equal>() ||
+        n.get_kind<greater_than>() || n.get_kind<greater_or_equal>() ||
+        n.get_kind<logical_not>() || n.get_kind<logical_and>() ||
+        n.get_kind<logical_or>() || n.get_kind<logical_and_then>() ||
+        n.get_kind<logical_or_else>()) {
+        return {0, 1};
+    }
+    return interval::full();
+}
+
+/// May the operation be vectorized in narrower lanes?  (Not division, for
+/// which there are no SIMD instructions, nor those which evaluate their
+/// operands for only some lanes.)
+bool
+narrowable(const node &n)
+{
+    return n.get_kind<addition>() || n.get_kind<subtraction>() ||
+           n.get_kind<multiplication>() || n.get_kind<unary_minus>() ||
+           n.get_kind<unary_plus>() || n.get_kind<equal_to>() ||
+           n.get_kind<not_equal>() || n.get_kind<less_than>() ||
+           n.get_kind<less_or_equal>() || n.get_kind<greater_than>() ||
+           n.get_kind<greater_or_equal>() || n.get_kind<logical_not>() ||
+           n.get_kind<logical_and>() || n.get_kind<logical_or>() ||
+           n.get_kind<compare>();
+}
+
+/// The variable a variable_ref refers to, if it is one held in a slot.
+const variable*
+slotted(const node *var)
+{
+    auto v = var ? var->get_kind<variable>() : nullptr;
+    return v && !v->cell_ && v->slot_ >= 0 ? v : nullptr;
+}
+
+void
+join(std::vector<interval> &into, const std::vector<interval> &from)
+{
+    for (auto i = 0u; i < into.size(); ++i) {
+        into[i] = interval::join(into[i], from[i]);
+    }
+}
+
+} // namespace
+
+void
+value_range::run(const std::vector<node *> &statements)
+{
+    for (auto stmt : statements) {
+        statement(*stmt);
+    }
+}
+
+interval
+value_range::range(const node &n) const
+{
+    auto found = ranges_.find(&n);
+    return found == ranges_.end() ? interval::full() : found->second;
+}
+
+std::pair<std::size_t, std::size_t>
+value_range::mark(const std::vector<node *> &statements, bool narrow) const
+{
+    std::pair<std::size_t, std::size_t> counts{0u, 0u};
+    for (auto stmt : statements) {
+        mark(*stmt, narrow, counts);
+    }
+    return counts;
+}
+
+void
+value_range::mark(node &n, bool narrow,
+                  std::pair<std::size_t, std::size_t> &counts) const
+{
+    if (n.get_kind<function>()) {
+        // Not looked at.
+        return;
+    }
+    if (auto op = n.get_operation(); op) {
+        auto b = bits(n);
+        op->narrow_ = narrow && b < 32u ? b : 0u;
+        counts.first += op->narrow_ != 0u;
+        ++counts.second;
+    }
+    for (auto &child : n.children) {
+        mark(*child, narrow, counts);
+    }
+}
+
+unsigned
+value_range::bits(const node &n) const
+{
+    auto found = bits_.find(&n);
+    return found == bits_.end() ? 32u : found->second;
+}
+
+void
+value_range::statement(node &n)
+{
+    if (n.get_kind<assignment_statement>()) {
+        auto values = expression(*n.children[1]);
+        assign(n.children[0]->get_kind<variable_ref>()->symbol_, values);
+    } else if (auto inc = n.get_kind<increment>(); inc) {
+        if (auto var = slotted(inc->symbol_); var) {
+            auto &values = slots_[var->slot_];
+            values = wrap(values.low_ + inc->value_,
+                          values.high_ + inc->value_);
+        }
+    } else if (n.get_kind<expression_statement>() ||
+               n.get_kind<return_statement>()) {
+        expression(*n.children[0]);
+    } else if (n.get_kind<if_statement>()) {
+        expression(*n.children[0]);
+        auto before = slots_;
+        statement(*n.children[1]);
+        auto taken = std::move(slots_);
+        slots_ = std::move(before);
+        if (n.children.size() == 3) {
+            statement(*n.children[2]);
+        }
+        join(slots_, taken);
+    } else if (n.get_kind<compound_statement>()) {
+        for (auto &child : n.children) {
+            statement(*child);
+        }
+    } else if (n.get_kind<loop_top_test_statement>()) {
+        iterate(*n.children[0], *n.children[1], true);
+    } else if (n.get_kind<loop_bottom_test_statement>()) {
+        iterate(*n.children[1], *n.children[0], false);
+    } else if (auto es = n.get_kind<exit_statement>(); es) {
+        if (n.children.size() == 1) {
+            expression(*n.children[0]);
+        }
+        exit(es->name_);
+    } else if (auto ec = n.get_kind<exit_on_compare>(); ec) {
+        exit(ec->name_);
+    } else if (n.get_kind<element_assignment>()) {
+        for (auto i = 1u; i < n.children.size(); ++i) {
+            expression(*n.children[i]);
+        }
+        assign(n.children[0]->get_kind<variable_ref>()->symbol_,
+               interval::full());
+    } else if (!n.get_kind<declaration>() && !n.get_kind<function>() &&
+               !n.get_kind<variable>() && !n.get_kind<scope>()) {
+        // A parallel loop, for one.
+        clobber();
+    }
+}
+
+void
+value_range::iterate(node &condition, node &body, bool top)
+{
+    auto b = body.get_kind<compound_statement>();
+    for (auto round = 0u; ; ++round) {
+        auto head = slots_;
+        state after;
+        if (top) {
+            expression(condition);
+            after = slots_;
+        }
+        loops_.push_back(loop{b ? b->name_ : std::string(), false, {}});
+        statement(body);
+        auto done = std::move(loops_.back());
+        loops_.pop_back();
+        if (!top) {
+            expression(condition);
+            after = slots_;
+        }
+
+        // The next round starts with the values of either.  Once the
+        // values don't change, this round has seen them all.
+        auto changed = false;
+        for (auto i = 0u; i < slots_.size(); ++i) {
+            auto values = interval::join(head[i], slots_[i]);
+            if (values != head[i]) {
+                changed = true;
+                slots_[i] = round < widen_after ? values : interval::full();
+            } else {
+                slots_[i] = values;
+            }
+        }
+        if (!changed) {
+            slots_ = std::move(after);
+            if (done.exited_) {
+                join(slots_, done.exits_);
+            }
+            return;
+        }
+    }
+}
+
+void
+value_range::exit(const std::string &name)
+{
+    for (auto l = loops_.rbegin(); l != loops_.rend(); ++l) {
+        if (name.empty() || name == l->name_) {
+            if (l->exited_) {
+                join(l->exits_, slots_);
+            } else {
+                l->exits_ = slots_;
+                l->exited_ = true;
+            }
+            return;
+        }
+    }
+}
+
+interval
+value_range::expression(node &n)
+{
+    // The values, and the lanes it needs, (32 bits unless it is narrowed).
+    auto result = interval::full();
+    auto width = 32u;
+    if (auto i = n.get_kind<number>(); i) {
+        result = {i->value_, i->value_};
+        width = narrowest(result);
+    } else if (auto ref = n.get_kind<variable_ref>(); ref) {
+        if (auto var = slotted(ref->symbol_); var && !var->length_) {
+            result = slots_[var->slot_];
+            width = narrowest(result);
+        }
+    } else if (auto c = n.get_kind<compare>(); c) {
+        auto lhs = slotted(c->lhs_), rhs = slotted(c->rhs_);
+        result = {0, 1};
+        if (lhs && (rhs || !c->rhs_)) {
+            width = std::max(narrowest(slots_[lhs->slot_]),
+                             rhs ? narrowest(slots_[rhs->slot_])
+                                 : narrowest({c->value_, c->value_}));
+        }
+    } else if (auto fc = n.get_kind<function_call>(); fc) {
+        for (auto &arg : n.children) {
+            expression(*arg);
+        }
+        auto f = fc->symbol_ ? fc->symbol_->get_kind<function>() : nullptr;
+        if (f && !f->is_intrinsic()) {
+            for (auto slot : assigned(*fc->symbol_)) {
+                slots_[slot] = interval::full();
+            }
+        } else if (!f) {
+            clobber();
+        }
+    } else if (n.get_operation()) {
+        auto lhs = interval::full(), rhs = interval::full();
+        auto operands = 8u;
+        for (auto i = 0u; i < n.children.size(); ++i) {
+            auto values = expression(*n.children[i]);
+            (i == 0u ? lhs : rhs) = values;
+            operands = std::max(operands, bits(*n.children[i]));
+        }
+        result = arithmetic(n, lhs, rhs);
+        if (narrowable(n)) {
+            width = std::max(operands, narrowest(result));
+        }
+    } else {
+        // An element of an array, or a builtin, which may change one.
+        for (auto &child : n.children) {
+            expression(*child);
+        }
+        if (n.get_kind<array_builtin>()) {
+            for (auto &child : n.children) {
+                if (auto ref = child->get_kind<variable_ref>(); ref) {
+                    assign(ref->symbol_, interval::full());
+                }
+            }
+        }
+    }
+    ranges_[&n] = result;
+    bits_[&n] = width;
+    return result;
+}
+
+void
+value_range::assign(const node *var, interval values)
+{
+    auto v = slotted(var);
+    if (!v) {
+        return;
+    }
+    if (!v->length_) {
+        slots_[v->slot_] = values;
+        return;
+    }
+    for (auto i = 0; i < v->length_; ++i) {
+        slots_[v->slot_ + i] = interval::full();
+    }
+}
+
+void
+value_range::clobber()
+{
+    std::fill(slots_.begin(), slots_.end(), interval::full());
+}
+
+const std::vector<std::size_t>&
+value_range::assigned(node &function)
+{
+    if (auto found = assigned_.find(&function); found != assigned_.end()) {
+        return found->second;
+    }
+    std::vector<bool> slots(slots_.size());
+    std::vector<const node *> called;
+    assigned(function, slots, called);
+    auto &result = assigned_[&function];
+    for (auto i = 0u; i < slots.size(); ++i) {
+        if (slots[i]) {
+            result.push_back(i);
+        }
+    }
+    return result;
+}
+
+void
+value_range::assigned(node &n, std::vector<bool> &slots,
+                      std::vector<const node *> &called)
+{
+    auto add = [&slots](const node *var)
+        {
+            if (auto v = slotted(var); v) {
+                for (auto i = 0; i < std::max(1, v->length_); ++i) {
+                    slots[v->slot_ + i] = true;
+                }
+            }
+        };
+    auto symbol = [](const node &ref)
+        {
+            auto r = ref.get_kind<variable_ref>();
+            return r ? r->symbol_ : nullptr;
+        };
+
+    if (auto f = n.get_kind<function>(); f) {
+        // Its parameters and variables, and those it saves, (see
+        // frame_allocator), as well as whatever its body assigns.
+        if (std::find(called.begin(), called.end(), &n) != called.end()) {
+            return;
+        }
+        called.push_back(&n);
+        if (f->scope_) {
+            for (auto &var : f->scope_->children) {
+                add(var.get());
+            }
+        }
+        for (auto i = 0; i < f->frame_size_; ++i) {
+            slots[f->frame_ + i] = true;
+        }
+    } else if (n.get_kind<assignment_statement>() ||
+               n.get_kind<element_assignment>()) {
+        add(symbol(*n.children[0]));
+    } else if (auto inc = n.get_kind<increment>(); inc) {
+        add(inc->symbol_);
+    } else if (n.get_kind<array_builtin>()) {
+        for (auto &child : n.children) {
+            add(symbol(*child));
+        }
+    } else if (auto fc = n.get_kind<function_call>(); fc && fc->symbol_) {
+        assigned(*fc->symbol_, slots, called);
+    }
+    for (auto &child : n.children) {
+        assigned(*child, slots, called);
+    }
+}
+
+} // namespace Calc
@@ -0,0 +1,162 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef VALUE_RANGE_H_INCLUDED
+#define VALUE_RANGE_H_INCLUDED
+
+#include "node.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Calc {
+
+/// The values something may take, from low_ to high_, (inclusive).  The
+/// bounds are 64 bit, so that the result of an operation on two ints can
+/// be found before it is known to fit in one.
+struct interval
+{
+    std::int64_t low_ = std::numeric_limits<int>::min();
+    std::int64_t high_ = std::numeric_limits<int>::max();
+
+    /// Every int.
+    static interval full()                  { return interval{}; }
+
+    /// The interval holding both.
+    static interval join(const interval &a, const interval &b)
+    {
+        return {std::min(a.low_, b.low_), std::max(a.high_, b.high_)};
+    }
+
+    /// Do the values fit in signed integers of these bits?
+    bool fits(unsigned bits) const
+    {
+        auto limit = std::int64_t(1) << (bits - 1u);
+        return low_ >= -limit && high_ < limit;
+    }
+
+    bool operator==(const interval &other) const
+    {
+        return low_ == other.low_ && high_ == other.high_;
+    }
+    bool operator!=(const interval &other) const  { return !(*this == other); }
+};
+
+/// Find the values the expressions of some top-level statements may take,
+/// given those the slots may hold before them, (as the inputs of a batch
+/// do).  Constants give their own values, each operation the values its
+/// operands' may give, (every int, if they may overflow), an if statement
+/// those of either branch, and a loop those of any number of iterations,
+/// (any int, for a variable still changing after a few).  A call of a
+/// function may change any slot the function may assign, (to anything).
+///
+/// The additions, subtractions, multiplications, negations, comparisons
+/// and strict logical operations all of whose values, and those of their
+/// operands, and theirs, fit in 8 or 16 bits, may then be marked, so that
+/// the vector_evaluator works on 4 or 2 times as many of them at once.
+class value_range
+{
+public:
+    /// @param slots The number of slots, (see frame_allocator).
+    explicit value_range(std::size_t slots) : slots_(slots) { }
+    value_range(const value_range &) = delete;
+    value_range(value_range &&) = default;
+    ~value_range() = default;
+
+    value_range& operator=(const value_range &) = delete;
+    value_range& operator=(value_range &&) = default;
+
+    /// The values a slot may hold before the statements, (any int, unless
+    /// given).
+    void seed(std::size_t slot, interval values)    { slots_[slot] = values; }
+
+    /// Look at the statements, evaluated in order.
+    void run(const std::vector<Node::node *> &statements);
+
+    /// The values an expression of the statements may take.
+    interval range(const Node::node &n) const;
+
+    /// Set the narrow_ bits of every operation of the statements, (to 0
+    /// unless narrow).
+    /// @return The number of operations marked, and the number in all.
+    std::pair<std::size_t, std::size_t>
+    mark(const std::vector<Node::node *> &statements, bool narrow) const;
+
+private:
+    using state = std::vector<interval>;
+
+    /// A loop being looked at, and the values at the exit statements
+    /// which leave it.
+    struct loop
+    {
+        std::string name_;          ///< The name of its body.
+        bool        exited_ = false;
+        state       exits_;
+    };
+
+    void statement(Node::node &n);
+    interval expression(Node::node &n);
+
+    /// Look at a loop until the values at its start stop changing.
+    /// @param top Is the condition tested before the body?
+    void iterate(Node::node &condition, Node::node &body, bool top);
+
+    /// Leave the loop which an exit statement names.
+    void exit(const std::string &name);
+
+    /// Any slot may now hold anything.
+    void clobber();
+
+    /// The slots a call of a function may change.
+    const std::vector<std::size_t>& assigned(Node::node &function);
+    void assigned(Node::node &n, std::vector<bool> &slots,
+                  std::vector<const Node::node *> &called);
+
+    /// Set the values of a variable's slots, (all of an array's).
+    void assign(const Node::node *var, interval values);
+
+    /// The bits of the narrowest lanes an expression fits in, (8, 16, or
+    /// 32 if it isn't one which may be narrowed).
+    unsigned bits(const Node::node &n) const;
+
+    void mark(Node::node &n, bool narrow,
+              std::pair<std::size_t, std::size_t> &counts) const;
+
+    state                                      slots_;
+    std::vector<loop>                          loops_;
+    std::unordered_map<const Node::node *, interval> ranges_;
+    std::unordered_map<const Node::node *, unsigned> bits_;
+    std::unordered_map<const Node::node *, std::vector<std::size_t>>
+                                               assigned_;
+};
+
+} // namespace Calc
+
+#endif // VALUE_RANGE_H_INCLUDED
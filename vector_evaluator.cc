@@ -0,0 +1,802 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#include "vector_evaluator.h"
+
+#include <algorithm>
+
+#include <CompuBrite/CheckPoint.h>
+
+namespace Calc {
+namespace cbi = CompuBrite;
+
+using namespace Calc::Node;
+
+namespace {
+
+using lanes = vector_evaluator::lanes;
+using mask = vector_evaluator::mask;
+constexpr auto width = vector_evaluator::width;
+
+/// Apply op to each pair of lanes.  The loops here have no branches, so
+/// that the compiler can vectorize them.  (The lanes may be narrower than
+/// ints, see vector_evaluator::narrow.)
+template <typename Column, typename Op>
+void
+each(Column &result, const Column &lhs, const Column &rhs, Op op)
+{
+    for (auto i = 0u; i < width; ++i) {
+        result[i] = op(lhs[i], rhs[i]);
+    }
+}
+
+template <typename Column, typename Op>
+void
+each(Column &result, const Column &operand, Op op)
+{
+    for (auto i = 0u; i < width; ++i) {
+        result[i] = op(operand[i]);
+    }
+}
+
+/// Compare each pair of lanes, giving 1 or 0 as the scalar evaluator does.
+template <typename Column>
+void
+test(Column &result, const Column &lhs, const Column &rhs, relation op)
+{
+    switch (op) {
+    case relation::equal_to:
+        each(result, lhs, rhs, [](int l, int r) { return int(l == r); });
+        break;
+    case relation::not_equal:
+        each(result, lhs, rhs, [](int l, int r) { return int(l != r); });
+        break;
+    case relation::less_than:
+        each(result, lhs, rhs, [](int l, int r) { return int(l < r); });
+        break;
+    case relation::less_or_equal:
+        each(result, lhs, rhs, [](int l, int r) { return int(l <= r); });
+        break;
+    case relation::greater_than:
+        each(result, lhs, rhs, [](int l, int r) { return int(l > r); });
+        break;
+    case relation::greater_or_equal:
+        each(result, lhs, rhs, [](int l, int r) { return int(l >= r); });
+        break;
+    }
+}
+
+bool
+supported(const node &n)
+{
+    if (n.get_kind<parallel_loop>() || n.get_kind<element>() ||
+        n.get_kind<element_assignment>() || n.get_kind<array_builtin>()) {
+        return false;
+    }
+    if (auto var = n.get_kind<variable>(); var && (var->cell_ || var->length_)) {
+        return false;
+    }
+    if (auto ref = n.get_kind<variable_ref>(); ref && ref->symbol_) {
+        if (auto var = ref->symbol_->get_kind<variable>();
+            var && var->cell_) {
+            return false;
+        }
+    }
+    if (auto f = n.get_kind<function>();
+        f && !f->is_intrinsic() && !returns(*n.children[0])) {
+        return false;
+    }
+    if (auto p = n.get_parent(); p && p->scope_ && !supported(*p->scope_)) {
+        return false;
+    }
+    return std::all_of(n.children.begin(), n.children.end(),
+                       [](auto &child) { return supported(*child); });
+}
+
+} // namespace
+
+bool
+vector_evaluator::supports(const node &root)
+{
+    return supported(root);
+}
+
+void
+vector_evaluator::run(node &root, std::size_t count)
+{
+    cbi::CheckPoint::expect(CBI_HERE, count <= width, "Too many lanes");
+    mask_ = count == width ? ~mask(0u) : (mask(1u) << count) - 1u;
+    frames_.clear();
+    accept(root);
+}
+
+void
+vector_evaluator::run(const std::vector<node *> &statements,
+                      std::size_t count)
+{
+    cbi::CheckPoint::expect(CBI_HERE, count <= width, "Too many lanes");
+    mask_ = count == width ? ~mask(0u) : (mask(1u) << count) - 1u;
+    frames_.clear();
+    for (auto stmt : statements) {
+        if (!mask_) {
+            return;
+        }
+        accept(*stmt);
+    }
+}
+
+void
+vector_evaluator::reset()
+{
+    for (auto &v : values_) {
+        v.fill(0);
+    }
+}
+
+void
+vector_evaluator::reset(const std::vector<int> &values)
+{
+    for (auto i = 0u; i < values.size(); ++i) {
+        values_[i].fill(values[i]);
+    }
+}
+
+mask
+vector_evaluator::gone() const
+{
+    mask m = 0u;
+    for (auto &f : frames_) {
+        m |= f.gone_;
+    }
+    return m;
+}
+
+mask
+vector_evaluator::nonzero(const lanes &v)
+{
+    mask m = 0u;
+    for (auto i = 0u; i < width; ++i) {
+        m |= mask(v[i] != 0) << i;
+    }
+    return m;
+}
+
+void
+vector_evaluator::blend(lanes &dst, const lanes &src, mask m)
+{
+    if (m == ~mask(0u)) {
+        dst = src;
+        return;
+    }
+    for (auto i = 0u; i < width; ++i) {
+        auto keep = -int((m >> i) & 1u);
+        dst[i] = (src[i] & keep) | (dst[i] & ~keep);
+    }
+}
+
+bool
+vector_evaluator::narrowed(node &n)
+{
+    auto op = n.get_operation();
+    if (!op || !op->narrow_) {
+        return false;
+    }
+    if (op->narrow_ == 8u) {
+        std::array<std::int8_t, width> result;
+        narrow(n, result);
+        std::copy(result.begin(), result.end(), result_.begin());
+    } else {
+        std::array<std::int16_t, width> result;
+        narrow(n, result);
+        std::copy(result.begin(), result.end(), result_.begin());
+    }
+    return true;
+}
+
+template <typename T>
+void
+vector_evaluator::narrow(node &n, std::array<T, width> &result)
+{
+    // Every value fits in a T, so working on ints, and keeping the low
+    // bits, gives the same results; the compiler does it in T lanes.
+    using column = std::array<T, width>;
+    auto load = [this](column &dst, node *var)
+        {
+            auto &v = value(var);
+            std::copy(v.begin(), v.end(), dst.begin());
+        };
+    auto binary = [this, &n, &result](auto op)
+        {
+            column rhs;
+            narrow(*n.children[0], result);
+            narrow(*n.children[1], rhs);
+            each(result, result, rhs, op);
+        };
+    auto compare = [this, &n, &result](relation op)
+        {
+            column rhs;
+            narrow(*n.children[0], result);
+            narrow(*n.children[1], rhs);
+            test(result, result, rhs, op);
+        };
+
+    if (auto i = n.get_kind<number>(); i) {
+        result.fill(T(i->value_));
+    } else if (auto ref = n.get_kind<variable_ref>(); ref) {
+        load(result, ref->symbol_);
+    } else if (auto c = n.get_kind<Node::compare>(); c) {
+        column rhs;
+        load(result, c->lhs_);
+        if (c->rhs_) {
+            load(rhs, c->rhs_);
+        } else {
+            rhs.fill(T(c->value_));
+        }
+        test(result, result, rhs, c->op_);
+    } else if (n.get_kind<addition>()) {
+        binary([](int l, int r) { return l + r; });
+    } else if (n.get_kind<subtraction>()) {
+        binary([](int l, int r) { return l - r; });
+    } else if (n.get_kind<multiplication>()) {
+        binary([](int l, int r) { return l * r; });
+    } else if (n.get_kind<logical_and>()) {
+        binary([](int l, int r) { return int(l && r); });
+    } else if (n.get_kind<logical_or>()) {
+        binary([](int l, int r) { return int(l || r); });
+    } else if (n.get_kind<equal_to>()) {
+        compare(relation::equal_to);
+    } else if (n.get_kind<not_equal>()) {
+        compare(relation::not_equal);
+    } else if (n.get_kind<less_than>()) {
+        compare(relation::less_than);
+    } else if (n.get_kind<less_or_equal>()) {
+        compare(relation::less_or_equal);
+    } else if (n.get_kind<greater_than>()) {
+        compare(relation::greater_than);
+    } else if (n.get_kind<greater_or_equal>()) {
+        compare(relation::greater_or_equal);
+    } else if (n.get_kind<unary_minus>()) {
+        narrow(*n.children[0], result);
+        each(result, result, [](int v) { return -1 * v; });
+    } else if (n.get_kind<unary_plus>()) {
+        narrow(*n.children[0], result);
+    } else if (n.get_kind<logical_not>()) {
+        narrow(*n.children[0], result);
+        each(result, result, [](int v) { return int(!v); });
+    } else {
+        cbi::CheckPoint::expect(CBI_HERE, false, "Not a narrow operation");
+    }
+}
+
+void
+vector_evaluator::operands(node &n, lanes &lhs, lanes &rhs)
+{
+    accept(*n.children[0]);
+    lhs = result_;
+    accept(*n.children[1]);
+    rhs = result_;
+}
+
+void
+vector_evaluator::pre_visit(node &n, declaration &)
+{
+}
+
+void
+vector_evaluator::pre_visit(node &n, variable &)
+{
+}
+
+void
+vector_evaluator::pre_visit(node &n, function &)
+{
+}
+
+void
+vector_evaluator::pre_visit(node &n, scope &)
+{
+}
+
+void
+vector_evaluator::pre_visit(node &n, root &)
+{
+    for (auto &child : n.children) {
+        if (!mask_) {
+            return;
+        }
+        accept(*child);
+    }
+}
+
+void
+vector_evaluator::pre_visit(node &n, compound_statement &)
+{
+    for (auto &child : n.children) {
+        if (!mask_) {
+            return;
+        }
+        accept(*child);
+    }
+}
+
+void
+vector_evaluator::pre_visit(node &n, variable_ref &var)
+{
+    result_ = value(var.symbol_);
+}
+
+void
+vector_evaluator::pre_visit(node &, number &i)
+{
+    result_.fill(i.value_);
+}
+
+void
+vector_evaluator::body(node &n)
+{
+    auto b = n.get_kind<compound_statement>();
+    cbi::CheckPoint::expect(CBI_HERE, b, "Must be compound statement");
+    frames_.push_back(frame{true, b->name_});
+    accept(n);
+    // Lanes which exit this loop only are done with it.
+    auto left = frames_.back().gone_;
+    frames_.pop_back();
+    mask_ &= ~left;
+}
+
+void
+vector_evaluator::pre_visit(node &n, loop_top_test_statement &)
+{
+    auto &cond = *n.children[0];
+    auto &b = *n.children[1];
+    auto running = mask_;
+    auto active = running;
+    while (active) {
+        mask_ = active;
+        accept(cond);
+        active &= nonzero(result_);
+        if (!active) {
+            break;
+        }
+        mask_ = active;
+        body(b);
+        active = mask_;
+    }
+    mask_ = running & ~gone();
+}
+
+void
+vector_evaluator::pre_visit(node &n, loop_bottom_test_statement &)
+{
+    auto &cond = *n.children[1];
+    auto &b = *n.children[0];
+    auto running = mask_;
+    auto active = running;
+    while (active) {
+        mask_ = active;
+        body(b);
+        active = mask_;
+        if (!active) {
+            break;
+        }
+        accept(cond);
+        active &= nonzero(result_);
+    }
+    mask_ = running & ~gone();
+}
+
+void
+vector_evaluator::pre_visit(node &n, if_statement &)
+{
+    auto running = mask_;
+    accept(*n.children[0]);
+    auto taken = nonzero(result_);
+    mask_ = running & taken;
+    if (mask_) {
+        accept(*n.children[1]);
+    }
+    auto after = mask_;
+    mask_ = running & ~taken;
+    if (mask_ && n.children.size() == 3) {
+        accept(*n.children[2]);
+    }
+    mask_ |= after;
+}
+
+void
+vector_evaluator::exit(const std::string &name, mask m)
+{
+    for (auto f = frames_.rbegin(); f != frames_.rend(); ++f) {
+        if (f->loop_ && (name.empty() || name == f->name_)) {
+            f->gone_ |= m;
+            mask_ &= ~m;
+            return;
+        }
+    }
+    cbi::CheckPoint::expect(CBI_HERE, false, "Exit outside of a loop");
+}
+
+void
+vector_evaluator::pre_visit(node &n, exit_statement &es)
+{
+    auto leaving = mask_;
+    if (n.children.size() == 1) {
+        accept(*n.children[0]);
+        leaving &= nonzero(result_);
+    }
+    if (leaving) {
+        exit(es.name_, leaving);
+    }
+}
+
+void
+vector_evaluator::pre_visit(node &n, exit_on_compare &ec)
+{
+    lanes rhs;
+    if (ec.rhs_) {
+        rhs = value(ec.rhs_);
+    } else {
+        rhs.fill(ec.value_);
+    }
+    test(result_, value(ec.lhs_), rhs, ec.op_);
+    if (auto leaving = mask_ & nonzero(result_); leaving) {
+        exit(ec.name_, leaving);
+    }
+}
+
+void
+vector_evaluator::pre_visit(node &n, return_statement &)
+{
+    accept(*n.children[0]);
+    auto f = std::find_if(frames_.rbegin(), frames_.rend(),
+                          [](auto &f) { return !f.loop_; });
+    cbi::CheckPoint::expect(CBI_HERE, f != frames_.rend(),
+                            "Return outside of a function");
+    blend(f->result_, result_, mask_);
+    f->gone_ |= mask_;
+    mask_ = 0u;
+}
+
+void
+vector_evaluator::pre_visit(node &n, assignment_statement &)
+{
+    auto var = n.children[0]->get_kind<variable_ref>()->symbol_;
+    accept(*n.children[1]);
+    blend(value(var), result_, mask_);
+}
+
+void
+vector_evaluator::pre_visit(node &n, increment &inc)
+{
+    auto &v = value(inc.symbol_);
+    auto step = inc.value_;
+    for (auto i = 0u; i < width; ++i) {
+        v[i] += step & -int((mask_ >> i) & 1u);
+    }
+    result_ = v;
+}
+
+void
+vector_evaluator::pre_visit(node &n, expression_statement &)
+{
+    accept(*n.children[0]);
+}
+
+void
+vector_evaluator::pre_visit(node &n, unary_minus &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    accept(*n.children[0]);
+    each(result_, result_, [](int v) { return -1 * v; });
+}
+
+void
+vector_evaluator::pre_visit(node &n, unary_plus &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    accept(*n.children[0]);
+}
+
+void
+vector_evaluator::pre_visit(node &n, logical_not &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    accept(*n.children[0]);
+    each(result_, result_, [](int v) { return int(!v); });
+}
+
+void
+vector_evaluator::pre_visit(node &n, multiplication &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    each(result_, lhs, rhs, [](int l, int r) { return l * r; });
+}
+
+void
+vector_evaluator::pre_visit(node &n, division &)
+{
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    // Lanes which aren't running may hold anything, including 0.
+    for (auto i = 0u; i < width; ++i) {
+        result_[i] = lhs[i] / (((mask_ >> i) & 1u) ? rhs[i] : 1);
+    }
+}
+
+void
+vector_evaluator::pre_visit(node &n, modulus &)
+{
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    for (auto i = 0u; i < width; ++i) {
+        result_[i] = lhs[i] % (((mask_ >> i) & 1u) ? rhs[i] : 1);
+    }
+}
+
+void
+vector_evaluator::pre_visit(node &n, addition &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    each(result_, lhs, rhs, [](int l, int r) { return l + r; });
+}
+
+void
+vector_evaluator::pre_visit(node &n, subtraction &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    each(result_, lhs, rhs, [](int l, int r) { return l - r; });
+}
+
+void
+vector_evaluator::pre_visit(node &n, logical_or &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    each(result_, lhs, rhs, [](int l, int r) { return int(l || r); });
+}
+
+void
+vector_evaluator::pre_visit(node &n, logical_and &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    each(result_, lhs, rhs, [](int l, int r) { return int(l && r); });
+}
+
+void
+vector_evaluator::pre_visit(node &n, logical_or_else &)
+{
+    // The right operand is evaluated only for the lanes which need it.
+    auto running = mask_;
+    accept(*n.children[0]);
+    auto lhs = result_;
+    mask_ = running & ~nonzero(lhs);
+    if (mask_) {
+        accept(*n.children[1]);
+    } else {
+        result_.fill(0);
+    }
+    each(result_, lhs, result_, [](int l, int r) { return int(l || r); });
+    mask_ = running;
+}
+
+void
+vector_evaluator::pre_visit(node &n, logical_and_then &)
+{
+    auto running = mask_;
+    accept(*n.children[0]);
+    auto lhs = result_;
+    mask_ = running & nonzero(lhs);
+    if (mask_) {
+        accept(*n.children[1]);
+    } else {
+        result_.fill(0);
+    }
+    each(result_, lhs, result_, [](int l, int r) { return int(l && r); });
+    mask_ = running;
+}
+
+void
+vector_evaluator::pre_visit(node &n, equal_to &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    test(result_, lhs, rhs, relation::equal_to);
+}
+
+void
+vector_evaluator::pre_visit(node &n, not_equal &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    test(result_, lhs, rhs, relation::not_equal);
+}
+
+void
+vector_evaluator::pre_visit(node &n, less_than &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    test(result_, lhs, rhs, relation::less_than);
+}
+
+void
+vector_evaluator::pre_visit(node &n, less_or_equal &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    test(result_, lhs, rhs, relation::less_or_equal);
+}
+
+void
+vector_evaluator::pre_visit(node &n, greater_than &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    test(result_, lhs, rhs, relation::greater_than);
+}
+
+void
+vector_evaluator::pre_visit(node &n, greater_or_equal &)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes lhs, rhs;
+    operands(n, lhs, rhs);
+    test(result_, lhs, rhs, relation::greater_or_equal);
+}
+
+void
+vector_evaluator::pre_visit(node &n, compare &c)
+{
+    if (narrowed(n)) {
+        return;
+    }
+    lanes rhs;
+    if (c.rhs_) {
+        rhs = value(c.rhs_);
+    } else {
+        rhs.fill(c.value_);
+    }
+    test(result_, value(c.lhs_), rhs, c.op_);
+}
+
+void
+vector_evaluator::pre_visit(node &n, function_call &fc)
+{
+    cbi::CheckPoint::expect(CBI_HERE, fc.symbol_, "No defined function!");
+    auto f = fc.symbol_->get_kind<function>();
+    cbi::CheckPoint::expect(CBI_HERE, f, "func_node should not be null");
+
+    if (auto func = f->get_intrinsic(); func) {
+        accept(*n.children[0]);
+        for (auto i = 0u; i < width; ++i) {
+            if ((mask_ >> i) & 1u) {
+                result_[i] = func(result_[i]);
+            }
+        }
+        return;
+    }
+
+    // As in the scalar evaluator, the arguments are all evaluated before
+    // any parameter is assigned, and the slots of a function which may
+    // recurse are saved around the call.
+    std::vector<lanes> args;
+    args.reserve(n.children.size());
+    for (auto &arg : n.children) {
+        accept(*arg);
+        args.push_back(result_);
+    }
+    std::vector<lanes> saved;
+    auto first = values_.begin() + f->frame_;
+    if (f->frame_size_) {
+        saved.assign(first, first + f->frame_size_);
+    }
+    auto param = f->scope_->children.begin();
+    for (auto &arg : args) {
+        blend(value((param++)->get()), arg, mask_);
+    }
+
+    auto running = mask_;
+    frames_.push_back(frame{false, {}});
+    accept(*fc.symbol_->children[0]);
+    result_ = frames_.back().result_;
+    frames_.pop_back();
+    mask_ = running;
+
+    if (f->frame_size_) {
+        std::copy(saved.begin(), saved.end(), values_.begin() + f->frame_);
+    }
+}
+
+void
+vector_evaluator::pre_visit(node &n, parallel_loop &)
+{
+    cbi::CheckPoint::expect(CBI_HERE, false,
+                            "Parallel loops are evaluated one row at a time");
+}
+
+void
+vector_evaluator::pre_visit(node &n, element &)
+{
+    cbi::CheckPoint::expect(CBI_HERE, false,
+                            "Arrays are evaluated one row at a time");
+}
+
+void
+vector_evaluator::pre_visit(node &n, element_assignment &)
+{
+    cbi::CheckPoint::expect(CBI_HERE, false,
+                            "Arrays are evaluated one row at a time");
+}
+
+void
+vector_evaluator::pre_visit(node &n, array_builtin &)
+{
+    cbi::CheckPoint::expect(CBI_HERE, false,
+                            "Arrays are evaluated one row at a time");
+}
+
+} // namespace Calc
@@ -0,0 +1,146 @@
+/**
+ * @copyright
+ * Copyright (c) 2021 Rich Newman
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ *   The above copyright notice and this permission notice shall be included in
+ *   all copies or substantial portions of the Software.
+ *
+ *   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @author
+ * Rich Newman
+ */
+
+#ifndef VECTOR_EVALUATOR_H_INCLUDED
+#define VECTOR_EVALUATOR_H_INCLUDED
+
+#include "node.h"
+#include "visitor.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Calc {
+
+/// Evaluate a tree for many independent rows at once, (see batch).
+/// Every value is a column, with a lane for each row, and each operation
+/// works on a whole column in a simple loop, which the compiler can turn
+/// into SIMD instructions, (SSE or AVX2, as the build allows).  Control
+/// flow is handled with a mask of the lanes still running: each side of an
+/// if statement runs for its own lanes, a loop runs until none of its lanes
+/// wants another iteration, and lanes which exit a loop, or return from a
+/// function, wait until it is done.  Nothing is printed.  Operations
+/// whose values are known to fit in 8 or 16 bits, (see value_range), are
+/// evaluated in lanes that wide, so that each instruction does 4 or 2 times
+/// as many.
+class vector_evaluator : public node_visitor
+{
+public:
+    /// The number of rows evaluated at once.
+    static constexpr std::size_t width = 64u;
+
+    using lanes = std::array<int, width>;
+    using mask = std::uint64_t;
+
+    /// @param frame_size The number of variable slots, (see
+    /// frame_allocator).
+    explicit vector_evaluator(std::size_t frame_size = 0u) :
+        values_(frame_size) { }
+    vector_evaluator(const vector_evaluator &) = delete;
+    vector_evaluator(vector_evaluator &&) = default;
+    ~vector_evaluator() = default;
+
+    vector_evaluator& operator=(const vector_evaluator &) = delete;
+    vector_evaluator& operator=(vector_evaluator &&) = default;
+
+#define xx(a, b) void pre_visit(Node::node &, Node::a &) override;
+#include "node_kind.def"
+
+    /// Can the tree be evaluated this way?  Shared variables, parallel
+    /// loops, and functions which may end without a return statement,
+    /// (whose result depends on the order things were evaluated in), need
+    /// the scalar evaluator.
+    static bool supports(const Node::node &root);
+
+    /// Evaluate the tree for the first count lanes.
+    void run(Node::node &root, std::size_t count);
+
+    /// Evaluate some of the top-level statements of a tree, in order, for
+    /// the first count lanes.
+    void run(const std::vector<Node::node *> &statements, std::size_t count);
+
+    /// Set every slot back to 0.
+    void reset();
+
+    /// Set every slot to its value in values, in every lane.
+    void reset(const std::vector<int> &values);
+
+    /// The storage for a slot, (see frame_allocator).
+    lanes& column(std::size_t slot)         { return values_[slot]; }
+
+private:
+    /// A loop, or a function call, which lanes may leave early.
+    struct frame
+    {
+        bool        loop_ = true;
+        std::string name_;          ///< The name of a loop's body.
+        mask        gone_ = 0u;     ///< Lanes which left it early.
+        lanes       result_{};      ///< What each lane of a call returned.
+    };
+
+    /// The lanes which have left an enclosing loop or call, (and must
+    /// wait for it to finish).
+    mask gone() const;
+
+    /// The lanes of a column which are not 0.
+    static mask nonzero(const lanes &v);
+
+    /// Copy the lanes of src which are in m to dst.
+    static void blend(lanes &dst, const lanes &src, mask m);
+
+    lanes& value(Node::node *var)
+    {
+        return values_[var->get_kind<Node::variable>()->slot_];
+    }
+
+    /// Evaluate an operation marked narrow, (see value_range), in lanes of
+    /// that many bits, and widen its result into result_.
+    /// @return Was it marked?
+    bool narrowed(Node::node &n);
+
+    /// Evaluate a narrow operation, or one of its operands, in lanes of T.
+    template <typename T>
+    void narrow(Node::node &n, std::array<T, width> &result);
+
+    /// Evaluate the operands of a binary operation.
+    void operands(Node::node &n, lanes &lhs, lanes &rhs);
+
+    /// Leave the loop which an exit statement names, for the lanes in m.
+    void exit(const std::string &name, mask m);
+
+    /// Run the body of a loop, for the lanes in mask_.
+    void body(Node::node &n);
+
+    std::vector<lanes> values_;
+    std::vector<frame> frames_;
+    lanes              result_{};
+    mask               mask_ = 0u;
+};
+
+} // namespace Calc
+
+#endif // VECTOR_EVALUATOR_H_INCLUDED
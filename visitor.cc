@@ -37,6 +37,7 @@ void
 node_visitor::accept(node &n, Mode mode)
 {
     auto &kind = n.kind_;
+    ++dispatches_;
     std::visit([this, &n, mode](auto &arg)
         {
             cbi::CheckPoint cp("visitor-accept");
@@ -65,8 +65,12 @@ public:
 
     void set_traversal(traversal &trav)     { traversal_ = &trav; }
 
+    /// The number of nodes accepted so far.
+    auto dispatches() const                 { return dispatches_; }
+
 protected:
     traversal   *traversal_ = nullptr;
+    std::size_t dispatches_{0u};
 
 };
 